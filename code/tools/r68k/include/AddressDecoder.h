@@ -6,39 +6,258 @@
 #define ROSCOM68K_EMU_ADDRESS_DECODER_H
 
 #include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <memory>
+#include <vector>
+#include "Device.h"
 #include "Memory.h"
+#include "MemoryMap.h"
 
 namespace rosco {
     namespace m68k {
         namespace emu {
             class AddressDecoder {
             public:
-                explicit AddressDecoder(std::uint32_t romsize, std::uint32_t ramsize, char const* filename);
+                // Guest address space is split into pages, each of which either
+                // maps straight onto host memory (RAM/ROM) or falls back to the
+                // slow, fully-decoded path (I/O, unmapped, ROM writes, /BOOT
+                // shadow).
+                static constexpr std::uint32_t PAGE_BITS = 12;
+                static constexpr std::uint32_t PAGE_SIZE = 1 << PAGE_BITS;
+                static constexpr std::uint32_t PAGE_MASK = PAGE_SIZE - 1;
+                static constexpr std::uint32_t BUS_SIZE = 0x01000000;
+                static constexpr std::uint32_t PAGE_COUNT = BUS_SIZE >> PAGE_BITS;
 
-                Memory* getMemoryForAddress(std::uint32_t address);
-                std::uint32_t makeRelativeAddress(std::uint32_t address);
+                // As many as a page's region byte can tell apart
+                static constexpr std::uint32_t MAX_REGIONS = 255;
+
+                // Memory in a snapshot starts on this boundary, so it can be
+                // mapped straight from the file on any host page size
+                static constexpr std::uint32_t SNAPSHOT_ALIGN = 0x10000;
+
+                // Regions are laid out as in the map, with the ROM image (if
+                // any) loaded into its first ROM region. Throws
+                // std::runtime_error if the map has no ROM.
+                AddressDecoder(const MemoryMap &map, char const* filename);
 
                 void reset();
 
-                std::uint32_t read32(std::uint32_t address);
-                std::uint16_t read16(std::uint32_t address);
-                std::uint8_t read8(std::uint32_t address);
+                // Called for an access to an unmapped address, or a write to
+                // ROM, before it reads as zero or is dropped. The handler may
+                // raise a bus error in the CPU instead of returning, which
+                // longjmps out of the decoder and the memory callback that
+                // called it; the decoder holds nothing across the call that
+                // would need unwinding, and callers that do (trap handlers)
+                // must stop the handler raising one.
+                using FaultHandler = std::function<void(std::uint32_t address, bool write)>;
+                void setFaultHandler(FaultHandler handler) { this->faultHandler = std::move(handler); }
+
+                // Route accesses to [base, base + size) to a device's registers.
+                // The range is taken off the fast path; the device must outlive
+                // the decoder.
+                void attach(std::uint32_t base, std::uint32_t size, Device *device);
+
+#ifndef MEM_TRACE
+                // Host view of guest memory from address to the end of its
+                // page (length is set to the bytes available), or nullptr if
+                // the page is not directly mapped. Lets traps and devices work
+                // on runs of guest bytes rather than one access per byte.
+                inline const std::uint8_t* readSpan(std::uint32_t address, std::uint32_t &length) {
+                    std::uint8_t *page = address < BUS_SIZE ? this->readPages[address >> PAGE_BITS] : nullptr;
+
+                    length = PAGE_SIZE - (address & PAGE_MASK);
+                    return page != nullptr ? page + (address & PAGE_MASK) : nullptr;
+                }
+
+                inline std::uint8_t* writeSpan(std::uint32_t address, std::uint32_t &length) {
+                    std::uint8_t *page = address < BUS_SIZE ? this->writePages[address >> PAGE_BITS] : nullptr;
+
+                    length = PAGE_SIZE - (address & PAGE_MASK);
+                    return page != nullptr ? page + (address & PAGE_MASK) : nullptr;
+                }
+
+                inline std::uint32_t read32(std::uint32_t address) {
+                    std::uint32_t offset = address & PAGE_MASK;
+
+                    if (address < BUS_SIZE && offset <= PAGE_SIZE - 4) {
+                        std::uint8_t *page = this->readPages[address >> PAGE_BITS];
+
+                        if (page != nullptr) {
+                            std::uint32_t data;
+                            std::memcpy(&data, page + offset, sizeof(data));
+                            return bswap_32(data);
+                        }
+                    }
+
+                    return slowRead32(address);
+                }
+
+                inline std::uint16_t read16(std::uint32_t address) {
+                    std::uint32_t offset = address & PAGE_MASK;
+
+                    if (address < BUS_SIZE && offset <= PAGE_SIZE - 2) {
+                        std::uint8_t *page = this->readPages[address >> PAGE_BITS];
+
+                        if (page != nullptr) {
+                            std::uint16_t data;
+                            std::memcpy(&data, page + offset, sizeof(data));
+                            return bswap_16(data);
+                        }
+                    }
+
+                    return slowRead16(address);
+                }
+
+                inline std::uint8_t read8(std::uint32_t address) {
+                    if (address < BUS_SIZE) {
+                        std::uint8_t *page = this->readPages[address >> PAGE_BITS];
+
+                        if (page != nullptr) {
+                            return page[address & PAGE_MASK];
+                        }
+                    }
+
+                    return slowRead8(address);
+                }
+
+                inline void write32(std::uint32_t address, std::uint32_t data) {
+                    std::uint32_t offset = address & PAGE_MASK;
+
+                    if (address < BUS_SIZE && offset <= PAGE_SIZE - 4) {
+                        std::uint8_t *page = this->writePages[address >> PAGE_BITS];
+
+                        if (page != nullptr) {
+                            data = bswap_32(data);
+                            std::memcpy(page + offset, &data, sizeof(data));
+                            return;
+                        }
+                    }
 
-                void write32(std::uint32_t address, std::uint32_t data);
-                void write16(std::uint32_t address, std::uint16_t data);
-                void write8(std::uint32_t address, std::uint8_t data);
+                    slowWrite32(address, data);
+                }
+
+                inline void write16(std::uint32_t address, std::uint16_t data) {
+                    std::uint32_t offset = address & PAGE_MASK;
+
+                    if (address < BUS_SIZE && offset <= PAGE_SIZE - 2) {
+                        std::uint8_t *page = this->writePages[address >> PAGE_BITS];
+
+                        if (page != nullptr) {
+                            data = bswap_16(data);
+                            std::memcpy(page + offset, &data, sizeof(data));
+                            return;
+                        }
+                    }
+
+                    slowWrite16(address, data);
+                }
+
+                inline void write8(std::uint32_t address, std::uint8_t data) {
+                    if (address < BUS_SIZE) {
+                        std::uint8_t *page = this->writePages[address >> PAGE_BITS];
+
+                        if (page != nullptr) {
+                            page[address & PAGE_MASK] = data;
+                            return;
+                        }
+                    }
+
+                    slowWrite8(address, data);
+                }
+#else
+                const std::uint8_t* readSpan(std::uint32_t address, std::uint32_t &length) {
+                    length = PAGE_SIZE - (address & PAGE_MASK);
+                    return nullptr;
+                }
+
+                std::uint8_t* writeSpan(std::uint32_t address, std::uint32_t &length) {
+                    length = PAGE_SIZE - (address & PAGE_MASK);
+                    return nullptr;
+                }
+
+                std::uint32_t read32(std::uint32_t address) { return slowRead32(address); }
+                std::uint16_t read16(std::uint32_t address) { return slowRead16(address); }
+                std::uint8_t read8(std::uint32_t address) { return slowRead8(address); }
+
+                void write32(std::uint32_t address, std::uint32_t data) { slowWrite32(address, data); }
+                void write16(std::uint32_t address, std::uint16_t data) { slowWrite16(address, data); }
+                void write8(std::uint32_t address, std::uint8_t data) { slowWrite8(address, data); }
+#endif
+
+                // Bulk copies between guest memory and a host buffer, for DMA-style
+                // device transfers. Spans are copied whole; anything else goes
+                // through the slow path a byte at a time.
+                void readBlock(std::uint32_t address, void *dst, std::uint32_t size);
+                void writeBlock(std::uint32_t address, const void *src, std::uint32_t size);
+                void fillBlock(std::uint32_t address, std::uint8_t value, std::uint32_t size);
 
                 void LoadMemoryFile(const uint32_t baseAddr, char const* filename);
 
+                // Write the /BOOT state, memory layout and contents to a
+                // snapshot from out's current position, or bring them back
+                // from fd at offset. The layout must match this decoder's;
+                // contents are restored as copy-on-write mappings of the file.
+                void save(std::ostream &out);
+                void restore(int fd, off_t offset);
+
+                // Keep a copy of RAM and the /BOOT state, and start noting
+                // which pages are written to, so rollback() can put back just
+                // those. Each page's first write after a checkpoint or
+                // rollback takes the slow path.
+                void checkpoint();
+                void rollback();
+
             private:
-                std::unique_ptr<Memory> rom;
-                std::unique_ptr<Memory> ram;
+                struct DeviceMapping {
+                    std::uint32_t base;
+                    std::uint32_t size;
+                    Device *device;
+                };
+
+                struct Region {
+                    MemoryRegion::Type type;
+                    std::uint32_t base;
+                    std::uint32_t size;
+                    std::unique_ptr<Memory> mem;        // none for I/O slots
+                };
+
+                std::vector<Region> regions;
+                Region *rom;
                 bool bootLineActive;
                 uint32_t bootReadCount;
+                std::vector<DeviceMapping> devices;
+                FaultHandler faultHandler;
+
+                std::vector<std::vector<std::uint8_t>> savedRam;    // by region, empty if not RAM
+                bool savedBootLineActive;
+                uint32_t savedBootReadCount;
+                bool tracking;
+                std::vector<std::uint32_t> dirtyPages;
+                bool pageDirty[PAGE_COUNT];
+
+                std::uint8_t *readPages[PAGE_COUNT];
+                std::uint8_t *writePages[PAGE_COUNT];
+                std::uint8_t pageRegions[PAGE_COUNT];   // index + 1 into regions, 0 if unmapped
+
+                std::uint32_t slowRead32(std::uint32_t address);
+                std::uint16_t slowRead16(std::uint32_t address);
+                std::uint8_t slowRead8(std::uint32_t address);
+
+                void slowWrite32(std::uint32_t address, std::uint32_t data);
+                void slowWrite16(std::uint32_t address, std::uint16_t data);
+                void slowWrite8(std::uint32_t address, std::uint8_t data);
+
+                Device* getDeviceForAddress(std::uint32_t address, std::uint32_t &offset);
+                Region* getRegionForAddress(std::uint32_t address);
+                Memory* getMemoryForRead(std::uint32_t address, std::uint32_t &offset);
+                Memory* getMemoryForWrite(std::uint32_t address, std::uint32_t &offset);
 
-                void ReadRomData(char const* filename);
+                void mapPages(std::uint32_t base, Memory *mem, bool writable);
+                void unmapPages(std::uint32_t base, std::uint32_t size);
+                void buildPageTable();
+                void markDirty(std::uint32_t address);
             };
         }
     }
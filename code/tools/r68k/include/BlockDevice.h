@@ -0,0 +1,54 @@
+//
+// Memory-mapped SD card image.
+//
+
+#ifndef ROSCOM68K_EMU_BLOCK_DEVICE_H
+#define ROSCOM68K_EMU_BLOCK_DEVICE_H
+
+#include <cstddef>
+#include <cstdint>
+#include "AddressDecoder.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // Exposes a disk image as 512-byte blocks, mapped into the host
+            // address space so transfers are a straight copy to or from
+            // guest memory. With an overlay, the image is mapped
+            // copy-on-write: the guest sees its own writes, but they never
+            // reach the file, so many machines can share one base image.
+            class BlockDevice {
+            public:
+                static constexpr std::uint32_t BLOCK_SIZE = 512;
+
+                BlockDevice(char const* filename, bool overlay);
+                ~BlockDevice();
+
+                BlockDevice(const BlockDevice&) = delete;
+                BlockDevice& operator=(const BlockDevice&) = delete;
+
+                bool isOpen() const { return this->image != nullptr; }
+                std::uint64_t blockCount() const { return this->size / BLOCK_SIZE; }
+
+                // Transfer count blocks between the image and guest memory.
+                // Returns false (and transfers nothing) if out of range.
+                bool read(std::uint32_t block, std::uint32_t count, AddressDecoder &mem, std::uint32_t address);
+                bool write(std::uint32_t block, std::uint32_t count, AddressDecoder &mem, std::uint32_t address);
+
+                // Host view of count blocks from block, for devices that move
+                // data a word at a time; nullptr if out of range
+                std::uint8_t* blocks(std::uint32_t block, std::uint32_t count) {
+                    return inRange(block, count) ? this->image + (std::size_t)block * BLOCK_SIZE : nullptr;
+                }
+
+            private:
+                bool inRange(std::uint32_t block, std::uint32_t count) const;
+
+                std::uint8_t *image;
+                std::size_t size;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_BLOCK_DEVICE_H
@@ -0,0 +1,40 @@
+//
+// Buffered console output for the emulated machine.
+//
+
+#ifndef ROSCOM68K_EMU_CONSOLE_BUFFER_H
+#define ROSCOM68K_EMU_CONSOLE_BUFFER_H
+
+#include <streambuf>
+#include <vector>
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // Collects guest console output in front of a file descriptor so
+            // it costs one write() per line on a terminal, or per buffer-full
+            // otherwise, instead of one per character or trap. The machine
+            // also flushes it before reading input and on a timer, so prompts
+            // without a newline still show up.
+            class ConsoleBuffer : public std::streambuf {
+            public:
+                explicit ConsoleBuffer(int fd, std::size_t size = 65536);
+                ~ConsoleBuffer() override;
+
+            protected:
+                int_type overflow(int_type ch) override;
+                std::streamsize xsputn(const char *s, std::streamsize n) override;
+                int sync() override;
+
+            private:
+                bool drain();
+
+                int fd;
+                bool lineMode;
+                std::vector<char> buffer;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_CONSOLE_BUFFER_H
@@ -0,0 +1,70 @@
+//
+// Buffered console input for the emulated machine.
+//
+
+#ifndef ROSCOM68K_EMU_CONSOLE_INPUT_H
+#define ROSCOM68K_EMU_CONSOLE_INPUT_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // Reads a file descriptor (the terminal, a pipe or a script file)
+            // on its own thread into a single-producer, single-consumer ring.
+            // The machine's input traps only look at the ring, so polling for
+            // a key costs a couple of loads rather than a select() each, and
+            // a read that finds nothing blocks on a condition rather than
+            // spinning on read().
+            class ConsoleInput {
+            public:
+                static constexpr std::size_t CAPACITY = 4096;      // power of two
+
+                explicit ConsoleInput(int fd);
+                ~ConsoleInput();
+
+                ConsoleInput(const ConsoleInput&) = delete;
+                ConsoleInput& operator=(const ConsoleInput&) = delete;
+
+                // Whether a byte is waiting; never makes a system call
+                bool ready() const {
+                    return this->head.load(std::memory_order_acquire) != this->tail.load(std::memory_order_relaxed);
+                }
+
+                // The input has ended and every byte of it has been read
+                bool exhausted() const {
+                    return this->ended.load(std::memory_order_acquire) && !ready();
+                }
+
+                // Wait up to timeout for a byte; zero just polls. Returns
+                // ready(), so false once the input is exhausted.
+                bool wait(std::chrono::nanoseconds timeout);
+
+                // Take the next byte, blocking until one arrives. Returns -1
+                // once the input is exhausted.
+                int read();
+
+            private:
+                void pump();
+
+                int fd;
+                int wakeFds[2];
+                std::uint8_t ring[CAPACITY];
+                std::atomic<std::size_t> head;          // written by the pump
+                std::atomic<std::size_t> tail;          // written by the CPU thread
+                std::atomic<bool> ended;
+                std::atomic<bool> full;                 // pump is waiting for room
+                std::mutex lock;
+                std::condition_variable changed;
+                std::thread thread;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_CONSOLE_INPUT_H
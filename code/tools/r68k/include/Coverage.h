@@ -0,0 +1,62 @@
+//
+// Guest code coverage.
+//
+
+#ifndef ROSCOM68K_EMU_COVERAGE_H
+#define ROSCOM68K_EMU_COVERAGE_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ElfLines.h"
+#include "ElfSymbols.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // Which guest instructions ran, from a map the CPU fills in as it
+            // goes: a byte per word of the address space, holding the longest
+            // straight-line run of instructions started from there. That
+            // costs the CPU one byte store per run rather than a call per
+            // instruction; the runs are only turned back into instructions,
+            // functions and source lines when the results are written.
+            class Coverage {
+            public:
+                Coverage();
+
+                // For m68k_set_coverage_map()
+                std::uint8_t* map() { return this->runs.data(); }
+
+                // Work out the instructions run from the map, disassembling
+                // guest memory as it is now with cpuType. Call once the run
+                // is over, with its machine loaded on this thread, before
+                // writing the results.
+                void collect(unsigned cpuType);
+
+                // Instructions run out of those there are, per function
+                void writeSummary(std::ostream &out, const ElfSymbols &symbols) const;
+
+                // An lcov tracefile: functions and source lines hit, for
+                // genhtml and friends. Needs the program's line table.
+                void writeLcov(std::ostream &out, const std::string &test, const ElfSymbols &symbols, const ElfLines &lines) const;
+
+            private:
+                struct Function {
+                    const ElfSymbols::Symbol *symbol;
+                    std::uint32_t end;
+                };
+
+                std::vector<Function> functions(const ElfSymbols &symbols) const;
+                std::uint32_t ran(std::uint32_t address, std::uint32_t end) const;
+
+                std::vector<std::uint8_t> runs;
+                std::vector<std::uint32_t> executed;        // sorted
+                unsigned cpuType;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_COVERAGE_H
@@ -0,0 +1,46 @@
+//
+// Memory-mapped I/O device on the emulated bus.
+//
+
+#ifndef ROSCOM68K_EMU_DEVICE_H
+#define ROSCOM68K_EMU_DEVICE_H
+
+#include <cstdint>
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // A register file the address decoder routes accesses to, by
+            // offset from wherever it is attached. Devices on the 8-bit side
+            // of the bus only need the byte accessors; wider accesses are
+            // split into bytes, big-endian, unless the device overrides them.
+            class Device {
+            public:
+                virtual ~Device() = default;
+
+                virtual std::uint8_t read8(std::uint32_t offset) = 0;
+                virtual void write8(std::uint32_t offset, std::uint8_t data) = 0;
+
+                virtual std::uint16_t read16(std::uint32_t offset) {
+                    return (read8(offset) << 8) | read8(offset + 1);
+                }
+
+                virtual void write16(std::uint32_t offset, std::uint16_t data) {
+                    write8(offset, data >> 8);
+                    write8(offset + 1, data);
+                }
+
+                virtual std::uint32_t read32(std::uint32_t offset) {
+                    return (read16(offset) << 16) | read16(offset + 2);
+                }
+
+                virtual void write32(std::uint32_t offset, std::uint32_t data) {
+                    write16(offset, data >> 16);
+                    write16(offset + 2, data);
+                }
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_DEVICE_H
@@ -0,0 +1,78 @@
+//
+// Batch disassembly of guest images.
+//
+
+#ifndef ROSCOM68K_EMU_DISASSEMBLER_H
+#define ROSCOM68K_EMU_DISASSEMBLER_H
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ElfSymbols.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // Lists whole images (a ROM, a .bin or the code in an ELF)
+            // straight out of host memory, rather than an instruction at a
+            // time through the disassembler's read callbacks. Each image is
+            // swept in chunks spread over a pool of threads; a chunk is
+            // decoded from its own start, then joined up with wherever the
+            // chunk before it ran into, so the listing is the same as one
+            // sweep from the beginning. Function symbols and the targets of
+            // branches and jumps get labels, and branches into a function
+            // are annotated with where they land.
+            class Disassembler {
+            public:
+                // cpuType as for m68k_disassemble(). Needs the core's
+                // tables built (by m68k_init()) before it is used.
+                Disassembler(unsigned cpuType, unsigned jobs);
+
+                // Code to list at address; bytes must outlive the listing
+                void add(std::uint32_t address, const std::uint8_t *bytes, std::uint32_t size);
+
+                // Disassemble everything added and write it out. Returns
+                // the number of instructions listed.
+                std::uint64_t write(std::ostream &out, const ElfSymbols &symbols);
+
+            private:
+                struct Region {
+                    std::uint32_t address;
+                    const std::uint8_t *bytes;
+                    std::uint32_t size;
+                };
+
+                struct Line {
+                    std::uint32_t address;
+                    std::uint32_t target;       // M68K_NO_TARGET if none
+                    std::uint32_t text;         // offset into the chunk's text
+                    std::uint32_t size;
+                };
+
+                struct Chunk {
+                    std::size_t region;
+                    std::uint32_t start;
+                    std::uint32_t end;
+                    std::vector<Line> lines;
+                    std::string text;           // each line's, NUL-terminated
+                    std::string listing;
+                };
+
+                void decode(Chunk &chunk, std::uint32_t from) const;
+                void join();
+                void format(Chunk &chunk, const ElfSymbols &symbols, const std::vector<std::uint32_t> &targets) const;
+                void forEachChunk(const std::function<void(Chunk&)> &work);
+
+                unsigned cpuType;
+                unsigned jobs;
+                std::vector<Region> regions;
+                std::vector<Chunk> chunks;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_DISASSEMBLER_H
@@ -0,0 +1,128 @@
+//
+// XR68C681 DUART on the emulated bus.
+//
+
+#ifndef ROSCOM68K_EMU_DUART_H
+#define ROSCOM68K_EMU_DUART_H
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <sys/types.h>
+#include "Device.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            class Machine;
+
+            // Register-level model of the rosco_m68k r2 mainboard DUART, with
+            // its registers on the odd bytes from BASE. Channel A is the
+            // console: its transmitter writes to the machine's (buffered)
+            // console, and its receive FIFO is topped up from the machine's
+            // input, several bytes at a time, whenever the guest looks at it.
+            // Channel B has nothing attached. The counter/timer runs in guest
+            // cycles off the scheduler, and interrupts are vectored through
+            // IVR on IRQ 4, as on the real board.
+            //
+            // Firmware that never programs the timer (such as r68k's own ROM)
+            // still gets the old fixed system tick on vector 0x45, until the
+            // guest starts the timer with its interrupt enabled.
+            class Duart : public Device {
+            public:
+                static constexpr std::uint32_t BASE = 0x00f00000;
+                static constexpr std::uint32_t SIZE = 0x40;
+                static constexpr int IRQ = 4;
+                static constexpr std::uint8_t TICK_VECTOR = 0x45;
+                static constexpr std::uint32_t XTAL_HZ = 3686400;
+                static constexpr std::uint32_t RX_FIFO = 3;
+
+                explicit Duart(Machine &machine);
+
+                // Where channel A's received bytes come from: whether one is
+                // waiting, and take it. Unset, the receiver never sees data.
+                void setInput(std::function<bool()> ready, std::function<char()> read) {
+                    this->inputReady = std::move(ready);
+                    this->inputRead = std::move(read);
+                }
+
+                void reset();
+
+                // The old free-running system tick, from the -t scheduler event
+                void legacyTick();
+
+                // Vector for an acknowledged level 4 interrupt
+                int acknowledge();
+
+                // Drive the CPU's interrupt line from the current state
+                void updateIrq();
+
+                std::uint8_t read8(std::uint32_t offset) override;
+                void write8(std::uint32_t offset, std::uint8_t data) override;
+
+                // Registers and FIFOs, for machine snapshots. After a restore,
+                // resume() once the scheduler and CPU are back, to re-arm the
+                // counter and interrupt line.
+                void save(std::ostream &out);
+                void restore(int fd, off_t offset);
+                void resume();
+                static std::size_t stateSize();
+
+            private:
+                struct Channel {
+                    std::uint8_t mr1;
+                    std::uint8_t mr2;
+                    std::uint8_t csr;
+                    std::uint8_t status;        // error bits of SR
+                    std::uint8_t rx[RX_FIFO];
+                    std::uint8_t rxCount;
+                    bool mrPointer;             // next MR access is MR2
+                    bool rxEnabled;
+                    bool txEnabled;
+                };
+
+                struct State {
+                    Channel a;
+                    Channel b;
+                    std::uint8_t acr;
+                    std::uint8_t isr;
+                    std::uint8_t imr;
+                    std::uint8_t ivr;
+                    std::uint8_t opcr;
+                    std::uint8_t opr;
+                    std::uint16_t ctPreset;
+                    bool ctRunning;
+                    bool tickPending;
+                    std::uint64_t ctStart;      // cycle the counter was (re)started
+                };
+
+                std::uint8_t readStatus(Channel &channel);
+                std::uint8_t readRx(Channel &channel);
+                std::uint8_t readMode(Channel &channel);
+                void writeMode(Channel &channel, std::uint8_t data);
+                void command(Channel &channel, std::uint8_t data);
+                void fillRx();
+                void updateTxRx();
+
+                bool timerMode() const { return this->state.acr & 0x40; }
+                std::uint32_t prescale() const;
+                std::uint64_t ticksToCycles(std::uint64_t ticks) const;
+                std::uint64_t ticksSinceStart() const;
+                std::uint16_t counterValue() const;
+                void startCounter();
+                void armCounter();
+                void armRxPoll();
+
+                Machine &machine;
+                State state;
+                std::uint64_t ctEvents;         // counter periods scheduled so far
+                std::uint32_t ctGeneration;     // stale scheduler events are ignored
+                std::uint32_t rxGeneration;
+                std::function<bool()> inputReady;
+                std::function<char()> inputRead;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_DUART_H
@@ -0,0 +1,74 @@
+//
+// Loadable segments of a guest ELF executable.
+//
+
+#ifndef ROSCOM68K_EMU_ELF_IMAGE_H
+#define ROSCOM68K_EMU_ELF_IMAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "AddressDecoder.h"
+#include "ElfSymbols.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // A big-endian ELF32 68k executable, as the toolchain links it
+            // before objcopy turns it into a .bin. Each PT_LOAD segment goes
+            // at its load (physical) address, which for programs that
+            // relocate themselves (such as those built on start_serial) is
+            // where the .bin would have been loaded, not where they run.
+            class ElfImage {
+            public:
+                // Whether the file starts with the ELF magic
+                static bool isElf(char const* filename);
+
+                // Returns false, with the reason in error(), if the file
+                // can't be read or isn't a 68k executable
+                bool load(char const* filename);
+
+                // Copy the segments into guest memory, zeroing the part of
+                // each not in the file (.bss)
+                void place(AddressDecoder &mem) const;
+
+                // Load address of the entry point
+                std::uint32_t entry() const { return this->entryPoint; }
+
+                // An executable segment's contents as they are in the file,
+                // at the address it was linked to run at
+                struct Code {
+                    std::uint32_t address;
+                    const std::uint8_t *bytes;
+                    std::uint32_t size;
+                };
+
+                // The executable segments, for disassembly
+                std::vector<Code> code() const;
+
+                // The executable's code symbols (empty if it was stripped)
+                const ElfSymbols& symbols() const { return this->syms; }
+
+                const std::string& error() const { return this->message; }
+
+            private:
+                struct Segment {
+                    std::uint32_t address;
+                    std::uint32_t runAddress;   // linked (virtual) address
+                    std::uint32_t offset;       // in the file
+                    std::uint32_t fileSize;
+                    std::uint32_t memSize;
+                    bool executable;
+                };
+
+                std::vector<std::uint8_t> data;
+                std::vector<Segment> segments;
+                std::uint32_t entryPoint = 0;
+                ElfSymbols syms;
+                std::string message;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_ELF_IMAGE_H
@@ -0,0 +1,60 @@
+//
+// Source line table from a guest ELF executable's debug info.
+//
+
+#ifndef ROSCOM68K_EMU_ELF_LINES_H
+#define ROSCOM68K_EMU_ELF_LINES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // The address-to-line mapping from the .debug_line section of a
+            // big-endian ELF32 file built with -g (DWARF 2 to 5), for
+            // attributing guest code to source lines.
+            class ElfLines {
+            public:
+                // The code in [address, end) came from line of files()[file]
+                struct Line {
+                    std::uint32_t address;
+                    std::uint32_t end;
+                    std::uint32_t file;
+                    std::uint32_t line;
+                };
+
+                // Returns false if the file can't be read or has no line
+                // table that makes sense
+                bool load(char const* filename);
+                bool load(const std::vector<std::uint8_t> &data);
+
+                bool empty() const { return this->table.empty(); }
+
+                // By address
+                const std::vector<Line>& lines() const { return this->table; }
+
+                // Source paths, as the compiler saw them
+                const std::vector<std::string>& files() const { return this->paths; }
+
+                // The line covering address, or nullptr if none
+                const Line* lookup(std::uint32_t address) const;
+
+            private:
+                struct Section {
+                    const std::uint8_t *data;
+                    std::size_t size;
+                };
+
+                bool loadUnit(const std::uint8_t *&pos, const std::uint8_t *end, const Section &lineStr, const Section &str);
+                std::uint32_t addFile(const std::string &path);
+
+                std::vector<Line> table;
+                std::vector<std::string> paths;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_ELF_LINES_H
@@ -0,0 +1,58 @@
+//
+// Function symbols from a guest ELF executable.
+//
+
+#ifndef ROSCOM68K_EMU_ELF_SYMBOLS_H
+#define ROSCOM68K_EMU_ELF_SYMBOLS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // Code symbols from the .symtab of a big-endian ELF32 file (what
+            // the rosco_m68k build leaves next to each .bin), for turning
+            // guest addresses back into function names.
+            class ElfSymbols {
+            public:
+                struct Symbol {
+                    std::uint32_t address;
+                    std::uint32_t size;
+                    std::uint32_t end;          // size, or end of section if unsized
+                    std::string name;
+                };
+
+                // Returns false if the file can't be read or isn't an ELF32
+                // big-endian executable with a symbol table
+                bool load(char const* filename);
+
+                // The same, from an ELF file already in memory
+                bool load(const std::vector<std::uint8_t> &data);
+
+                bool empty() const { return this->symbols.empty(); }
+
+                // By address
+                const std::vector<Symbol>& all() const { return this->symbols; }
+
+                // The symbol with this name, or nullptr if none
+                const Symbol* find(const std::string &name) const;
+
+                // The symbol covering address, or nullptr if none
+                const Symbol* lookup(std::uint32_t address) const;
+
+                // "name+0x1c", or the bare address when there is no symbol
+                std::string describe(std::uint32_t address) const;
+
+                // Just the function name, or the bare address
+                std::string function(std::uint32_t address) const;
+
+            private:
+                std::vector<Symbol> symbols;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_ELF_SYMBOLS_H
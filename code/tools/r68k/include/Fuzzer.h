@@ -0,0 +1,83 @@
+//
+// In-process fuzzing of a guest function.
+//
+
+#ifndef ROSCOM68K_EMU_FUZZER_H
+#define ROSCOM68K_EMU_FUZZER_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Coverage.h"
+#include "Machine.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // Drives a libFuzzer-style target in the guest, a C function
+            //
+            //     int target(const uint8_t *data, size_t size);
+            //
+            // over and over with mutated inputs. The machine is checkpointed
+            // where the program first calls the target, and rolled back
+            // before each input, which is copied onto the stack and passed in
+            // a fresh call; the run ends when the target returns to its
+            // caller. Inputs that reach code no earlier input did (by the
+            // coverage map, within the program's code) join the corpus.
+            class Fuzzer {
+            public:
+                enum class Outcome { Returned, Fault, Halt, Exit, Timeout };
+
+                using Input = std::vector<std::uint8_t>;
+
+                // The machine must be stopped at the target's first
+                // instruction, called from the program, with the coverage
+                // map in place. Feedback comes from [codeStart, codeEnd).
+                // Each input gets budget guest cycles.
+                Fuzzer(Machine &machine, Coverage &coverage, std::uint32_t codeStart, std::uint32_t codeEnd, std::uint64_t budget);
+
+                // Run the target on one input
+                Outcome execute(const Input &input);
+
+                // Run the seeds, then mutated inputs, until one crashes or
+                // runs inputs have been tried (0 for no limit). New corpus
+                // entries are saved to corpusDir, unless empty, and a crash
+                // to crash-<hash> in the current directory. Returns true if
+                // nothing crashed.
+                bool fuzz(std::vector<Input> seeds, const std::string &corpusDir, std::uint64_t runs, std::uint32_t maxLen, std::ostream &log);
+
+                static const char* describe(Outcome outcome);
+
+                // Names inputs by their contents, as libFuzzer does
+                static std::string hash(const Input &input);
+
+            private:
+                bool newCoverage();
+                void mutate(Input &input, std::uint32_t maxLen);
+                void status(std::ostream &log, const char *event);
+                void crashed(const Input &input, Outcome outcome, std::ostream &log);
+
+                Machine &machine;
+                Coverage &coverage;
+                std::uint32_t entry;
+                std::uint32_t returnAddress;
+                std::uint32_t stackTop;
+                std::uint32_t codeStart;
+                std::uint32_t codeEnd;
+                std::uint64_t budget;
+                std::vector<std::uint8_t> seen;         // coverage map over the code so far
+                std::uint32_t covered;
+                std::vector<Input> corpus;
+                std::mt19937 random;
+                std::uint64_t execs;
+                std::chrono::steady_clock::time_point started;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_FUZZER_H
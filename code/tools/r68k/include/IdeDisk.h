@@ -0,0 +1,106 @@
+//
+// IDE hard disk on the emulated bus.
+//
+
+#ifndef ROSCOM68K_EMU_IDE_DISK_H
+#define ROSCOM68K_EMU_IDE_DISK_H
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include "BlockDevice.h"
+#include "Device.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            class Machine;
+
+            // The IDE interface at BASE, with a disk image as the master drive
+            // (there is no slave). Registers are 16 bits wide, one per word,
+            // with the 8-bit ones in the low byte, as the stage 1 ATA driver
+            // expects. PIO data goes word by word straight between the
+            // data register and the mapped image, little-endian as on the
+            // real bus.
+            //
+            // The drive answers READ/WRITE SECTORS, READ/WRITE MULTIPLE, SET
+            // MULTIPLE MODE, IDENTIFY DEVICE and the housekeeping commands,
+            // and never goes busy, so the time a command takes is all in the
+            // guest's driver. For each command it counts sectors, bytes,
+            // status polls and guest cycles from issue to the last word, to
+            // show where a driver spends its time. Its interrupt is not
+            // wired up.
+            class IdeDisk : public Device {
+            public:
+                static constexpr std::uint32_t BASE = 0x00f80040;
+                static constexpr std::uint32_t SIZE = 0x20;
+                static constexpr std::uint32_t MAX_MULTIPLE = 16;
+
+                IdeDisk(Machine &machine, char const* filename, bool overlay);
+
+                bool isOpen() const { return this->disk.isOpen(); }
+
+                void reset();
+
+                std::uint8_t read8(std::uint32_t offset) override;
+                void write8(std::uint32_t offset, std::uint8_t data) override;
+                std::uint16_t read16(std::uint32_t offset) override;
+                void write16(std::uint32_t offset, std::uint16_t data) override;
+
+                // Per-command counters, one line per command seen
+                void report(std::ostream &out) const;
+
+            private:
+                struct Stats {
+                    std::uint64_t commands;
+                    std::uint64_t errors;
+                    std::uint64_t sectors;
+                    std::uint64_t bytes;
+                    std::uint64_t statusReads;
+                    std::uint64_t cycles;
+                    std::uint64_t maxCycles;
+                };
+
+                std::uint8_t readRegister(unsigned reg);
+                void writeRegister(unsigned reg, std::uint8_t data);
+                std::uint16_t readData();
+                void writeData(std::uint16_t data);
+
+                void command(std::uint8_t cmd);
+                bool startTransfer(bool write, std::uint32_t perBlock);
+                void identify();
+                void nextBlock();
+                void complete();
+                void abort(std::uint8_t error);
+                bool masterSelected() const { return !(this->devsel & 0x10); }
+
+                Machine &machine;
+                BlockDevice disk;
+
+                std::uint8_t features;
+                std::uint8_t sectorCount;
+                std::uint8_t lba[3];
+                std::uint8_t devsel;
+                std::uint8_t status;
+                std::uint8_t error;
+                std::uint8_t control;
+                std::uint32_t multiple;         // sectors per READ/WRITE MULTIPLE block
+
+                // The transfer in progress: DRQ is set while data is left
+                std::uint8_t *data;             // next byte in the image (or identify buffer)
+                std::uint32_t blockLeft;        // bytes until the next block
+                std::uint32_t sectorsLeft;      // whole transfer, after this block
+                std::uint32_t perBlock;
+                bool writing;
+
+                std::uint8_t identity[BlockDevice::BLOCK_SIZE];
+
+                std::uint8_t current;           // command being timed
+                std::uint64_t started;
+                std::map<std::uint8_t, Stats> stats;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_IDE_DISK_H
@@ -0,0 +1,85 @@
+//
+// Record/replay journal of a machine's nondeterministic inputs.
+//
+
+#ifndef ROSCOM68K_EMU_JOURNAL_H
+#define ROSCOM68K_EMU_JOURNAL_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // A compact binary log of everything a run takes from outside the
+            // guest: keyboard polls that found a key, key reads, SD card
+            // results and data, and the final exit. Each entry is stamped
+            // with the guest cycle it happened at. Timer interrupts need no
+            // entries, because the scheduler raises them at fixed cycle
+            // counts given the CPU clock and tick rate stored in the header.
+            // Replaying the journal therefore re-executes a session
+            // bit-for-bit, and any difference in what the guest asks for, or
+            // when, is reported as divergence.
+            class Journal {
+            public:
+                enum Event : std::uint8_t {
+                    CheckChar = 1,
+                    ReadChar,
+                    SdInit,
+                    SdRead,
+                    SdWrite,
+                    Exit,
+                };
+
+                struct Header {
+                    std::uint32_t cpuHz;
+                    std::uint32_t tickHz;
+                    std::uint64_t imageHash;        // ROM and program the session ran
+                };
+
+                bool record(char const* filename, const Header &header);
+                bool replay(char const* filename, Header &header);
+
+                bool recording() const { return this->mode == Mode::Record; }
+                bool replaying() const { return this->mode == Mode::Replay; }
+
+                // Recording: start an entry, then append its payload
+                void event(Event type, std::uint64_t cycle);
+                void put(const void *data, std::size_t size);
+
+                // Replaying: check the next entry is type at cycle, then read
+                // its payload. Both return false, with error() set, once the
+                // guest has diverged from the journal or it has run out.
+                bool expect(Event type, std::uint64_t cycle);
+                bool get(void *data, std::size_t size);
+
+                // Replaying, for inputs only logged when something happened
+                // (a poll finding a key): whether the next entry is type at
+                // cycle, consuming it if so. Fails if the guest has gone past
+                // the next entry without asking for it.
+                bool poll(Event type, std::uint64_t cycle);
+
+                // Stop replaying with an error; always returns false
+                bool fail(const std::string &message);
+
+                const std::string& error() const { return this->lastError; }
+
+            private:
+                enum class Mode { Off, Record, Replay };
+
+                bool peek();
+
+                Mode mode = Mode::Off;
+                std::fstream file;
+                std::uint64_t lastCycle = 0;
+                bool peeked = false;
+                std::uint8_t nextType;
+                std::uint64_t nextCycle;
+                std::string lastError;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_JOURNAL_H
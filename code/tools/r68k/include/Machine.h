@@ -0,0 +1,241 @@
+//
+// A complete emulated rosco_m68k machine.
+//
+
+#ifndef ROSCOM68K_EMU_MACHINE_H
+#define ROSCOM68K_EMU_MACHINE_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AddressDecoder.h"
+#include "BlockDevice.h"
+#include "ConsoleInput.h"
+#include "Coverage.h"
+#include "Duart.h"
+#include "ElfSymbols.h"
+#include "IdeDisk.h"
+#include "Journal.h"
+#include "MemoryMap.h"
+#include "Profiler.h"
+#include "Scheduler.h"
+#include "Tracer.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // Owns everything one guest needs: its CPU context, address
+            // decoder, scheduler, DUART, SD card and IDE images and console.
+            // Any number of machines can exist in a process, each driven
+            // from one thread at a time. The Musashi core runs one CPU per
+            // thread, so a machine's context is swapped in when it is run
+            // and stays loaded until another machine on the same thread
+            // needs the core.
+            class Machine {
+            public:
+                // romFile may be null for a machine that will be restored
+                // from a snapshot
+                Machine(char const* romFile, std::uint32_t cpuHz, char const* sdImage = "rosco_sd.bin", bool sdOverlay = false,
+                        const MemoryMap &memoryMap = MemoryMap::standard());
+                ~Machine();
+
+                Machine(const Machine&) = delete;
+                Machine& operator=(const Machine&) = delete;
+
+                // The machine whose CPU is loaded on the calling thread; the
+                // core's callbacks use this to find their machine.
+                static Machine* current();
+
+                // Load a program: an ELF executable's segments go to their
+                // load addresses, and its symbols are kept; anything else is
+                // a raw binary at baseAddr. Returns the entry point. Throws
+                // std::runtime_error if the program can't be loaded.
+                std::uint32_t load(const uint32_t baseAddr, char const* filename);
+
+                // Symbols of the loaded ELF program (empty for a raw binary)
+                const ElfSymbols& symbols() const { return this->syms; }
+                void reset();
+
+                // Run until the guest exits or virtual time reaches deadline.
+                // Returns true if the guest exited.
+                bool run(std::uint64_t deadline = UINT64_MAX);
+
+                // Run until the CPU is about to execute the instruction at
+                // address. Returns false if the guest exited or virtual time
+                // reached deadline first.
+                bool runTo(std::uint32_t address, std::uint64_t deadline = UINT64_MAX);
+
+                // Save the CPU, memory and device state to a file, or restore
+                // them from one, so runs can start from a booted machine.
+                // Restored memory is a copy-on-write mapping of the file, so
+                // costs nothing until the guest writes to it. Snapshots are
+                // only good for the build of r68k that wrote them. Both throw
+                // std::runtime_error on failure.
+                void saveSnapshot(char const* filename);
+                void restoreSnapshot(char const* filename);
+
+                // Remember the CPU and memory as they are now, then put them
+                // back as often as needed, much faster than a snapshot: only
+                // the pages written since are copied back. Devices and the
+                // scheduler's clock carry on from where they were.
+                void checkpoint();
+                void rollback();
+
+                // Stop the guest with the given exit code (from a trap handler)
+                void exit(int code);
+
+                // Guest cycles so far, counting into the timeslice being run
+                std::uint64_t now() const;
+
+                bool exited() const { return this->hasExited; }
+
+                // Whether the CPU stopped dead (after a double bus fault)
+                // rather than the guest exiting; run() returns when it does
+                bool halted() const { return this->hasHalted; }
+                int exitCode() const { return this->code; }
+
+                AddressDecoder& memory() { return *this->decoder; }
+                Scheduler& scheduler() { return this->sched; }
+                BlockDevice& sdCard() { return this->sd; }
+                Duart& duart() { return this->uart; }
+
+                // Put a disk image on the IDE interface (overlaid as for the
+                // SD card); there is no IDE device until this is called.
+                // Returns false if the image can't be opened.
+                bool attachIde(char const* image, bool overlay);
+                IdeDisk* ide() { return this->hdd.get(); }
+
+                // Devices call this after scheduling an event from inside the
+                // CPU's timeslice, so the CPU stops in time for it
+                void reschedule();
+
+                std::ostream& console() { return *this->out; }
+                void setConsole(std::ostream &console) { this->out = &console; }
+
+                // Where keys come from: the terminal, or a script. Batch
+                // machines have none, and input traps end the run.
+                ConsoleInput* input() { return this->in; }
+                void setInput(ConsoleInput *input) { this->in = input; }
+                bool interactive() const { return this->in != nullptr; }
+
+                bool wantedInput() const { return this->inputWanted; }
+                void requestInput() { this->inputWanted = true; }
+
+                // Input traps call this when a poll found nothing. A guest
+                // polling over and over from the same place with the same
+                // registers is idle: virtual time skips to the next event,
+                // and the idle wait (if set) lets the host sleep until input
+                // arrives or that much real time has passed.
+                void pollIdle();
+                void setIdleWait(std::function<void(std::chrono::nanoseconds)> wait) { this->idleWait = std::move(wait); }
+
+                // Start feeding the profiler: every instruction in exact mode,
+                // or the PC every samplePeriod cycles in sample mode. The
+                // profiler must outlive the machine's run.
+                void setProfiler(Profiler *profiler, std::uint64_t samplePeriod);
+
+                // Have the CPU mark the code it runs in the coverage map,
+                // which must outlive the machine's run
+                void setCoverage(Coverage *coverage);
+
+                // Keep the guest's recent instructions, writes and faults in
+                // the tracer's ring; it must outlive the machine's run.
+                void setTracer(Tracer *tracer);
+                bool tracing() const { return this->tracer != nullptr; }
+
+                // Report why the guest went wrong, with the guest PC, then
+                // the ring if tracing. The ring is only printed the first
+                // time, so a guest that keeps going wrong doesn't flood the
+                // output.
+                void dumpTrace(std::ostream &out, const std::string &why);
+
+                // Accesses to unmapped memory and writes to ROM. With bus
+                // errors on, those the CPU makes raise a bus error in the
+                // guest; the rest read as zero or are dropped, and the first
+                // few are reported on stderr.
+                std::uint64_t faults() const { return this->faultCount; }
+
+                // An illegal instruction that isn't a trap, which the CPU
+                // then steps over
+                void illegal(std::uint32_t opcode);
+
+                // End the run at the first fault or illegal instruction,
+                // rather than letting the guest carry on; faulted() says
+                // whether the last run ended that way, and faultPc() where.
+                void setStopOnFault(bool stop) { this->stopOnFault = stop; }
+                bool faulted() const { return this->hasFaulted; }
+                std::uint32_t faultPc() const { return this->stopPc; }
+
+                // Held by host code (such as a trap handler) that touches
+                // guest memory on the guest's behalf, so a fault there can't
+                // unwind through it as a bus error
+                class HostAccess {
+                public:
+                    explicit HostAccess(Machine &machine) : machine(machine) { machine.hostAccesses++; }
+                    ~HostAccess() { this->machine.hostAccesses--; }
+
+                    HostAccess(const HostAccess&) = delete;
+                    HostAccess& operator=(const HostAccess&) = delete;
+
+                private:
+                    Machine &machine;
+                };
+
+                // Record or replay the run's inputs; nullptr when neither
+                Journal* journal() { return this->jrnl; }
+                void setJournal(Journal *journal) { this->jrnl = journal; }
+
+            private:
+                void activate();
+                void skipIdle(std::uint64_t deadline);
+                void fault(std::uint32_t address, bool write);
+                void stop();
+                void updateHook();
+                static void instructionHook(unsigned int pc, unsigned int ir, int cycles);
+
+                AddressDecoder *decoder;
+                Scheduler sched;
+                BlockDevice sd;
+                Duart uart;
+                std::unique_ptr<IdeDisk> hdd;
+                std::ostream *out;
+                ConsoleInput *in;
+                ElfSymbols syms;
+                std::vector<std::uint8_t> context;
+                std::vector<std::uint8_t> savedContext;
+                Profiler *profiler;
+                Tracer *tracer;
+                Coverage *coverage;
+                bool traceDumped;
+                Journal *jrnl;
+                std::function<void(std::chrono::nanoseconds)> idleWait;
+                std::array<std::uint32_t, 17> pollState;
+                std::uint64_t lastPoll;
+                unsigned idlePolls;
+                bool idle;
+                std::uint32_t breakpoint;
+                bool watching;
+                bool atBreakpoint;
+                bool executing;
+                bool busErrors;
+                bool stopOnFault;
+                bool hasFaulted;
+                std::uint32_t stopPc;
+                std::uint64_t faultCount;
+                unsigned hostAccesses;
+                bool inputWanted;
+                bool hasExited;
+                bool hasHalted;
+                int code;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_MACHINE_H
@@ -9,6 +9,8 @@
 
 #include <cstdint>
 #include <memory>
+#include <ostream>
+#include <sys/types.h>
 
 namespace rosco {
     namespace m68k {
@@ -73,6 +75,11 @@ namespace rosco {
 
                 void LoadData(std::uint32_t baseAddr, const char* filename);
 
+                // Write the whole contents to out, or replace them with a
+                // copy-on-write mapping of fd at offset (page-aligned)
+                void SaveData(std::ostream &out);
+                void MapData(int fd, off_t offset);
+
             private:
                 std::uint8_t *store;
                 std::uint32_t size;
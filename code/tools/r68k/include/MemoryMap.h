@@ -0,0 +1,73 @@
+//
+// Layout of the emulated machine's address space.
+//
+
+#ifndef ROSCOM68K_EMU_MEMORY_MAP_H
+#define ROSCOM68K_EMU_MEMORY_MAP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            struct MemoryRegion {
+                enum Type : std::uint8_t {
+                    Ram,
+                    Rom,            // read-only; the first one holds the ROM image
+                    Io,             // slot for memory-mapped devices
+                };
+
+                Type type;
+                std::uint32_t base;
+                std::uint32_t size;
+            };
+
+            // Which parts of the bus answer, and how. Regions start and end
+            // on AddressDecoder pages and may not overlap, and there can be
+            // up to AddressDecoder::MAX_REGIONS of them. Anything outside
+            // them is unmapped: accesses there (and writes to ROM) are faults,
+            // which become bus errors for the guest if busErrors is set.
+            // Devices can be attached anywhere, but an I/O slot with nothing
+            // attached reads as zero without faulting.
+            //
+            // A map file has one region per line, "<ram|rom|io> <base> <size>",
+            // with sizes in bytes or with a K or M suffix, or a line reading
+            // "bus-errors". '#' starts a comment.
+            class MemoryMap {
+            public:
+                // Expansion RAM the board can decode: everything from the end
+                // of onboard RAM to the ROM
+                static constexpr std::uint32_t EXPANSION_BASE = 0x00100000;
+                static constexpr std::uint32_t EXPANSION_SIZE = 0x00d00000;
+
+                // 1MB of onboard RAM, the ROM space at 0xE00000 and I/O above
+                // it, as the r2 mainboard and r68k's ROM expect
+                static MemoryMap standard();
+
+                // Returns false, with the reason in error(), if the region is
+                // misaligned, off the bus, overlaps another or is one too many
+                bool add(const MemoryRegion &region);
+
+                // Replace the map with the one in a file, or add one region
+                // given as "<base>:<size>" (the --ram option)
+                bool load(char const* filename);
+                bool addRam(const std::string &spec);
+
+                const std::vector<MemoryRegion>& regions() const { return this->list; }
+                const std::string& error() const { return this->message; }
+
+                bool busErrors = false;
+
+            private:
+                bool parseLine(const std::string &line);
+
+                std::vector<MemoryRegion> list;
+                std::string message;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_MEMORY_MAP_H
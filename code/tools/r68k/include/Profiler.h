@@ -0,0 +1,82 @@
+//
+// Guest code profiler.
+//
+
+#ifndef ROSCOM68K_EMU_PROFILER_H
+#define ROSCOM68K_EMU_PROFILER_H
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "ElfSymbols.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // Collects per-instruction execution counts and cycles, either
+            // exactly (every instruction, from the CPU's profile hook) or by
+            // sampling the PC every so many cycles. Exact mode also follows
+            // subroutine calls so it can attribute cycles to call stacks.
+            class Profiler {
+            public:
+                enum class Mode { Exact, Sample };
+
+                explicit Profiler(Mode mode);
+
+                Mode mode() const { return this->profMode; }
+
+                // Exact mode: one executed instruction
+                void record(std::uint32_t pc, std::uint16_t ir, int cycles);
+
+                // Sample mode: the CPU was at pc for the last cycles cycles
+                void sample(std::uint32_t pc, std::uint64_t cycles);
+
+                // A flat per-function and per-address profile
+                void writeFlat(std::ostream &out, const ElfSymbols &symbols) const;
+
+                // One "frame;frame;frame cycles" line per call stack, for
+                // flamegraph.pl and friends. Sample mode has leaf frames only.
+                void writeFolded(std::ostream &out, const ElfSymbols &symbols) const;
+
+            private:
+                // Counts for one 4K page of guest code, indexed by word
+                static constexpr std::uint32_t PAGE_BITS = 12;
+                static constexpr std::uint32_t PAGE_SLOTS = (1 << PAGE_BITS) / 2;
+
+                struct Page {
+                    std::uint64_t count[PAGE_SLOTS] = {};
+                    std::uint64_t cycles[PAGE_SLOTS] = {};
+                };
+
+                // A node in the call tree, identified by its caller's node
+                // and the address called
+                struct Node {
+                    std::uint32_t parent;
+                    std::uint32_t function;
+                    std::uint64_t cycles;
+                };
+
+                struct Frame {
+                    std::uint32_t node;
+                    std::uint32_t sp;
+                };
+
+                Page& page(std::uint32_t pc);
+                void call(std::uint32_t function, std::uint32_t sp);
+                void unwind(std::uint32_t sp);
+
+                Mode profMode;
+                std::vector<std::unique_ptr<Page>> pages;
+                std::vector<Node> nodes;
+                std::unordered_map<std::uint64_t, std::uint32_t> children;
+                std::vector<Frame> stack;
+                std::uint32_t leaf;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_PROFILER_H
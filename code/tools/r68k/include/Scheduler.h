@@ -0,0 +1,74 @@
+//
+// Cycle-based event scheduler for the emulated machine.
+//
+
+#ifndef ROSCOM68K_EMU_SCHEDULER_H
+#define ROSCOM68K_EMU_SCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // Keeps virtual time in guest CPU cycles and fires device events
+            // (timer ticks etc.) at exact cycle counts, so a run is the same
+            // no matter how fast or loaded the host is. Optionally paces
+            // virtual time against the wall clock at a given CPU frequency.
+            class Scheduler {
+            public:
+                using Callback = std::function<void()>;
+
+                explicit Scheduler(std::uint32_t cpuHz);
+
+                std::uint64_t now() const { return this->cycles; }
+                std::uint32_t cpuHz() const { return this->hz; }
+
+                void scheduleAt(std::uint64_t when, Callback callback);
+                void scheduleIn(std::uint64_t delta, Callback callback);
+                void schedulePeriodic(std::uint64_t period, Callback callback);
+
+                // Cycles the CPU may run before the next event is due
+                std::uint64_t cyclesUntilNextEvent() const;
+
+                // Account for cycles run by the CPU and fire any events now due
+                void advance(std::uint64_t ran);
+
+                // Jump virtual time to cycles (when restoring a snapshot),
+                // keeping pending events the same distance in the future
+                void setNow(std::uint64_t cycles);
+
+                // When set, virtual time is held back to cpuHz of wall time
+                void setRealTime(bool realTime);
+
+            private:
+                struct Event {
+                    std::uint64_t when;
+                    std::uint64_t sequence;
+                    std::uint64_t period;
+                    Callback callback;
+
+                    bool operator>(const Event &other) const {
+                        return when != other.when ? when > other.when : sequence > other.sequence;
+                    }
+                };
+
+                std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+                std::uint64_t cycles;
+                std::uint64_t sequence;
+                std::uint32_t hz;
+                bool realTime;
+                std::chrono::steady_clock::time_point epoch;
+                std::uint64_t epochCycles;
+
+                void push(std::uint64_t when, std::uint64_t period, Callback callback);
+                void throttle();
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_SCHEDULER_H
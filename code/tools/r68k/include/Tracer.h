@@ -0,0 +1,74 @@
+//
+// Ring buffer of the guest's most recent instructions and writes.
+//
+
+#ifndef ROSCOM68K_EMU_TRACER_H
+#define ROSCOM68K_EMU_TRACER_H
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "ElfSymbols.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // Keeps the last so many things the guest did, as fixed-size
+            // binary entries: each instruction's PC, opcode and cycles, each
+            // write it made, and each bus fault. Recording an entry is one
+            // store into the ring, so tracing can stay on for long runs, and
+            // the ring is only decoded when something has gone wrong.
+            class Tracer {
+            public:
+                // Room for at least size entries (rounded up to a power of two)
+                explicit Tracer(std::uint32_t size);
+
+                // From the CPU's per-instruction hook, after the instruction ran
+                inline void instruction(std::uint32_t pc, std::uint16_t ir, int cycles) {
+                    add({ pc, (std::uint32_t)cycles, ir, Instruction, 0 });
+                }
+
+                // A write of size bytes (1, 2 or 4) to guest memory
+                inline void write(std::uint32_t address, std::uint32_t value, std::uint8_t size) {
+                    add({ address, value, 0, Write, size });
+                }
+
+                // An access to unmapped memory, or a write to ROM
+                inline void fault(std::uint32_t address, bool write) {
+                    add({ address, 0, write, Fault, 0 });
+                }
+
+                // Everything recorded, oldest first. Writes and faults are
+                // shown under the instruction that made them. The code is
+                // disassembled from guest memory as it is now, with cpuType.
+                void dump(std::ostream &out, const ElfSymbols &symbols, unsigned cpuType) const;
+
+            private:
+                enum Kind : std::uint8_t { Instruction, Write, Fault };
+
+                // The profile hook reports an instruction after it ran, so
+                // its writes come before it in the ring
+                struct Entry {
+                    std::uint32_t address;      // PC, or where the write or fault went
+                    std::uint32_t value;        // instruction's cycles, or the value written
+                    std::uint16_t opcode;       // fault: whether it was a write
+                    Kind kind;
+                    std::uint8_t size;
+                };
+
+                inline void add(const Entry &entry) {
+                    this->ring[this->count++ & this->mask] = entry;
+                }
+
+                void dumpInstruction(std::ostream &out, const Entry &entry, const ElfSymbols &symbols, unsigned cpuType) const;
+
+                std::vector<Entry> ring;
+                std::uint64_t mask;
+                std::uint64_t count;
+            };
+        }
+    }
+}
+
+#endif //ROSCOM68K_EMU_TRACER_H
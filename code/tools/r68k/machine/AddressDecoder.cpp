@@ -2,157 +2,522 @@
 // Created by ross.bamford on 22/04/2019.
 //
 
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "AddressDecoder.h"
+#include "../musashi/m68k.h"
 
 namespace rosco {
     namespace m68k {
         namespace emu {
-            AddressDecoder::AddressDecoder(std::uint32_t romsize, std::uint32_t ramsize, char const* filename) {
-                this->rom = std::unique_ptr<Memory>(new Memory(romsize));
-                this->ram = std::unique_ptr<Memory>(new Memory(ramsize));
+            // Followed by the layout, one SnapshotRegion per region, then
+            // the contents of each RAM and ROM region on SNAPSHOT_ALIGN
+            struct SnapshotState {
+                std::uint32_t regionCount;
+                std::uint32_t bootReadCount;
+                std::uint8_t bootLineActive;
+            };
+
+            struct SnapshotRegion {
+                std::uint32_t type;
+                std::uint32_t base;
+                std::uint32_t size;
+            };
+
+            static void pad(std::ostream &out, std::uint32_t align) {
+                while (out.tellp() % align) {
+                    out.put(0);
+                }
+            }
+
+            static off_t align(off_t offset, std::uint32_t align) {
+                return (offset + align - 1) / align * align;
+            }
+
+            AddressDecoder::AddressDecoder(const MemoryMap &map, char const* filename) {
+                this->rom = nullptr;
                 this->bootLineActive = true;
                 this->bootReadCount = 0;
+                this->savedBootLineActive = true;
+                this->savedBootReadCount = 0;
+                this->tracking = false;
+                std::fill(std::begin(this->pageDirty), std::end(this->pageDirty), false);
+
+                for (auto &region : map.regions()) {
+                    this->regions.push_back(Region {
+                        region.type, region.base, region.size,
+                        region.type == MemoryRegion::Io ? nullptr : std::make_unique<Memory>(region.size)
+                    });
+                }
+
+                std::fill(std::begin(this->pageRegions), std::end(this->pageRegions), 0);
+
+                for (std::size_t i = 0; i < this->regions.size(); i++) {
+                    Region &region = this->regions[i];
+
+                    std::fill_n(this->pageRegions + (region.base >> PAGE_BITS), region.size >> PAGE_BITS, i + 1);
+
+                    if (region.type == MemoryRegion::Rom && this->rom == nullptr) {
+                        this->rom = &region;
+                    }
+                }
+
+                if (this->rom == nullptr) {
+                    throw std::runtime_error("Memory map has no ROM");
+                }
 
 #ifdef MEM_TRACE
-                std::cout << "Initialized with " << this->ram->size << " bytes RAM and " << this->rom->size << " bytes ROM" << std::endl;
+                for (auto &region : this->regions) {
+                    std::cout << "Region " << (int)region.type << " @ " << std::hex << region.base << ", " << std::dec << region.size << " bytes" << std::endl;
+                }
 #endif
 
-                ReadRomData(filename);
+                // No ROM image when the contents will come from a snapshot
+                if (filename != nullptr) {
+                    this->rom->mem->LoadData(0, filename);
+                }
+                buildPageTable();
             }
 
-            Memory* AddressDecoder::getMemoryForAddress(std::uint32_t address) {
-                if (address < this->ram->size) {
-#ifdef MEM_TRACE
-                    std::cout << "Read RAM @ " << std::hex << address << std::endl;
-#endif
-                    return this->ram.get();
-                } else if (address >= 0x00e00000 && address < 0x00f00000) {
-#ifdef MEM_TRACE
-                    std::cout << "Read ROM @ " << std::hex << address << std::endl;
-#endif
-                    return this->rom.get();
-                } else {
-                    // /BERR?
-#ifdef MEM_TRACE
-                    std::cout << "BusError @ " << std::hex << address << std::endl;
-#endif
-                    return NULL;
+            void AddressDecoder::mapPages(std::uint32_t base, Memory *mem, bool writable) {
+                // Only whole pages go on the fast path; any ragged tail is left
+                // to the slow path, which bounds-checks against the Memory.
+                for (std::uint32_t offset = 0; offset + PAGE_SIZE <= mem->size; offset += PAGE_SIZE) {
+                    std::uint32_t page = (base + offset) >> PAGE_BITS;
+
+                    this->readPages[page] = mem->store + offset;
+                    this->writePages[page] = writable ? mem->store + offset : nullptr;
+                }
+            }
+
+            void AddressDecoder::unmapPages(std::uint32_t base, std::uint32_t size) {
+                for (std::uint32_t offset = 0; offset < size; offset += PAGE_SIZE) {
+                    std::uint32_t page = (base + offset) >> PAGE_BITS;
+
+                    this->readPages[page] = nullptr;
+                    this->writePages[page] = nullptr;
+                }
+            }
+
+            void AddressDecoder::buildPageTable() {
+                std::fill(std::begin(this->readPages), std::end(this->readPages), nullptr);
+                std::fill(std::begin(this->writePages), std::end(this->writePages), nullptr);
+
+                // ROM pages are read-only, so writes reach the slow path and fault
+                for (auto &region : this->regions) {
+                    if (region.mem) {
+                        mapPages(region.base, region.mem.get(), region.type == MemoryRegion::Ram);
+                    }
+                }
+
+                if (this->bootLineActive) {
+                    // While /BOOT is asserted, long reads in the low ROM-sized
+                    // window are shadowed from ROM, so keep it on the slow path.
+                    unmapPages(0, this->rom->size);
+                }
+
+                for (auto &mapping : this->devices) {
+                    unmapPages(mapping.base & ~PAGE_MASK, mapping.size + (mapping.base & PAGE_MASK));
                 }
+
+                // Pages not yet written since the checkpoint stay off the
+                // write fast path, so their first write is seen
+                if (this->tracking) {
+                    for (std::uint32_t page = 0; page < PAGE_COUNT; page++) {
+                        if (!this->pageDirty[page]) {
+                            this->writePages[page] = nullptr;
+                        }
+                    }
+                }
+            }
+
+            void AddressDecoder::attach(std::uint32_t base, std::uint32_t size, Device *device) {
+                this->devices.push_back(DeviceMapping { base, size, device });
+                buildPageTable();
+            }
+
+            Device* AddressDecoder::getDeviceForAddress(std::uint32_t address, std::uint32_t &offset) {
+                for (auto &mapping : this->devices) {
+                    if (address - mapping.base < mapping.size) {
+                        // Device registers can change under a polling loop
+                        m68k_device_access();
+                        offset = address - mapping.base;
+                        return mapping.device;
+                    }
+                }
+
+                return nullptr;
             }
 
-            std::uint32_t AddressDecoder::makeRelativeAddress(std::uint32_t address) {
-                if (address < this->ram->size) {
+            AddressDecoder::Region* AddressDecoder::getRegionForAddress(std::uint32_t address) {
+                std::uint8_t index = address < BUS_SIZE ? this->pageRegions[address >> PAGE_BITS] : 0;
+
+                return index ? &this->regions[index - 1] : nullptr;
+            }
+
+            Memory* AddressDecoder::getMemoryForRead(std::uint32_t address, std::uint32_t &offset) {
+                Region *region = getRegionForAddress(address);
+
+                if (region == nullptr) {
 #ifdef MEM_TRACE
-                    std::cout << "RAM Relative address is: 0x" << std::hex << address << std::endl;
+                    std::cout << "BusError reading @ " << std::hex << address << std::endl;
 #endif
-                    return address;
-                } else if (address >= 0x00e00000 && address < 0x00f00000) {
+                    if (this->faultHandler) {
+                        this->faultHandler(address, false);
+                    }
+                    return nullptr;
+                }
+
 #ifdef MEM_TRACE
-                    std::cout << "ROM Relative address is: 0x" << std::hex << address - (0x00e00000) << std::endl;
+                std::cout << "Read " << (region->type == MemoryRegion::Rom ? "ROM" : "RAM") << " @ " << std::hex << address << std::endl;
 #endif
-                    return address - (0x00e00000);
-                } else {
-                    // /BERR?
+                offset = address - region->base;
+                return region->mem.get();
+            }
+
+            Memory* AddressDecoder::getMemoryForWrite(std::uint32_t address, std::uint32_t &offset) {
+                Region *region = getRegionForAddress(address);
+
+                if (region == nullptr || region->type == MemoryRegion::Rom) {
 #ifdef MEM_TRACE
-                    std::cout << "BUSERROR Relative address is 0x0" << std::endl;
+                    std::cout << "BusError writing @ " << std::hex << address << std::endl;
 #endif
-                    return 0;
+                    if (this->faultHandler) {
+                        this->faultHandler(address, true);
+                    }
+                    return nullptr;
+                }
+
+                // An empty I/O slot: nothing to write, or to roll back
+                if (region->mem == nullptr) {
+                    return nullptr;
+                }
+
+                if (this->tracking) {
+                    markDirty(address);
+                }
+
+                offset = address - region->base;
+                return region->mem.get();
+            }
+
+            void AddressDecoder::markDirty(std::uint32_t address) {
+                std::uint32_t page = address >> PAGE_BITS;
+
+                if (!this->pageDirty[page]) {
+                    this->pageDirty[page] = true;
+                    this->dirtyPages.push_back(page);
+
+                    // Straight to memory from now on, if the page is
+                    // directly mapped at all
+                    this->writePages[page] = this->readPages[page];
+                }
+            }
+
+            void AddressDecoder::checkpoint() {
+                this->savedRam.clear();
+
+                for (auto &region : this->regions) {
+                    if (region.type == MemoryRegion::Ram) {
+                        this->savedRam.emplace_back(region.mem->store, region.mem->store + region.size);
+                    } else {
+                        this->savedRam.emplace_back();
+                    }
+                }
+
+                this->savedBootLineActive = this->bootLineActive;
+                this->savedBootReadCount = this->bootReadCount;
+
+                for (std::uint32_t page : this->dirtyPages) {
+                    this->pageDirty[page] = false;
+                }
+                this->dirtyPages.clear();
+                this->tracking = true;
+                buildPageTable();
+            }
+
+            void AddressDecoder::rollback() {
+                for (std::uint32_t page : this->dirtyPages) {
+                    std::uint32_t index = this->pageRegions[page] - 1;
+                    Region &region = this->regions[index];
+                    std::uint32_t offset = (page << PAGE_BITS) - region.base;
+
+                    std::memcpy(region.mem->store + offset, this->savedRam[index].data() + offset, std::min(PAGE_SIZE, region.size - offset));
+                    m68k_invalidate_code(page << PAGE_BITS, PAGE_SIZE);
+
+                    this->pageDirty[page] = false;
+                    this->writePages[page] = nullptr;
+                }
+                this->dirtyPages.clear();
+
+                if (this->bootLineActive != this->savedBootLineActive) {
+                    this->bootLineActive = this->savedBootLineActive;
+                    buildPageTable();
                 }
+                this->bootReadCount = this->savedBootReadCount;
             }
 
             void AddressDecoder::reset() {
                 this->bootLineActive = true;
                 this->bootReadCount = 0;
+                buildPageTable();
             }
 
-            std::uint32_t AddressDecoder::read32(std::uint32_t address) {
-                Memory *mem;
+            std::uint32_t AddressDecoder::slowRead32(std::uint32_t address) {
+                std::uint32_t offset;
+                Device *device = getDeviceForAddress(address, offset);
+
+                if (device != nullptr) {
+                    return device->read32(offset);
+                }
 
                 if (this->bootLineActive && address < this->rom->size) {
                     if (this->bootReadCount++ < 1) {
 #ifdef MEM_TRACE
                         std::cout << "Read /BOOT-shadowed ROM @ " << std::hex << address << std::endl;
 #endif
-                        mem = this->rom.get();
                     } else {
 #ifdef MEM_TRACE
                         std::cout << "Deassert /BOOT and read ROM @ " << std::hex << address << std::endl;
 #endif
                         this->bootLineActive = false;
-                        mem = this->rom.get();
+                        buildPageTable();
                     }
-                } else {
-                    mem = this->getMemoryForAddress(address);
+
+                    return this->rom->mem->read32(address);
                 }
 
-                if (mem != NULL) {
-                    uint32_t dw = mem->read32(makeRelativeAddress(address));
-                    return dw;
-                } else {
-                    // /BERR!
-                    return 0;
+                Memory *mem = getMemoryForRead(address, offset);
+
+                // Unmapped and I/O slot reads see zero
+                return mem != nullptr ? mem->read32(offset) : 0;
+            }
+
+            std::uint16_t AddressDecoder::slowRead16(std::uint32_t address) {
+                std::uint32_t offset;
+                Device *device = getDeviceForAddress(address, offset);
+
+                if (device != nullptr) {
+                    return device->read16(offset);
                 }
+
+                Memory *mem = getMemoryForRead(address, offset);
+
+                return mem != nullptr ? mem->read16(offset) : 0;
             }
 
-            std::uint16_t AddressDecoder::read16(std::uint32_t address) {
-                Memory *mem = this->getMemoryForAddress(address);
+            std::uint8_t AddressDecoder::slowRead8(std::uint32_t address) {
+                std::uint32_t offset;
+                Device *device = getDeviceForAddress(address, offset);
 
-                if (mem != NULL) {
-                    return mem->read16(makeRelativeAddress(address));
-                } else {
-                    // /BERR!
-                    return 0;
+                if (device != nullptr) {
+                    return device->read8(offset);
                 }
+
+                Memory *mem = getMemoryForRead(address, offset);
+
+                return mem != nullptr ? mem->read8(offset) : 0;
             }
 
-            std::uint8_t AddressDecoder::read8(std::uint32_t address) {
-                Memory *mem = this->getMemoryForAddress(address);
+            void AddressDecoder::slowWrite32(std::uint32_t address, std::uint32_t data) {
+                std::uint32_t offset;
+                Device *device = getDeviceForAddress(address, offset);
 
-                if (mem != NULL) {
-                    return mem->read8(makeRelativeAddress(address));
-                } else {
-                    // /BERR!
-                    return 0;
+                if (device != nullptr) {
+                    device->write32(offset, data);
+                    return;
+                }
+
+                Memory *mem = getMemoryForWrite(address, offset);
+
+                if (mem != nullptr) {
+                    mem->write32(offset, data);
                 }
             }
 
-            void AddressDecoder::write32(std::uint32_t address, std::uint32_t data) {
-                Memory *mem = this->getMemoryForAddress(address);
+            void AddressDecoder::slowWrite16(std::uint32_t address, std::uint16_t data) {
+                std::uint32_t offset;
+                Device *device = getDeviceForAddress(address, offset);
+
+                if (device != nullptr) {
+                    device->write16(offset, data);
+                    return;
+                }
+
+                Memory *mem = getMemoryForWrite(address, offset);
 
-                if (mem != NULL) {
-                    mem->write32(makeRelativeAddress(address), data);
-                } else {
-                    // /BERR!
+                if (mem != nullptr) {
+                    mem->write16(offset, data);
                 }
             }
 
-            void AddressDecoder::write16(std::uint32_t address, std::uint16_t data) {
-                Memory *mem = this->getMemoryForAddress(address);
+            void AddressDecoder::slowWrite8(std::uint32_t address, std::uint8_t data) {
+                std::uint32_t offset;
+                Device *device = getDeviceForAddress(address, offset);
 
-                if (mem != NULL) {
-                    mem->write16(makeRelativeAddress(address), data);
-                } else {
-                    // /BERR!
+                if (device != nullptr) {
+                    device->write8(offset, data);
+                    return;
+                }
+
+                Memory *mem = getMemoryForWrite(address, offset);
+
+                if (mem != nullptr) {
+                    mem->write8(offset, data);
                 }
             }
 
-            void AddressDecoder::write8(std::uint32_t address, std::uint8_t data) {
-                Memory *mem = this->getMemoryForAddress(address);
+            void AddressDecoder::readBlock(std::uint32_t address, void *dst, std::uint32_t size) {
+                std::uint8_t *out = static_cast<std::uint8_t*>(dst);
+
+                while (size > 0) {
+                    std::uint32_t chunk;
+                    const std::uint8_t *span = readSpan(address, chunk);
+
+                    chunk = std::min(size, chunk);
+
+                    if (span != nullptr) {
+                        std::memcpy(out, span, chunk);
+                    } else {
+                        for (std::uint32_t i = 0; i < chunk; i++) {
+                            out[i] = slowRead8(address + i);
+                        }
+                    }
+
+                    address += chunk;
+                    out += chunk;
+                    size -= chunk;
+                }
+            }
+
+            void AddressDecoder::writeBlock(std::uint32_t address, const void *src, std::uint32_t size) {
+                const std::uint8_t *in = static_cast<const std::uint8_t*>(src);
+
+                while (size > 0) {
+                    std::uint32_t chunk;
+                    std::uint8_t *span = writeSpan(address, chunk);
+
+                    chunk = std::min(size, chunk);
 
-                if (mem != NULL) {
-                    mem->write8(makeRelativeAddress(address), data);
-                } else {
-                    // /BERR!
+                    if (span != nullptr) {
+                        std::memcpy(span, in, chunk);
+                    } else {
+                        for (std::uint32_t i = 0; i < chunk; i++) {
+                            slowWrite8(address + i, in[i]);
+                        }
+                    }
+
+                    address += chunk;
+                    in += chunk;
+                    size -= chunk;
                 }
             }
 
-            void AddressDecoder::ReadRomData(char const* filename) {
-                this->rom->LoadData(0, filename);
+            void AddressDecoder::fillBlock(std::uint32_t address, std::uint8_t value, std::uint32_t size) {
+                while (size > 0) {
+                    std::uint32_t chunk;
+                    std::uint8_t *span = writeSpan(address, chunk);
+
+                    chunk = std::min(size, chunk);
+
+                    if (span != nullptr) {
+                        std::memset(span, value, chunk);
+                    } else {
+                        for (std::uint32_t i = 0; i < chunk; i++) {
+                            slowWrite8(address + i, value);
+                        }
+                    }
+
+                    address += chunk;
+                    size -= chunk;
+                }
             }
 
             void AddressDecoder::LoadMemoryFile(const uint32_t baseAddr, char const* filename) {
-                this->ram->LoadData(baseAddr, filename);
+                Region *region = getRegionForAddress(baseAddr);
+
+                if (region == nullptr || !region->mem) {
+                    throw std::runtime_error("No memory to load the program into");
+                }
+
+                region->mem->LoadData(baseAddr - region->base, filename);
+            }
+
+            void AddressDecoder::save(std::ostream &out) {
+                SnapshotState state = {};
+                state.regionCount = this->regions.size();
+                state.bootReadCount = this->bootReadCount;
+                state.bootLineActive = this->bootLineActive;
+
+                out.write((char*)&state, sizeof(state));
+                for (auto &region : this->regions) {
+                    SnapshotRegion layout = { region.type, region.base, region.size };
+                    out.write((char*)&layout, sizeof(layout));
+                }
+
+                for (auto &region : this->regions) {
+                    if (region.mem) {
+                        pad(out, SNAPSHOT_ALIGN);
+                        region.mem->SaveData(out);
+                    }
+                }
+            }
+
+            void AddressDecoder::restore(int fd, off_t offset) {
+                SnapshotState state;
+                std::vector<SnapshotRegion> layout;
+
+                if (pread(fd, &state, sizeof(state), offset) != sizeof(state)) {
+                    throw std::runtime_error("Snapshot is truncated");
+                }
+                if (state.regionCount != this->regions.size()) {
+                    throw std::runtime_error("Snapshot memory map doesn't match this machine");
+                }
+
+                layout.resize(state.regionCount);
+                offset += sizeof(state);
+                if (pread(fd, layout.data(), layout.size() * sizeof(SnapshotRegion), offset) != (ssize_t)(layout.size() * sizeof(SnapshotRegion))) {
+                    throw std::runtime_error("Snapshot is truncated");
+                }
+                offset += layout.size() * sizeof(SnapshotRegion);
+
+                for (std::size_t i = 0; i < layout.size(); i++) {
+                    Region &region = this->regions[i];
+
+                    if (layout[i].type != region.type || layout[i].base != region.base || layout[i].size != region.size) {
+                        throw std::runtime_error("Snapshot memory map doesn't match this machine");
+                    }
+                }
+
+                // Touching a mapping past the end of the file would fault, so
+                // check the whole thing is there before mapping any of it
+                std::vector<off_t> offsets;
+                for (auto &region : this->regions) {
+                    if (region.mem) {
+                        offset = align(offset, SNAPSHOT_ALIGN);
+                        offsets.push_back(offset);
+                        offset += region.size;
+                    }
+                }
+
+                struct stat st;
+                if (fstat(fd, &st) != 0 || st.st_size < offset) {
+                    throw std::runtime_error("Snapshot is truncated");
+                }
+
+                auto next = offsets.begin();
+                for (auto &region : this->regions) {
+                    if (region.mem) {
+                        region.mem->MapData(fd, *next++);
+                    }
+                }
+
+                this->bootReadCount = state.bootReadCount;
+                this->bootLineActive = state.bootLineActive;
+                buildPageTable();
             }
         }
     }
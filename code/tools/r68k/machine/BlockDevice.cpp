@@ -0,0 +1,68 @@
+//
+// Memory-mapped SD card image.
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "BlockDevice.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            BlockDevice::BlockDevice(char const* filename, bool overlay) {
+                this->image = nullptr;
+                this->size = 0;
+
+                // A private mapping never writes back, so read access will do
+                int fd = open(filename, overlay ? O_RDONLY : O_RDWR);
+                if (fd < 0) {
+                    return;
+                }
+
+                struct stat st;
+                if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                    void *mapped = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                                        overlay ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+
+                    if (mapped != MAP_FAILED) {
+                        this->image = static_cast<std::uint8_t*>(mapped);
+                        this->size = st.st_size;
+                    }
+                }
+
+                // The mapping keeps the file open
+                close(fd);
+            }
+
+            BlockDevice::~BlockDevice() {
+                if (this->image != nullptr) {
+                    munmap(this->image, this->size);
+                }
+            }
+
+            bool BlockDevice::inRange(std::uint32_t block, std::uint32_t count) const {
+                return this->image != nullptr && (std::uint64_t)block + count <= this->blockCount();
+            }
+
+            bool BlockDevice::read(std::uint32_t block, std::uint32_t count, AddressDecoder &mem, std::uint32_t address) {
+                if (!inRange(block, count)) {
+                    return false;
+                }
+
+                mem.writeBlock(address, this->image + (std::size_t)block * BLOCK_SIZE, count * BLOCK_SIZE);
+                return true;
+            }
+
+            bool BlockDevice::write(std::uint32_t block, std::uint32_t count, AddressDecoder &mem, std::uint32_t address) {
+                if (!inRange(block, count)) {
+                    return false;
+                }
+
+                mem.readBlock(address, this->image + (std::size_t)block * BLOCK_SIZE, count * BLOCK_SIZE);
+                return true;
+            }
+        }
+    }
+}
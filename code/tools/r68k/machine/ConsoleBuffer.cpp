@@ -0,0 +1,73 @@
+//
+// Buffered console output for the emulated machine.
+//
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "ConsoleBuffer.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            ConsoleBuffer::ConsoleBuffer(int fd, std::size_t size) : buffer(size) {
+                this->fd = fd;
+                this->lineMode = isatty(fd);
+                setp(this->buffer.data(), this->buffer.data() + this->buffer.size());
+            }
+
+            ConsoleBuffer::~ConsoleBuffer() {
+                drain();
+            }
+
+            bool ConsoleBuffer::drain() {
+                const char *data = pbase();
+                std::size_t left = pptr() - pbase();
+
+                while (left > 0) {
+                    ssize_t written = write(this->fd, data, left);
+
+                    if (written < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        return false;
+                    }
+
+                    data += written;
+                    left -= written;
+                }
+
+                setp(this->buffer.data(), this->buffer.data() + this->buffer.size());
+                return true;
+            }
+
+            ConsoleBuffer::int_type ConsoleBuffer::overflow(int_type ch) {
+                if (!drain()) {
+                    return traits_type::eof();
+                }
+
+                if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+                    *pptr() = traits_type::to_char_type(ch);
+                    pbump(1);
+                }
+
+                return traits_type::not_eof(ch);
+            }
+
+            std::streamsize ConsoleBuffer::xsputn(const char *s, std::streamsize n) {
+                std::streamsize done = std::streambuf::xsputn(s, n);
+
+                if (this->lineMode && std::memchr(s, '\n', done) != nullptr) {
+                    drain();
+                }
+
+                return done;
+            }
+
+            int ConsoleBuffer::sync() {
+                return drain() ? 0 : -1;
+            }
+        }
+    }
+}
@@ -0,0 +1,156 @@
+//
+// Buffered console input for the emulated machine.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <stdexcept>
+#include <unistd.h>
+#include "ConsoleInput.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            ConsoleInput::ConsoleInput(int fd) : head(0), tail(0), ended(false), full(false) {
+                this->fd = fd;
+
+                // The destructor pokes this to get the pump out of poll()
+                if (pipe(this->wakeFds) != 0) {
+                    throw std::runtime_error("Failed to create console input pipe");
+                }
+
+                this->thread = std::thread(&ConsoleInput::pump, this);
+            }
+
+            ConsoleInput::~ConsoleInput() {
+                char c = 0;
+
+                {
+                    std::lock_guard<std::mutex> guard(this->lock);
+                    this->ended.store(true);
+                    this->changed.notify_all();
+                }
+                (void)!write(this->wakeFds[1], &c, 1);
+
+                this->thread.join();
+                close(this->wakeFds[0]);
+                close(this->wakeFds[1]);
+            }
+
+            void ConsoleInput::pump() {
+                sigset_t signals;
+
+                // Leave signals such as SIGINT to the thread running the
+                // guest, which can report where it was
+                sigemptyset(&signals);
+                sigaddset(&signals, SIGINT);
+                sigaddset(&signals, SIGTERM);
+                sigaddset(&signals, SIGHUP);
+                sigaddset(&signals, SIGQUIT);
+                pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+                // Files and pipes end lines with LF, where a terminal sends the
+                // CR that guest programs look for
+                bool lineFeeds = !isatty(this->fd);
+
+                while (!this->ended.load()) {
+                    std::size_t head = this->head.load(std::memory_order_relaxed);
+
+                    if (head - this->tail.load() == CAPACITY) {
+                        std::unique_lock<std::mutex> guard(this->lock);
+
+                        this->full.store(true);
+                        this->changed.wait(guard, [this, head]() {
+                            return head - this->tail.load() < CAPACITY || this->ended.load();
+                        });
+                        this->full.store(false);
+                        continue;
+                    }
+
+                    struct pollfd fds[2] = {
+                        { this->fd, POLLIN, 0 },
+                        { this->wakeFds[0], POLLIN, 0 },
+                    };
+
+                    if (poll(fds, 2, -1) < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        break;
+                    }
+                    if (fds[1].revents) {
+                        break;
+                    }
+
+                    // Read straight into the free run of the ring, up to the wrap
+                    std::size_t offset = head & (CAPACITY - 1);
+                    std::size_t room = std::min(CAPACITY - (head - this->tail.load()), CAPACITY - offset);
+                    ssize_t n = ::read(this->fd, this->ring + offset, room);
+
+                    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        break;
+                    }
+
+                    if (lineFeeds) {
+                        for (ssize_t i = 0; i < n; i++) {
+                            if (this->ring[offset + i] == '\n') {
+                                this->ring[offset + i] = '\r';
+                            }
+                        }
+                    }
+
+                    this->head.store(head + n, std::memory_order_release);
+
+                    std::lock_guard<std::mutex> guard(this->lock);
+                    this->changed.notify_all();
+                }
+
+                std::lock_guard<std::mutex> guard(this->lock);
+                this->ended.store(true, std::memory_order_release);
+                this->changed.notify_all();
+            }
+
+            bool ConsoleInput::wait(std::chrono::nanoseconds timeout) {
+                if (ready() || timeout <= std::chrono::nanoseconds::zero()) {
+                    return ready();
+                }
+
+                std::unique_lock<std::mutex> guard(this->lock);
+                this->changed.wait_for(guard, timeout, [this]() {
+                    return ready() || this->ended.load();
+                });
+
+                return ready();
+            }
+
+            int ConsoleInput::read() {
+                if (!ready()) {
+                    std::unique_lock<std::mutex> guard(this->lock);
+                    this->changed.wait(guard, [this]() {
+                        return ready() || this->ended.load();
+                    });
+
+                    if (!ready()) {
+                        return -1;
+                    }
+                }
+
+                std::size_t tail = this->tail.load(std::memory_order_relaxed);
+                std::uint8_t c = this->ring[tail & (CAPACITY - 1)];
+                this->tail.store(tail + 1);
+
+                if (this->full.load()) {
+                    std::lock_guard<std::mutex> guard(this->lock);
+                    this->changed.notify_all();
+                }
+
+                return c;
+            }
+        }
+    }
+}
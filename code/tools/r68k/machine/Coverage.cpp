@@ -0,0 +1,157 @@
+//
+// Guest code coverage.
+//
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include "AddressDecoder.h"
+#include "Coverage.h"
+#include "../musashi/m68k.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            Coverage::Coverage() : runs(AddressDecoder::BUS_SIZE / 2) {
+                this->cpuType = M68K_CPU_TYPE_68010;
+            }
+
+            void Coverage::collect(unsigned cpuType) {
+                char text[100];
+
+                this->cpuType = cpuType;
+                this->executed.clear();
+
+                for (std::uint32_t word = 0; word < this->runs.size(); word++) {
+                    std::uint32_t pc = word * 2;
+
+                    for (unsigned i = 0; i < this->runs[word]; i++) {
+                        this->executed.push_back(pc);
+                        pc += std::max(2u, m68k_disassemble(text, pc, cpuType));
+                    }
+                }
+
+                // Runs from different starts overlap where they meet
+                std::sort(this->executed.begin(), this->executed.end());
+                this->executed.erase(std::unique(this->executed.begin(), this->executed.end()), this->executed.end());
+            }
+
+            // How many of the instructions run were in [address, end)
+            std::uint32_t Coverage::ran(std::uint32_t address, std::uint32_t end) const {
+                auto first = std::lower_bound(this->executed.begin(), this->executed.end(), address);
+                auto last = std::lower_bound(first, this->executed.end(), end);
+
+                return last - first;
+            }
+
+            // Each function's extent, cut short where an unsized label's
+            // would run into the next symbol
+            std::vector<Coverage::Function> Coverage::functions(const ElfSymbols &symbols) const {
+                const std::vector<ElfSymbols::Symbol> &all = symbols.all();
+                std::vector<Function> result;
+
+                for (std::size_t i = 0; i < all.size(); i++) {
+                    if (i > 0 && all[i].address == all[i - 1].address) {
+                        continue;
+                    }
+
+                    std::uint32_t end = all[i].end;
+                    for (std::size_t next = i + 1; next < all.size(); next++) {
+                        if (all[next].address != all[i].address) {
+                            end = std::min(end, all[next].address);
+                            break;
+                        }
+                    }
+
+                    result.push_back(Function { &all[i], end });
+                }
+
+                return result;
+            }
+
+            void Coverage::writeSummary(std::ostream &out, const ElfSymbols &symbols) const {
+                std::vector<Function> list = functions(symbols);
+                std::uint64_t attributed = 0;
+                unsigned hit = 0;
+                char text[100];
+
+                out << "Coverage: " << this->executed.size() << " instructions run" << std::endl << std::endl
+                    << "  %covered         run       total  function" << std::endl;
+
+                for (auto &function : list) {
+                    std::uint32_t count = ran(function.symbol->address, function.end);
+                    std::uint32_t total = 0;
+
+                    for (std::uint32_t pc = function.symbol->address; pc < function.end; total++) {
+                        pc += std::max(2u, m68k_disassemble(text, pc, this->cpuType));
+                    }
+
+                    attributed += count;
+                    hit += count > 0;
+
+                    out << std::setw(9) << std::fixed << std::setprecision(2) << (total ? 100.0 * count / total : 0.0) << "%"
+                        << std::setw(12) << count << std::setw(12) << total << "  " << function.symbol->name << std::endl;
+                }
+
+                out << std::endl << hit << " of " << list.size() << " functions entered";
+                if (attributed < this->executed.size()) {
+                    std::uint64_t outside = this->executed.size() - attributed;
+                    out << "; " << outside << (outside == 1 ? " instruction" : " instructions") << " run outside them";
+                }
+                out << std::endl;
+            }
+
+            void Coverage::writeLcov(std::ostream &out, const std::string &test, const ElfSymbols &symbols, const ElfLines &lines) const {
+                struct File {
+                    std::map<std::uint32_t, bool> lines;        // hit, by line number
+                    std::vector<std::pair<std::uint32_t, const Function*>> functions;
+                };
+
+                std::vector<Function> list = functions(symbols);
+                std::map<std::uint32_t, File> files;
+
+                // A line is hit if any of the code generated for it ran
+                for (auto &line : lines.lines()) {
+                    bool &hit = files[line.file].lines[line.line];
+                    hit = hit || ran(line.address, line.end) > 0;
+                }
+
+                for (auto &function : list) {
+                    const ElfLines::Line *line = lines.lookup(function.symbol->address);
+
+                    if (line) {
+                        files[line->file].functions.emplace_back(line->line, &function);
+                    }
+                }
+
+                for (auto &entry : files) {
+                    const File &file = entry.second;
+                    unsigned functionsHit = 0, linesHit = 0;
+
+                    out << "TN:" << test << std::endl
+                        << "SF:" << lines.files()[entry.first] << std::endl;
+
+                    for (auto &function : file.functions) {
+                        out << "FN:" << function.first << "," << function.second->symbol->name << std::endl;
+                    }
+                    for (auto &function : file.functions) {
+                        bool hit = ran(function.second->symbol->address, function.second->end) > 0;
+
+                        out << "FNDA:" << hit << "," << function.second->symbol->name << std::endl;
+                        functionsHit += hit;
+                    }
+                    out << "FNF:" << file.functions.size() << std::endl
+                        << "FNH:" << functionsHit << std::endl;
+
+                    for (auto &line : file.lines) {
+                        out << "DA:" << line.first << "," << line.second << std::endl;
+                        linesHit += line.second;
+                    }
+                    out << "LF:" << file.lines.size() << std::endl
+                        << "LH:" << linesHit << std::endl
+                        << "end_of_record" << std::endl;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,207 @@
+//
+// Batch disassembly of guest images.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include "Disassembler.h"
+#include "../musashi/m68k.h"
+
+#define CHUNK_SIZE      0x4000      // bytes per job
+#define TEXT_COLUMN     42          // room for six words before the text
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // Much cheaper than snprintf, which this is most of the work of
+            // formatting a line
+            static void appendHex(std::string &out, std::uint32_t value, unsigned digits) {
+                static const char hex[] = "0123456789abcdef";
+
+                for (unsigned i = digits; i-- > 0; ) {
+                    out.push_back(hex[(value >> (4 * i)) & 0xf]);
+                }
+            }
+
+            Disassembler::Disassembler(unsigned cpuType, unsigned jobs) {
+                this->cpuType = cpuType;
+                this->jobs = std::max(1u, jobs);
+            }
+
+            void Disassembler::add(std::uint32_t address, const std::uint8_t *bytes, std::uint32_t size) {
+                this->regions.push_back(Region { address, bytes, size });
+            }
+
+            std::uint64_t Disassembler::write(std::ostream &out, const ElfSymbols &symbols) {
+                std::vector<std::uint32_t> targets;
+                std::uint64_t count = 0;
+
+                std::stable_sort(this->regions.begin(), this->regions.end(),
+                                 [](const Region &a, const Region &b) { return a.address < b.address; });
+
+                this->chunks.clear();
+                for (std::size_t r = 0; r < this->regions.size(); r++) {
+                    for (std::uint32_t start = 0; start < this->regions[r].size; start += std::min<std::uint32_t>(CHUNK_SIZE, this->regions[r].size - start)) {
+                        Chunk chunk;
+                        chunk.region = r;
+                        chunk.start = start;
+                        chunk.end = start + std::min<std::uint32_t>(CHUNK_SIZE, this->regions[r].size - start);
+                        this->chunks.push_back(std::move(chunk));
+                    }
+                }
+
+                forEachChunk([this](Chunk &chunk) { decode(chunk, chunk.start); });
+                join();
+
+                for (auto &chunk : this->chunks) {
+                    for (auto &line : chunk.lines) {
+                        if (line.target != M68K_NO_TARGET) {
+                            targets.push_back(line.target);
+                        }
+                    }
+                }
+                std::sort(targets.begin(), targets.end());
+                targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+                forEachChunk([&](Chunk &chunk) { format(chunk, symbols, targets); });
+
+                for (auto &chunk : this->chunks) {
+                    out << chunk.listing;
+                    count += chunk.lines.size();
+                }
+                this->chunks.clear();
+
+                return count;
+            }
+
+            // Sweep the chunk from offset from, carrying on past its end to
+            // the end of the last instruction that starts inside it
+            void Disassembler::decode(Chunk &chunk, std::uint32_t from) const {
+                const Region &region = this->regions[chunk.region];
+                char text[256];
+
+                chunk.lines.clear();
+                chunk.text.clear();
+
+                for (std::uint32_t offset = from; offset < chunk.end; ) {
+                    std::uint32_t address = region.address + offset;
+                    std::uint32_t target;
+                    std::uint32_t size = m68k_disassemble_buffer(text, address, region.bytes, region.address, region.size, &target, this->cpuType);
+
+                    // The last few bytes, too few for the instruction they start
+                    if (size == 0) {
+                        size = std::min<std::uint32_t>(2, region.size - offset);
+                        target = M68K_NO_TARGET;
+                        if (size == 2) {
+                            snprintf(text, sizeof(text), "dc.w    $%04x", (region.bytes[offset] << 8) | region.bytes[offset + 1]);
+                        } else {
+                            snprintf(text, sizeof(text), "dc.b    $%02x", region.bytes[offset]);
+                        }
+                    }
+
+                    chunk.lines.push_back(Line { address, target, (std::uint32_t)chunk.text.size(), size });
+                    chunk.text.append(text, strlen(text) + 1);
+                    offset += size;
+                }
+            }
+
+            // A chunk's own sweep can start partway through an instruction.
+            // Drop what it decoded before the instruction the previous chunk
+            // ran into; the two sweeps have almost always fallen into step
+            // by then, and where they haven't the chunk is decoded again.
+            void Disassembler::join() {
+                std::uint32_t next = 0;
+
+                for (auto &chunk : this->chunks) {
+                    const Region &region = this->regions[chunk.region];
+
+                    if (chunk.start == 0) {
+                        next = 0;
+                    }
+
+                    if (next != chunk.start) {
+                        std::uint32_t address = region.address + next;
+                        auto line = std::lower_bound(chunk.lines.begin(), chunk.lines.end(), address,
+                                                     [](const Line &line, std::uint32_t address) { return line.address < address; });
+
+                        if (line != chunk.lines.end() && line->address == address) {
+                            chunk.lines.erase(chunk.lines.begin(), line);
+                        } else {
+                            decode(chunk, next);
+                        }
+                    }
+
+                    if (!chunk.lines.empty()) {
+                        next = chunk.lines.back().address - region.address + chunk.lines.back().size;
+                    }
+                }
+            }
+
+            void Disassembler::format(Chunk &chunk, const ElfSymbols &symbols, const std::vector<std::uint32_t> &targets) const {
+                const Region &region = this->regions[chunk.region];
+                char buffer[64];
+
+                chunk.listing.clear();
+                chunk.listing.reserve(chunk.lines.size() * 64);
+
+                for (auto &line : chunk.lines) {
+                    const ElfSymbols::Symbol *symbol = symbols.lookup(line.address);
+
+                    if (symbol && symbol->address == line.address) {
+                        snprintf(buffer, sizeof(buffer), "\n%08x <", line.address);
+                        chunk.listing.append(buffer).append(symbol->name).append(">:\n");
+                    } else if (std::binary_search(targets.begin(), targets.end(), line.address)) {
+                        snprintf(buffer, sizeof(buffer), ".L%x:\n", line.address);
+                        chunk.listing.append(buffer);
+                    }
+
+                    // Address and the instruction's words, then its text
+                    std::size_t column = chunk.listing.size();
+                    const std::uint8_t *bytes = region.bytes + (line.address - region.address);
+
+                    appendHex(chunk.listing, line.address, 8);
+                    chunk.listing.push_back(' ');
+                    for (std::uint32_t i = 0; i < line.size; i += 2) {
+                        chunk.listing.push_back(' ');
+                        if (i + 1 < line.size) {
+                            appendHex(chunk.listing, (bytes[i] << 8) | bytes[i + 1], 4);
+                        } else {
+                            appendHex(chunk.listing, bytes[i], 2);
+                        }
+                    }
+                    std::size_t width = chunk.listing.size() - column;
+                    chunk.listing.append(width < TEXT_COLUMN ? TEXT_COLUMN - width : 1, ' ');
+                    chunk.listing.append(chunk.text.data() + line.text);
+
+                    if (line.target != M68K_NO_TARGET && symbols.lookup(line.target)) {
+                        chunk.listing.append("  <").append(symbols.describe(line.target)).append(">");
+                    }
+                    chunk.listing.push_back('\n');
+                }
+            }
+
+            void Disassembler::forEachChunk(const std::function<void(Chunk&)> &work) {
+                std::atomic<std::size_t> next(0);
+
+                auto worker = [&]() {
+                    std::size_t i;
+
+                    while ((i = next++) < this->chunks.size()) {
+                        work(this->chunks[i]);
+                    }
+                };
+
+                std::vector<std::thread> workers;
+                for (unsigned j = 0; j < std::min<std::size_t>(this->jobs, this->chunks.size()); j++) {
+                    workers.emplace_back(worker);
+                }
+                for (auto &w : workers) {
+                    w.join();
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,481 @@
+//
+// XR68C681 DUART on the emulated bus.
+//
+
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include "Duart.h"
+#include "Machine.h"
+#include "../musashi/m68k.h"
+
+#define RX_POLL_BAUD    115200      // how often a receive interrupt can fire
+#define RX_POLL_BITS    10          // start, 8 data, stop
+
+// Read registers, by index
+#define R_MR            0x0
+#define R_SR            0x1
+#define R_MISR          0x2
+#define R_RHR           0x3
+#define R_IPCR          0x4
+#define R_ISR           0x5
+#define R_CTU           0x6
+#define R_CTL           0x7
+#define R_IVR           0xc
+#define R_IP            0xd
+#define R_START_CT      0xe
+#define R_STOP_CT       0xf
+
+// Write registers, by index
+#define W_MR            0x0
+#define W_CSR           0x1
+#define W_CR            0x2
+#define W_THR           0x3
+#define W_ACR           0x4
+#define W_IMR           0x5
+#define W_CTUR          0x6
+#define W_CTLR          0x7
+#define W_IVR           0xc
+#define W_OPCR          0xd
+#define W_OPR_SET       0xe
+#define W_OPR_RESET     0xf
+
+// Channel B's registers are channel A's plus this
+#define CHANNEL_B       0x8
+
+#define SR_RXRDY        0x01
+#define SR_FFULL        0x02
+#define SR_TXRDY        0x04
+#define SR_TXEMT        0x08
+
+#define ISR_TXRDYA      0x01
+#define ISR_RXRDYA      0x02
+#define ISR_COUNTER     0x08
+#define ISR_TXRDYB      0x10
+#define ISR_RXRDYB      0x20
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            Duart::Duart(Machine &machine) : machine(machine) {
+                this->ctGeneration = 0;
+                this->rxGeneration = 0;
+                reset();
+            }
+
+            void Duart::reset() {
+                std::memset(&this->state, 0, sizeof(this->state));
+                this->state.ivr = 0x0f;
+                this->ctEvents = 0;
+                this->ctGeneration++;
+                this->rxGeneration++;
+            }
+
+            std::size_t Duart::stateSize() {
+                return sizeof(State);
+            }
+
+            void Duart::save(std::ostream &out) {
+                out.write((char*)&this->state, sizeof(this->state));
+            }
+
+            void Duart::restore(int fd, off_t offset) {
+                if (pread(fd, &this->state, sizeof(this->state), offset) != sizeof(this->state)) {
+                    throw std::runtime_error("Snapshot is truncated");
+                }
+            }
+
+            void Duart::resume() {
+                // Pick the counter up where it was, in the restored timeline
+                std::uint64_t ticks = this->state.ctRunning ? ticksSinceStart() : 0;
+                std::uint64_t first = timerMode() ? 2 * (this->state.ctPreset ? this->state.ctPreset : 0x10000)
+                                                  : this->state.ctPreset;
+                std::uint64_t period = timerMode() ? first : 0x10000;
+                this->ctEvents = ticks < first ? 0 : (ticks - first) / period + 1;
+
+                armCounter();
+                armRxPoll();
+                updateIrq();
+            }
+
+            void Duart::legacyTick() {
+                // Once the guest runs the real timer, it supplies the tick
+                if (this->state.ctRunning && (this->state.imr & ISR_COUNTER)) {
+                    return;
+                }
+
+                this->state.tickPending = true;
+                updateIrq();
+            }
+
+            int Duart::acknowledge() {
+                if (this->state.tickPending) {
+                    this->state.tickPending = false;
+                    updateIrq();
+                    return TICK_VECTOR;
+                }
+
+                updateTxRx();
+                if (this->state.isr & this->state.imr) {
+                    // Stays asserted until the handler clears the cause
+                    return this->state.ivr;
+                }
+
+                return M68K_INT_ACK_SPURIOUS;
+            }
+
+            void Duart::updateTxRx() {
+                std::uint8_t isr = this->state.isr & ~(ISR_TXRDYA | ISR_RXRDYA | ISR_TXRDYB | ISR_RXRDYB);
+
+                // Transmission is instant, so an enabled transmitter is always ready
+                if (this->state.a.txEnabled) {
+                    isr |= ISR_TXRDYA;
+                }
+                if (this->state.a.rxCount) {
+                    isr |= ISR_RXRDYA;
+                }
+                if (this->state.b.txEnabled) {
+                    isr |= ISR_TXRDYB;
+                }
+                if (this->state.b.rxCount) {
+                    isr |= ISR_RXRDYB;
+                }
+
+                this->state.isr = isr;
+            }
+
+            void Duart::updateIrq() {
+                updateTxRx();
+                m68k_set_irq(this->state.tickPending || (this->state.isr & this->state.imr) ? IRQ : 0);
+            }
+
+            void Duart::fillRx() {
+                Channel &a = this->state.a;
+
+                if (!a.rxEnabled || !this->inputReady) {
+                    return;
+                }
+
+                while (a.rxCount < RX_FIFO && this->inputReady()) {
+                    a.rx[a.rxCount++] = this->inputRead();
+                }
+            }
+
+            std::uint8_t Duart::readStatus(Channel &channel) {
+                std::uint8_t sr = channel.status;
+
+                if (&channel == &this->state.a) {
+                    fillRx();
+                }
+
+                if (channel.rxCount) {
+                    sr |= SR_RXRDY;
+                }
+                if (channel.rxCount == RX_FIFO) {
+                    sr |= SR_FFULL;
+                }
+                if (channel.txEnabled) {
+                    sr |= SR_TXRDY | SR_TXEMT;
+                }
+
+                // A guest spinning on an empty receiver is waiting for a key
+                if (&channel == &this->state.a && !channel.rxCount) {
+                    this->machine.pollIdle();
+                }
+
+                return sr;
+            }
+
+            std::uint8_t Duart::readRx(Channel &channel) {
+                if (&channel == &this->state.a) {
+                    fillRx();
+                }
+
+                if (!channel.rxCount) {
+                    return 0;
+                }
+
+                std::uint8_t c = channel.rx[0];
+                std::memmove(channel.rx, channel.rx + 1, --channel.rxCount);
+
+                updateIrq();
+                return c;
+            }
+
+            std::uint8_t Duart::readMode(Channel &channel) {
+                if (channel.mrPointer) {
+                    return channel.mr2;
+                }
+
+                channel.mrPointer = true;
+                return channel.mr1;
+            }
+
+            void Duart::writeMode(Channel &channel, std::uint8_t data) {
+                if (channel.mrPointer) {
+                    channel.mr2 = data;
+                } else {
+                    channel.mr1 = data;
+                    channel.mrPointer = true;
+                }
+            }
+
+            void Duart::command(Channel &channel, std::uint8_t data) {
+                if ((data & 0x03) == 0x01) {
+                    channel.rxEnabled = true;
+                }
+                if ((data & 0x03) == 0x02) {
+                    channel.rxEnabled = false;
+                }
+                if ((data & 0x0c) == 0x04) {
+                    channel.txEnabled = true;
+                }
+                if ((data & 0x0c) == 0x08) {
+                    channel.txEnabled = false;
+                }
+
+                // 0x80 and up are the XR68C681's extended commands (baud rate
+                // sets, standby), which don't matter here
+                switch (data & 0xf0) {
+                case 0x10:
+                    channel.mrPointer = false;
+                    break;
+                case 0x20:
+                    channel.rxEnabled = false;
+                    channel.rxCount = 0;
+                    channel.status = 0;
+                    break;
+                case 0x30:
+                    channel.txEnabled = false;
+                    break;
+                case 0x40:
+                    channel.status = 0;
+                    break;
+                }
+
+                updateIrq();
+                armRxPoll();
+            }
+
+            std::uint8_t Duart::read8(std::uint32_t offset) {
+                // Registers sit on the odd bytes; the even ones float
+                if (!(offset & 1)) {
+                    return 0xff;
+                }
+
+                switch ((offset >> 1) & 0xf) {
+                case R_MR:
+                    return readMode(this->state.a);
+                case R_MR + CHANNEL_B:
+                    return readMode(this->state.b);
+                case R_SR:
+                    return readStatus(this->state.a);
+                case R_SR + CHANNEL_B:
+                    return readStatus(this->state.b);
+                case R_MISR:
+                    updateTxRx();
+                    return this->state.isr & this->state.imr;
+                case R_RHR:
+                    return readRx(this->state.a);
+                case R_RHR + CHANNEL_B:
+                    return readRx(this->state.b);
+                case R_IPCR:
+                    return 0;
+                case R_ISR:
+                    fillRx();
+                    updateTxRx();
+                    return this->state.isr;
+                case R_CTU:
+                    return counterValue() >> 8;
+                case R_CTL:
+                    return counterValue();
+                case R_IVR:
+                    return this->state.ivr;
+                case R_IP:
+                    return 0x3f;
+                case R_START_CT:
+                    startCounter();
+                    return 0xff;
+                case R_STOP_CT:
+                    // Clears the interrupt; only a counter actually stops
+                    if (!timerMode()) {
+                        this->state.ctRunning = false;
+                        armCounter();
+                    }
+                    this->state.isr &= ~ISR_COUNTER;
+                    updateIrq();
+                    return 0xff;
+                default:
+                    return 0xff;
+                }
+            }
+
+            void Duart::write8(std::uint32_t offset, std::uint8_t data) {
+                if (!(offset & 1)) {
+                    return;
+                }
+
+                switch ((offset >> 1) & 0xf) {
+                case W_MR:
+                    writeMode(this->state.a, data);
+                    break;
+                case W_MR + CHANNEL_B:
+                    writeMode(this->state.b, data);
+                    break;
+                case W_CSR:
+                    this->state.a.csr = data;
+                    break;
+                case W_CSR + CHANNEL_B:
+                    this->state.b.csr = data;
+                    break;
+                case W_CR:
+                    command(this->state.a, data);
+                    break;
+                case W_CR + CHANNEL_B:
+                    command(this->state.b, data);
+                    break;
+                case W_THR:
+                    // Into the console buffer, which goes out a line (or a
+                    // buffer-full) at a time
+                    if (this->state.a.txEnabled) {
+                        this->machine.console().put(data);
+                    }
+                    break;
+                case W_THR + CHANNEL_B:
+                    // Nothing is attached to channel B
+                    break;
+                case W_ACR:
+                    this->state.acr = data;
+                    // A timer runs from the moment it's selected
+                    if (timerMode()) {
+                        startCounter();
+                    }
+                    break;
+                case W_IMR:
+                    this->state.imr = data;
+                    updateIrq();
+                    armRxPoll();
+                    break;
+                case W_CTUR:
+                    this->state.ctPreset = (this->state.ctPreset & 0x00ff) | (data << 8);
+                    break;
+                case W_CTLR:
+                    this->state.ctPreset = (this->state.ctPreset & 0xff00) | data;
+                    break;
+                case W_IVR:
+                    this->state.ivr = data;
+                    break;
+                case W_OPCR:
+                    this->state.opcr = data;
+                    break;
+                case W_OPR_SET:
+                    this->state.opr |= data;
+                    break;
+                case W_OPR_RESET:
+                    this->state.opr &= ~data;
+                    break;
+                }
+            }
+
+            std::uint32_t Duart::prescale() const {
+                // ACR[6:4] picks the clock; only the crystal is connected
+                switch ((this->state.acr >> 4) & 0x7) {
+                case 0x3:
+                case 0x7:
+                    return 16;
+                case 0x6:
+                    return 1;
+                default:
+                    return 0;
+                }
+            }
+
+            std::uint64_t Duart::ticksToCycles(std::uint64_t ticks) const {
+                // Split to keep the product in 64 bits for any sane run length
+                std::uint64_t scale = (std::uint64_t)prescale() * this->machine.scheduler().cpuHz();
+
+                return ticks / XTAL_HZ * scale + (ticks % XTAL_HZ) * scale / XTAL_HZ;
+            }
+
+            std::uint64_t Duart::ticksSinceStart() const {
+                std::uint64_t scale = (std::uint64_t)prescale() * this->machine.scheduler().cpuHz();
+                std::uint64_t cycles = this->machine.now() - this->state.ctStart;
+
+                return scale ? cycles / scale * XTAL_HZ + (cycles % scale) * XTAL_HZ / scale : 0;
+            }
+
+            std::uint16_t Duart::counterValue() const {
+                if (!this->state.ctRunning) {
+                    return this->state.ctPreset;
+                }
+
+                std::uint64_t ticks = ticksSinceStart();
+
+                if (timerMode()) {
+                    std::uint32_t preset = this->state.ctPreset ? this->state.ctPreset : 0x10000;
+                    return preset - ticks % preset;
+                }
+
+                return this->state.ctPreset - ticks;
+            }
+
+            void Duart::startCounter() {
+                this->state.ctRunning = true;
+                this->state.ctStart = this->machine.now();
+                this->ctEvents = 0;
+                armCounter();
+            }
+
+            void Duart::armCounter() {
+                std::uint32_t generation = ++this->ctGeneration;
+
+                if (!this->state.ctRunning || !prescale()) {
+                    return;
+                }
+
+                // A timer's square wave has a period of twice the preset, and
+                // sets the interrupt once per period. A counter reaches zero
+                // after the preset, then every 64K ticks as it wraps.
+                std::uint64_t first = timerMode() ? 2 * (this->state.ctPreset ? this->state.ctPreset : 0x10000)
+                                                  : this->state.ctPreset;
+                std::uint64_t period = timerMode() ? first : 0x10000;
+                std::uint64_t when = this->state.ctStart + ticksToCycles(first + this->ctEvents * period);
+
+                this->machine.scheduler().scheduleAt(when, [this, generation]() {
+                    if (generation != this->ctGeneration) {
+                        return;
+                    }
+
+                    this->ctEvents++;
+                    this->state.isr |= ISR_COUNTER;
+                    updateIrq();
+                    armCounter();
+                });
+                this->machine.reschedule();
+            }
+
+            void Duart::armRxPoll() {
+                std::uint32_t generation = ++this->rxGeneration;
+
+                // Only an interrupt-driven receiver needs data to turn up by
+                // itself; a polled one is filled as the guest looks
+                if (!(this->state.imr & ISR_RXRDYA) || !this->state.a.rxEnabled || !this->inputReady) {
+                    return;
+                }
+
+                std::uint64_t interval = (std::uint64_t)this->machine.scheduler().cpuHz() * RX_POLL_BITS / RX_POLL_BAUD;
+
+                this->machine.scheduler().scheduleIn(interval, [this, generation]() {
+                    if (generation != this->rxGeneration) {
+                        return;
+                    }
+
+                    fillRx();
+                    updateIrq();
+                    armRxPoll();
+                });
+                this->machine.reschedule();
+            }
+        }
+    }
+}
@@ -0,0 +1,131 @@
+//
+// Loadable segments of a guest ELF executable.
+//
+
+#include <fstream>
+#include <iterator>
+#include "ElfImage.h"
+
+// Just enough of the ELF32 layout to find the program headers
+#define EI_CLASS        4
+#define EI_DATA         5
+#define ELFCLASS32      1
+#define ELFDATA2MSB     2
+
+#define ET_EXEC         2
+#define EM_68K          4
+#define PT_LOAD         1
+#define PF_X            1
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            static std::uint32_t be32(const std::vector<std::uint8_t> &data, std::size_t offset) {
+                return (data[offset] << 24) | (data[offset + 1] << 16) | (data[offset + 2] << 8) | data[offset + 3];
+            }
+
+            static std::uint16_t be16(const std::vector<std::uint8_t> &data, std::size_t offset) {
+                return (data[offset] << 8) | data[offset + 1];
+            }
+
+            bool ElfImage::isElf(char const* filename) {
+                std::ifstream in(filename, std::ios::binary);
+                char magic[4];
+
+                return in.read(magic, sizeof(magic)) && magic[0] == 0x7f && magic[1] == 'E' && magic[2] == 'L' && magic[3] == 'F';
+            }
+
+            bool ElfImage::load(char const* filename) {
+                std::ifstream in(filename, std::ios::binary);
+
+                if (!in) {
+                    this->message = std::string("cannot open ") + filename;
+                    return false;
+                }
+
+                this->data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+                this->segments.clear();
+
+                const std::vector<std::uint8_t> &data = this->data;
+
+                if (data.size() < 52 || data[0] != 0x7f || data[1] != 'E' || data[2] != 'L' || data[3] != 'F'
+                        || data[EI_CLASS] != ELFCLASS32 || data[EI_DATA] != ELFDATA2MSB
+                        || be16(data, 16) != ET_EXEC || be16(data, 18) != EM_68K) {
+                    this->message = std::string(filename) + " is not a 68k ELF executable";
+                    return false;
+                }
+
+                std::uint32_t entry = be32(data, 24);
+                std::uint32_t phoff = be32(data, 28);
+                std::uint16_t phentsize = be16(data, 42);
+                std::uint16_t phnum = be16(data, 44);
+
+                if (phentsize < 32 || phoff + (std::uint64_t)phnum * phentsize > data.size()) {
+                    this->message = std::string(filename) + " has a bad program header table";
+                    return false;
+                }
+
+                this->entryPoint = entry;
+
+                for (std::uint32_t i = 0; i < phnum; i++) {
+                    std::size_t ph = phoff + i * phentsize;
+
+                    if (be32(data, ph) != PT_LOAD || be32(data, ph + 20) == 0) {
+                        continue;
+                    }
+
+                    Segment segment = {
+                        .address = be32(data, ph + 12),
+                        .runAddress = be32(data, ph + 8),
+                        .offset = be32(data, ph + 4),
+                        .fileSize = be32(data, ph + 16),
+                        .memSize = be32(data, ph + 20),
+                        .executable = (be32(data, ph + 24) & PF_X) != 0,
+                    };
+                    std::uint32_t vaddr = segment.runAddress;
+
+                    if ((std::uint64_t)segment.offset + segment.fileSize > data.size() || segment.fileSize > segment.memSize
+                            || (std::uint64_t)segment.address + segment.memSize > AddressDecoder::BUS_SIZE) {
+                        this->message = std::string(filename) + " has a bad segment";
+                        return false;
+                    }
+
+                    // The entry point is linked at its run address; start
+                    // from where it was loaded
+                    if (entry - vaddr < segment.memSize) {
+                        this->entryPoint = entry - vaddr + segment.address;
+                    }
+
+                    this->segments.push_back(segment);
+                }
+
+                if (this->segments.empty()) {
+                    this->message = std::string(filename) + " has nothing to load";
+                    return false;
+                }
+
+                this->syms.load(data);
+                return true;
+            }
+
+            void ElfImage::place(AddressDecoder &mem) const {
+                for (auto &segment : this->segments) {
+                    mem.writeBlock(segment.address, this->data.data() + segment.offset, segment.fileSize);
+                    mem.fillBlock(segment.address + segment.fileSize, 0, segment.memSize - segment.fileSize);
+                }
+            }
+
+            std::vector<ElfImage::Code> ElfImage::code() const {
+                std::vector<Code> result;
+
+                for (auto &segment : this->segments) {
+                    if (segment.executable && segment.fileSize > 0) {
+                        result.push_back(Code { segment.runAddress, this->data.data() + segment.offset, segment.fileSize });
+                    }
+                }
+
+                return result;
+            }
+        }
+    }
+}
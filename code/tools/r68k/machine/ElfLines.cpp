@@ -0,0 +1,479 @@
+//
+// Source line table from a guest ELF executable's debug info.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include "ElfLines.h"
+
+// Just enough of the ELF32 layout to find sections by name
+#define EI_CLASS        4
+#define EI_DATA         5
+#define ELFCLASS32      1
+#define ELFDATA2MSB     2
+
+// Line number program opcodes (DWARF 5, section 6.2.5)
+#define DW_LNS_copy                 1
+#define DW_LNS_advance_pc           2
+#define DW_LNS_advance_line         3
+#define DW_LNS_set_file             4
+#define DW_LNS_const_add_pc         8
+#define DW_LNS_fixed_advance_pc     9
+
+#define DW_LNE_end_sequence         1
+#define DW_LNE_set_address          2
+#define DW_LNE_define_file          3
+
+// Entry formats for the DWARF 5 directory and file tables
+#define DW_LNCT_path                1
+#define DW_LNCT_directory_index     2
+
+#define DW_FORM_block               0x09
+#define DW_FORM_data1               0x0b
+#define DW_FORM_data2               0x05
+#define DW_FORM_data4               0x06
+#define DW_FORM_data8               0x07
+#define DW_FORM_data16              0x1e
+#define DW_FORM_string              0x08
+#define DW_FORM_strp                0x0e
+#define DW_FORM_udata               0x0f
+#define DW_FORM_line_strp           0x1f
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            static std::uint32_t be32(const std::vector<std::uint8_t> &data, std::size_t offset) {
+                return (data[offset] << 24) | (data[offset + 1] << 16) | (data[offset + 2] << 8) | data[offset + 3];
+            }
+
+            static std::uint16_t be16(const std::vector<std::uint8_t> &data, std::size_t offset) {
+                return (data[offset] << 8) | data[offset + 1];
+            }
+
+            // Walks big-endian fields and LEB128 numbers, going bad (and
+            // reading zeroes) rather than off the end
+            struct Reader {
+                const std::uint8_t *pos;
+                const std::uint8_t *end;
+                bool bad = false;
+
+                std::uint64_t fixed(unsigned size) {
+                    std::uint64_t value = 0;
+
+                    if ((std::size_t)(this->end - this->pos) < size) {
+                        this->bad = true;
+                        this->pos = this->end;
+                        return 0;
+                    }
+                    while (size--) {
+                        value = (value << 8) | *this->pos++;
+                    }
+                    return value;
+                }
+
+                std::uint64_t uleb() {
+                    std::uint64_t value = 0;
+
+                    for (unsigned shift = 0; ; shift += 7) {
+                        std::uint8_t byte = fixed(1);
+
+                        if (shift < 64) {
+                            value |= (std::uint64_t)(byte & 0x7f) << shift;
+                        }
+                        if (!(byte & 0x80) || this->bad) {
+                            return value;
+                        }
+                    }
+                }
+
+                std::int64_t sleb() {
+                    std::uint64_t value = 0;
+                    unsigned shift = 0;
+                    std::uint8_t byte;
+
+                    do {
+                        byte = fixed(1);
+                        if (shift < 64) {
+                            value |= (std::uint64_t)(byte & 0x7f) << shift;
+                        }
+                        shift += 7;
+                    } while ((byte & 0x80) && !this->bad);
+
+                    if (shift < 64 && (byte & 0x40)) {
+                        value |= ~(std::uint64_t)0 << shift;
+                    }
+                    return (std::int64_t)value;
+                }
+
+                std::string string() {
+                    const void *nul = std::memchr(this->pos, 0, this->end - this->pos);
+
+                    if (nul == nullptr) {
+                        this->bad = true;
+                        this->pos = this->end;
+                        return "";
+                    }
+
+                    std::string text((const char*)this->pos, (const char*)nul);
+                    this->pos = (const std::uint8_t*)nul + 1;
+                    return text;
+                }
+
+                void skip(std::uint64_t size) {
+                    if ((std::uint64_t)(this->end - this->pos) < size) {
+                        this->bad = true;
+                        this->pos = this->end;
+                    } else {
+                        this->pos += size;
+                    }
+                }
+            };
+
+            bool ElfLines::load(char const* filename) {
+                std::ifstream in(filename, std::ios::binary);
+
+                if (!in) {
+                    return false;
+                }
+
+                std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+                return load(data);
+            }
+
+            bool ElfLines::load(const std::vector<std::uint8_t> &data) {
+                if (data.size() < 52 || data[0] != 0x7f || data[1] != 'E' || data[2] != 'L' || data[3] != 'F'
+                        || data[EI_CLASS] != ELFCLASS32 || data[EI_DATA] != ELFDATA2MSB) {
+                    return false;
+                }
+
+                std::uint32_t shoff = be32(data, 32);
+                std::uint16_t shentsize = be16(data, 46);
+                std::uint16_t shnum = be16(data, 48);
+                std::uint16_t shstrndx = be16(data, 50);
+
+                if (shentsize < 40 || shoff + (std::uint64_t)shnum * shentsize > data.size() || shstrndx >= shnum) {
+                    return false;
+                }
+
+                auto section = [&](std::uint32_t index) { return shoff + index * shentsize; };
+                std::uint32_t namesOffset = be32(data, section(shstrndx) + 16);
+                std::uint32_t namesSize = be32(data, section(shstrndx) + 20);
+                std::map<std::string, Section> sections;
+
+                if ((std::uint64_t)namesOffset + namesSize > data.size()) {
+                    return false;
+                }
+
+                for (std::uint32_t i = 0; i < shnum; i++) {
+                    std::uint32_t name = be32(data, section(i));
+                    std::uint32_t offset = be32(data, section(i) + 16);
+                    std::uint32_t size = be32(data, section(i) + 20);
+
+                    if (name < namesSize && (std::uint64_t)offset + size <= data.size()) {
+                        const char *str = reinterpret_cast<const char*>(&data[namesOffset + name]);
+                        sections[std::string(str, strnlen(str, namesSize - name))] = Section { &data[0] + offset, size };
+                    }
+                }
+
+                this->table.clear();
+                this->paths.clear();
+
+                auto lines = sections.find(".debug_line");
+                if (lines == sections.end()) {
+                    return false;
+                }
+
+                Section none = { nullptr, 0 };
+                const Section &lineStr = sections.count(".debug_line_str") ? sections[".debug_line_str"] : none;
+                const Section &str = sections.count(".debug_str") ? sections[".debug_str"] : none;
+                const std::uint8_t *pos = lines->second.data;
+                const std::uint8_t *end = pos + lines->second.size;
+
+                while (pos < end) {
+                    if (!loadUnit(pos, end, lineStr, str)) {
+                        break;
+                    }
+                }
+
+                std::sort(this->table.begin(), this->table.end(), [](const Line &a, const Line &b) {
+                    return a.address < b.address;
+                });
+
+                return !this->table.empty();
+            }
+
+            // One compilation unit's header and line number program
+            bool ElfLines::loadUnit(const std::uint8_t *&pos, const std::uint8_t *end, const Section &lineStr, const Section &str) {
+                Reader unit = { pos, end };
+                std::uint64_t length = unit.fixed(4);
+                unsigned offsetSize = 4;
+
+                if (length == 0xffffffff) {
+                    length = unit.fixed(8);
+                    offsetSize = 8;
+                }
+                if (unit.bad || length > (std::uint64_t)(end - unit.pos)) {
+                    return false;
+                }
+
+                pos = unit.pos + length;
+                unit.end = pos;
+
+                std::uint16_t version = unit.fixed(2);
+                if (version < 2 || version > 5) {
+                    return true;
+                }
+                if (version >= 5) {
+                    unit.fixed(2);                  // address and segment selector sizes
+                }
+
+                std::uint64_t headerLength = unit.fixed(offsetSize);
+                if (headerLength > (std::uint64_t)(unit.end - unit.pos)) {
+                    return false;
+                }
+
+                const std::uint8_t *program = unit.pos + headerLength;
+                std::uint8_t minLength = unit.fixed(1);
+                if (version >= 4) {
+                    unit.fixed(1);                  // maximum operations per instruction
+                }
+                unit.fixed(1);                      // default is_stmt
+                std::int8_t lineBase = unit.fixed(1);
+                std::uint8_t lineRange = unit.fixed(1);
+                std::uint8_t opcodeBase = unit.fixed(1);
+                std::vector<std::uint8_t> opcodeLengths(opcodeBase ? opcodeBase - 1 : 0);
+
+                for (auto &argc : opcodeLengths) {
+                    argc = unit.fixed(1);
+                }
+                if (unit.bad || lineRange == 0 || opcodeBase == 0) {
+                    return false;
+                }
+
+                std::vector<std::string> dirs;
+                std::vector<std::uint32_t> files;
+
+                auto path = [&](const std::string &name, std::uint64_t dir) {
+                    if (name.empty() || name[0] == '/' || dir >= dirs.size() || dirs[dir].empty()) {
+                        return addFile(name);
+                    }
+                    return addFile(dirs[dir] + "/" + name);
+                };
+
+                if (version < 5) {
+                    // Directory 0 is the compilation directory, which only
+                    // .debug_info knows
+                    dirs.push_back("");
+                    for (std::string dir = unit.string(); !dir.empty(); dir = unit.string()) {
+                        dirs.push_back(dir);
+                    }
+
+                    // Files count from 1
+                    files.push_back(0);
+                    for (std::string name = unit.string(); !name.empty(); name = unit.string()) {
+                        std::uint64_t dir = unit.uleb();
+
+                        unit.uleb();                // modification time
+                        unit.uleb();                // length
+                        files.push_back(path(name, dir));
+                    }
+                } else {
+                    // Each table says which fields its entries have, and how
+                    // each is encoded; only the names and directories matter
+                    for (int table = 0; table < 2 && !unit.bad; table++) {
+                        std::vector<std::pair<std::uint64_t, std::uint64_t>> format(unit.fixed(1));
+
+                        for (auto &field : format) {
+                            field.first = unit.uleb();
+                            field.second = unit.uleb();
+                        }
+
+                        for (std::uint64_t count = unit.uleb(); count > 0 && !unit.bad; count--) {
+                            std::string name;
+                            std::uint64_t dir = 0;
+
+                            for (auto &field : format) {
+                                std::uint64_t value = 0;
+                                std::string text;
+
+                                switch (field.second) {
+                                case DW_FORM_string:
+                                    text = unit.string();
+                                    break;
+                                case DW_FORM_line_strp:
+                                case DW_FORM_strp: {
+                                    const Section &strings = field.second == DW_FORM_line_strp ? lineStr : str;
+                                    std::uint64_t offset = unit.fixed(offsetSize);
+
+                                    if (offset < strings.size) {
+                                        const char *s = reinterpret_cast<const char*>(strings.data + offset);
+                                        text = std::string(s, strnlen(s, strings.size - offset));
+                                    }
+                                    break;
+                                }
+                                case DW_FORM_udata:
+                                    value = unit.uleb();
+                                    break;
+                                case DW_FORM_data1:
+                                    value = unit.fixed(1);
+                                    break;
+                                case DW_FORM_data2:
+                                    value = unit.fixed(2);
+                                    break;
+                                case DW_FORM_data4:
+                                    value = unit.fixed(4);
+                                    break;
+                                case DW_FORM_data8:
+                                    value = unit.fixed(8);
+                                    break;
+                                case DW_FORM_data16:
+                                    unit.skip(16);
+                                    break;
+                                case DW_FORM_block:
+                                    unit.skip(unit.uleb());
+                                    break;
+                                default:
+                                    return false;
+                                }
+
+                                if (field.first == DW_LNCT_path) {
+                                    name = text;
+                                } else if (field.first == DW_LNCT_directory_index) {
+                                    dir = value;
+                                }
+                            }
+
+                            if (table == 0) {
+                                dirs.push_back(name);
+                            } else {
+                                files.push_back(path(name, dir));
+                            }
+                        }
+                    }
+                }
+
+                if (unit.bad) {
+                    return false;
+                }
+
+                // Run the line number program, turning each row into the
+                // range of code up to the next
+                Reader ops = { program, unit.end };
+                std::vector<Line> sequence;
+                std::uint32_t address = 0;
+                std::uint64_t file = 1;
+                std::int64_t line = 1;
+
+                auto row = [&]() {
+                    if (!sequence.empty()) {
+                        sequence.back().end = address;
+                    }
+                    sequence.push_back(Line { address, address, file < files.size() ? files[file] : UINT32_MAX, (std::uint32_t)line });
+                };
+
+                while (ops.pos < ops.end && !ops.bad) {
+                    std::uint8_t op = ops.fixed(1);
+
+                    if (op >= opcodeBase) {
+                        std::uint8_t adjusted = op - opcodeBase;
+
+                        address += (adjusted / lineRange) * minLength;
+                        line += lineBase + adjusted % lineRange;
+                        row();
+                        continue;
+                    }
+
+                    switch (op) {
+                    case 0: {
+                        std::uint64_t size = ops.uleb();
+                        const std::uint8_t *next = ops.pos + std::min<std::uint64_t>(size, ops.end - ops.pos);
+                        std::uint8_t sub = size ? ops.fixed(1) : 0;
+
+                        if (sub == DW_LNE_end_sequence) {
+                            row();
+                            sequence.pop_back();
+
+                            // Code the linker threw away is left at address 0
+                            if (!sequence.empty() && sequence.front().address != 0) {
+                                for (auto &range : sequence) {
+                                    if (range.end > range.address && range.file != UINT32_MAX) {
+                                        this->table.push_back(range);
+                                    }
+                                }
+                            }
+
+                            sequence.clear();
+                            address = 0;
+                            file = 1;
+                            line = 1;
+                        } else if (sub == DW_LNE_set_address) {
+                            address = ops.fixed(size - 1);
+                        } else if (sub == DW_LNE_define_file) {
+                            std::string name = ops.string();
+                            std::uint64_t dir = ops.uleb();
+
+                            files.push_back(path(name, dir));
+                        }
+
+                        ops.pos = next;
+                        break;
+                    }
+                    case DW_LNS_copy:
+                        row();
+                        break;
+                    case DW_LNS_advance_pc:
+                        address += ops.uleb() * minLength;
+                        break;
+                    case DW_LNS_advance_line:
+                        line += ops.sleb();
+                        break;
+                    case DW_LNS_set_file:
+                        file = ops.uleb();
+                        break;
+                    case DW_LNS_const_add_pc:
+                        address += ((255 - opcodeBase) / lineRange) * minLength;
+                        break;
+                    case DW_LNS_fixed_advance_pc:
+                        address += ops.fixed(2);
+                        break;
+                    default:
+                        // Anything else (column, is_stmt and so on) just has
+                        // arguments to skip
+                        for (unsigned i = 0; i < opcodeLengths[op - 1]; i++) {
+                            ops.uleb();
+                        }
+                    }
+                }
+
+                return true;
+            }
+
+            std::uint32_t ElfLines::addFile(const std::string &path) {
+                auto it = std::find(this->paths.begin(), this->paths.end(), path);
+
+                if (it != this->paths.end()) {
+                    return it - this->paths.begin();
+                }
+
+                this->paths.push_back(path);
+                return this->paths.size() - 1;
+            }
+
+            const ElfLines::Line* ElfLines::lookup(std::uint32_t address) const {
+                auto it = std::upper_bound(this->table.begin(), this->table.end(), address,
+                                           [](std::uint32_t addr, const Line &l) { return addr < l.address; });
+
+                if (it == this->table.begin()) {
+                    return nullptr;
+                }
+
+                --it;
+                return address < it->end ? &*it : nullptr;
+            }
+        }
+    }
+}
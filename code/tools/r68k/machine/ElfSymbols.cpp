@@ -0,0 +1,176 @@
+//
+// Function symbols from a guest ELF executable.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "ElfSymbols.h"
+
+// Just enough of the ELF32 layout to find the symbol table
+#define EI_CLASS        4
+#define EI_DATA         5
+#define ELFCLASS32      1
+#define ELFDATA2MSB     2
+
+#define SHT_SYMTAB      2
+#define SHF_EXECINSTR   0x4
+#define SHN_LORESERVE   0xff00
+
+#define STT_NOTYPE      0
+#define STT_FUNC        2
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            static std::uint32_t be32(const std::vector<std::uint8_t> &data, std::size_t offset) {
+                return (data[offset] << 24) | (data[offset + 1] << 16) | (data[offset + 2] << 8) | data[offset + 3];
+            }
+
+            static std::uint16_t be16(const std::vector<std::uint8_t> &data, std::size_t offset) {
+                return (data[offset] << 8) | data[offset + 1];
+            }
+
+            bool ElfSymbols::load(char const* filename) {
+                std::ifstream in(filename, std::ios::binary);
+
+                if (!in) {
+                    return false;
+                }
+
+                std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+                return load(data);
+            }
+
+            bool ElfSymbols::load(const std::vector<std::uint8_t> &data) {
+                if (data.size() < 52 || data[0] != 0x7f || data[1] != 'E' || data[2] != 'L' || data[3] != 'F'
+                        || data[EI_CLASS] != ELFCLASS32 || data[EI_DATA] != ELFDATA2MSB) {
+                    return false;
+                }
+
+                std::uint32_t shoff = be32(data, 32);
+                std::uint16_t shentsize = be16(data, 46);
+                std::uint16_t shnum = be16(data, 48);
+
+                if (shentsize < 40 || shoff + (std::uint64_t)shnum * shentsize > data.size()) {
+                    return false;
+                }
+
+                auto section = [&](std::uint32_t index) { return shoff + index * shentsize; };
+
+                this->symbols.clear();
+
+                for (std::uint32_t i = 0; i < shnum; i++) {
+                    if (be32(data, section(i) + 4) != SHT_SYMTAB) {
+                        continue;
+                    }
+
+                    std::uint32_t symoff = be32(data, section(i) + 16);
+                    std::uint32_t symsize = be32(data, section(i) + 20);
+                    std::uint32_t link = be32(data, section(i) + 24);
+
+                    if (link >= shnum) {
+                        continue;
+                    }
+
+                    std::uint32_t stroff = be32(data, section(link) + 16);
+                    std::uint32_t strsize = be32(data, section(link) + 20);
+
+                    if ((std::uint64_t)symoff + symsize > data.size() || (std::uint64_t)stroff + strsize > data.size()) {
+                        continue;
+                    }
+
+                    for (std::uint32_t sym = symoff; sym + 16 <= symoff + symsize; sym += 16) {
+                        std::uint32_t name = be32(data, sym);
+                        std::uint8_t type = data[sym + 12] & 0xf;
+                        std::uint16_t shndx = be16(data, sym + 14);
+
+                        // Only named code symbols: functions, and untyped labels
+                        // from assembly sources
+                        if ((type != STT_FUNC && type != STT_NOTYPE) || name == 0 || name >= strsize
+                                || shndx == 0 || shndx >= SHN_LORESERVE || shndx >= shnum
+                                || !(be32(data, section(shndx) + 8) & SHF_EXECINSTR)) {
+                            continue;
+                        }
+
+                        const char *str = reinterpret_cast<const char*>(&data[stroff + name]);
+                        std::string symbol(str, strnlen(str, strsize - name));
+
+                        // Skip compiler-local labels (.L123 etc.)
+                        if (symbol.empty() || symbol[0] == '.') {
+                            continue;
+                        }
+
+                        std::uint32_t value = be32(data, sym + 4);
+                        std::uint32_t size = be32(data, sym + 8);
+                        std::uint32_t end = size ? value + size
+                                                 : be32(data, section(shndx) + 12) + be32(data, section(shndx) + 20);
+
+                        this->symbols.push_back(Symbol { value, size, end, symbol });
+                    }
+                }
+
+                // Prefer sized (function) symbols over labels at the same address
+                std::stable_sort(this->symbols.begin(), this->symbols.end(), [](const Symbol &a, const Symbol &b) {
+                    return a.address != b.address ? a.address < b.address : a.size > b.size;
+                });
+
+                return !this->symbols.empty();
+            }
+
+            const ElfSymbols::Symbol* ElfSymbols::find(const std::string &name) const {
+                auto it = std::find_if(this->symbols.begin(), this->symbols.end(),
+                                       [&name](const Symbol &s) { return s.name == name; });
+
+                return it != this->symbols.end() ? &*it : nullptr;
+            }
+
+            const ElfSymbols::Symbol* ElfSymbols::lookup(std::uint32_t address) const {
+                auto it = std::upper_bound(this->symbols.begin(), this->symbols.end(), address,
+                                           [](std::uint32_t addr, const Symbol &s) { return addr < s.address; });
+
+                if (it == this->symbols.begin()) {
+                    return nullptr;
+                }
+
+                // Back up to the first symbol at this address
+                std::uint32_t at = (--it)->address;
+                while (it != this->symbols.begin() && (it - 1)->address == at) {
+                    --it;
+                }
+
+                return address < it->end ? &*it : nullptr;
+            }
+
+            std::string ElfSymbols::describe(std::uint32_t address) const {
+                const Symbol *symbol = lookup(address);
+                char buf[32];
+
+                if (symbol == nullptr) {
+                    snprintf(buf, sizeof(buf), "0x%08x", address);
+                    return buf;
+                } else if (symbol->address == address) {
+                    return symbol->name;
+                } else {
+                    snprintf(buf, sizeof(buf), "+0x%x", address - symbol->address);
+                    return symbol->name + buf;
+                }
+            }
+
+            std::string ElfSymbols::function(std::uint32_t address) const {
+                const Symbol *symbol = lookup(address);
+                char buf[16];
+
+                if (symbol == nullptr) {
+                    snprintf(buf, sizeof(buf), "0x%08x", address);
+                    return buf;
+                }
+
+                return symbol->name;
+            }
+        }
+    }
+}
@@ -0,0 +1,261 @@
+//
+// In-process fuzzing of a guest function.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "Fuzzer.h"
+#include "../musashi/m68k.h"
+
+#define FRAME_SIZE      12          // return address, data, size
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            Fuzzer::Fuzzer(Machine &machine, Coverage &coverage, std::uint32_t codeStart, std::uint32_t codeEnd, std::uint64_t budget)
+                    : machine(machine), coverage(coverage), random(std::random_device()()) {
+                this->entry = m68k_get_reg(NULL, M68K_REG_PC);
+                this->stackTop = m68k_get_reg(NULL, M68K_REG_A7);
+                this->returnAddress = machine.memory().read32(this->stackTop);
+                this->codeStart = codeStart & ~1u;
+                this->codeEnd = std::max(this->codeStart, codeEnd);
+                this->budget = budget;
+                this->seen.assign(coverage.map() + this->codeStart / 2, coverage.map() + (this->codeEnd + 1) / 2);
+                this->covered = std::count_if(this->seen.begin(), this->seen.end(), [](std::uint8_t run) { return run != 0; });
+                this->execs = 0;
+                this->started = std::chrono::steady_clock::now();
+
+                machine.checkpoint();
+            }
+
+            Fuzzer::Outcome Fuzzer::execute(const Input &input) {
+                AddressDecoder &mem = this->machine.memory();
+
+                this->machine.rollback();
+
+                // The input goes just below the program's own call, so
+                // everything live in the guest is left alone
+                std::uint32_t size = input.size();
+                std::uint32_t data = (this->stackTop - size) & ~3u;
+                std::uint32_t frame = data - FRAME_SIZE;
+
+                {
+                    Machine::HostAccess host(this->machine);
+
+                    mem.writeBlock(data, input.data(), size);
+                    mem.write32(frame, this->returnAddress);
+                    mem.write32(frame + 4, data);
+                    mem.write32(frame + 8, size);
+                }
+                m68k_invalidate_code(frame, data + size - frame);
+
+                m68k_set_reg(M68K_REG_A7, frame);
+                m68k_set_reg(M68K_REG_PC, this->entry);
+
+                bool returned = this->machine.runTo(this->returnAddress, this->machine.now() + this->budget);
+                this->execs++;
+
+                if (returned) {
+                    return Outcome::Returned;
+                } else if (this->machine.faulted()) {
+                    return Outcome::Fault;
+                } else if (this->machine.halted()) {
+                    return Outcome::Halt;
+                } else if (this->machine.exited()) {
+                    return Outcome::Exit;
+                }
+                return Outcome::Timeout;
+            }
+
+            // The map only ever grows, so anything it has over what's been
+            // seen is new
+            bool Fuzzer::newCoverage() {
+                const std::uint8_t *map = this->coverage.map() + this->codeStart / 2;
+
+                if (std::memcmp(map, this->seen.data(), this->seen.size()) == 0) {
+                    return false;
+                }
+
+                for (std::size_t i = 0; i < this->seen.size(); i++) {
+                    if (map[i] != this->seen[i]) {
+                        this->covered += this->seen[i] == 0;
+                        this->seen[i] = map[i];
+                    }
+                }
+                return true;
+            }
+
+            void Fuzzer::mutate(Input &input, std::uint32_t maxLen) {
+                static const std::uint32_t interesting[] = {
+                    0, 1, 0x7f, 0x80, 0xff, 0x100, 0x7fff, 0x8000, 0xffff, 0x10000, 0x7fffffff, 0x80000000, 0xffffffff
+                };
+
+                unsigned count = 1 + this->random() % 4;
+
+                for (unsigned n = 0; n < count; n++) {
+                    unsigned kind = this->random() % 7;
+
+                    // Everything but inserting needs bytes to work on
+                    if (input.empty() || (kind == 3 && input.size() == 1)) {
+                        kind = 2;
+                    }
+
+                    std::size_t at = input.empty() ? 0 : this->random() % input.size();
+
+                    switch (kind) {
+                    case 0:
+                        input[at] ^= 1 << (this->random() % 8);
+                        break;
+                    case 1:
+                        input[at] = this->random();
+                        break;
+                    case 2: {
+                        std::size_t length = 1 + this->random() % 4;
+                        at = this->random() % (input.size() + 1);
+                        for (std::size_t i = 0; i < length; i++) {
+                            input.insert(input.begin() + at, (std::uint8_t)this->random());
+                        }
+                        break;
+                    }
+                    case 3: {
+                        std::size_t length = 1 + this->random() % std::min<std::size_t>(input.size() - at, 8);
+                        input.erase(input.begin() + at, input.begin() + at + length);
+                        break;
+                    }
+                    case 4: {
+                        std::size_t from = this->random() % input.size();
+                        std::size_t length = 1 + this->random() % (input.size() - std::max(at, from));
+                        std::memmove(input.data() + at, input.data() + from, length);
+                        break;
+                    }
+                    case 5: {
+                        // Big-endian, as the guest would read it
+                        std::uint32_t value = interesting[this->random() % std::size(interesting)];
+                        unsigned width = 1 << (this->random() % 3);
+                        for (unsigned i = 0; i < width && at + i < input.size(); i++) {
+                            input[at + i] = value >> (8 * (width - 1 - i));
+                        }
+                        break;
+                    }
+                    case 6: {
+                        // Splice: this input up to a point, then another's tail
+                        const Input &other = this->corpus[this->random() % this->corpus.size()];
+                        if (!other.empty()) {
+                            std::size_t from = this->random() % other.size();
+                            input.resize(at);
+                            input.insert(input.end(), other.begin() + from, other.end());
+                        }
+                        break;
+                    }
+                    }
+                }
+
+                if (input.size() > maxLen) {
+                    input.resize(maxLen);
+                }
+            }
+
+            bool Fuzzer::fuzz(std::vector<Input> seeds, const std::string &corpusDir, std::uint64_t runs, std::uint32_t maxLen, std::ostream &log) {
+                if (seeds.empty()) {
+                    seeds.emplace_back();
+                }
+
+                for (auto &seed : seeds) {
+                    Outcome outcome = execute(seed);
+
+                    if (outcome != Outcome::Returned) {
+                        crashed(seed, outcome, log);
+                        return false;
+                    }
+                    if (newCoverage() || this->corpus.empty()) {
+                        this->corpus.push_back(std::move(seed));
+                    }
+                }
+                status(log, "INITED");
+
+                while (runs == 0 || this->execs < runs) {
+                    Input input = this->corpus[this->random() % this->corpus.size()];
+                    mutate(input, maxLen);
+
+                    Outcome outcome = execute(input);
+
+                    if (outcome != Outcome::Returned) {
+                        crashed(input, outcome, log);
+                        return false;
+                    }
+
+                    if (newCoverage()) {
+                        if (!corpusDir.empty()) {
+                            std::ofstream out(std::filesystem::path(corpusDir) / hash(input), std::ios::binary);
+                            out.write((const char*)input.data(), input.size());
+                        }
+                        this->corpus.push_back(std::move(input));
+                        status(log, "NEW");
+                    } else if ((this->execs & (this->execs - 1)) == 0) {
+                        status(log, "pulse");
+                    }
+                }
+
+                status(log, "DONE");
+                return true;
+            }
+
+            void Fuzzer::status(std::ostream &log, const char *event) {
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->started).count();
+
+                log << "#" << this->execs << "\t" << event << " cov: " << this->covered << " corp: " << this->corpus.size()
+                    << " exec/s: " << (seconds > 0 ? (std::uint64_t)(this->execs / seconds) : 0) << std::endl;
+            }
+
+            void Fuzzer::crashed(const Input &input, Outcome outcome, std::ostream &log) {
+                std::uint32_t pc = outcome == Outcome::Fault ? this->machine.faultPc() : m68k_get_reg(NULL, M68K_REG_PPC);
+                std::string name = "crash-" + hash(input);
+
+                log << "==r68k== " << describe(outcome) << " on run " << this->execs << ", at PC 0x" << std::hex << pc << std::dec;
+                if (this->machine.symbols().lookup(pc)) {
+                    log << " (" << this->machine.symbols().describe(pc) << ")";
+                }
+                log << std::endl;
+
+                if (this->machine.tracing()) {
+                    this->machine.dumpTrace(log, describe(outcome));
+                }
+
+                std::ofstream out(name, std::ios::binary);
+                out.write((const char*)input.data(), input.size());
+                log << "Input of " << input.size() << " bytes written to " << name << std::endl;
+            }
+
+            const char* Fuzzer::describe(Outcome outcome) {
+                switch (outcome) {
+                case Outcome::Returned:
+                    return "Target returned";
+                case Outcome::Fault:
+                    return "Bus fault or illegal instruction";
+                case Outcome::Halt:
+                    return "CPU halted by a double fault";
+                case Outcome::Exit:
+                    return "Program exited";
+                default:
+                    return "Timed out";
+                }
+            }
+
+            std::string Fuzzer::hash(const Input &input) {
+                std::uint64_t hash = 0xcbf29ce484222325ULL;          // FNV-1a
+                std::ostringstream name;
+
+                for (std::uint8_t byte : input) {
+                    hash = (hash ^ byte) * 0x100000001b3ULL;
+                }
+
+                name << std::hex << std::setfill('0') << std::setw(16) << hash;
+                return name.str();
+            }
+        }
+    }
+}
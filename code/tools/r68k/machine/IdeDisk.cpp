@@ -0,0 +1,420 @@
+//
+// IDE hard disk on the emulated bus.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include "IdeDisk.h"
+#include "Machine.h"
+
+// Registers, by word index
+#define REG_DATA            0
+#define REG_ERROR           1           // features when written
+#define REG_SECTOR_COUNT    2
+#define REG_LBA_7_0         3
+#define REG_LBA_15_8        4
+#define REG_LBA_23_16       5
+#define REG_DEVSEL          6
+#define REG_STATUS          7           // command when written
+#define REG_ALT_STATUS      14          // device control when written
+
+#define SR_BSY              0x80
+#define SR_DRDY             0x40
+#define SR_DSC              0x10
+#define SR_DRQ              0x08
+#define SR_ERR              0x01
+
+#define ER_IDNF             0x10
+#define ER_ABRT             0x04
+
+#define DC_SRST             0x04
+
+#define CMD_READ_SECTORS    0x20
+#define CMD_READ_SECTORS_NR 0x21
+#define CMD_WRITE_SECTORS   0x30
+#define CMD_WRITE_SECTORS_NR 0x31
+#define CMD_READ_MULTIPLE   0xc4
+#define CMD_WRITE_MULTIPLE  0xc5
+#define CMD_SET_MULTIPLE    0xc6
+#define CMD_IDENTIFY        0xec
+
+// Geometry reported for CHS addressing
+#define HEADS               16
+#define SECTORS_PER_TRACK   63
+#define MAX_CYLINDERS       16383
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            static const char* commandName(std::uint8_t cmd) {
+                switch (cmd) {
+                case CMD_READ_SECTORS:
+                case CMD_READ_SECTORS_NR:
+                    return "READ SECTORS";
+                case CMD_WRITE_SECTORS:
+                case CMD_WRITE_SECTORS_NR:
+                    return "WRITE SECTORS";
+                case CMD_READ_MULTIPLE:
+                    return "READ MULTIPLE";
+                case CMD_WRITE_MULTIPLE:
+                    return "WRITE MULTIPLE";
+                case CMD_SET_MULTIPLE:
+                    return "SET MULTIPLE MODE";
+                case CMD_IDENTIFY:
+                    return "IDENTIFY DEVICE";
+                default:
+                    return nullptr;
+                }
+            }
+
+            IdeDisk::IdeDisk(Machine &machine, char const* filename, bool overlay)
+                    : machine(machine), disk(filename, overlay) {
+                this->control = 0;
+                this->current = 0;
+                this->started = 0;
+                reset();
+            }
+
+            void IdeDisk::reset() {
+                // The ATA device signature, and "no error" from diagnostics
+                this->features = 0;
+                this->sectorCount = 1;
+                this->lba[0] = 1;
+                this->lba[1] = 0;
+                this->lba[2] = 0;
+                this->devsel = 0xa0;
+                this->status = SR_DRDY | SR_DSC;
+                this->error = 0x01;
+                this->multiple = 0;
+                this->data = nullptr;
+                this->blockLeft = 0;
+                this->sectorsLeft = 0;
+                this->perBlock = 0;
+                this->writing = false;
+            }
+
+            std::uint8_t IdeDisk::read8(std::uint32_t offset) {
+                // Registers are in the low byte of each word
+                if (!(offset & 1)) {
+                    return (offset >> 1) == REG_DATA ? readData() >> 8 : 0;
+                }
+
+                return (offset >> 1) == REG_DATA ? readData() : readRegister(offset >> 1);
+            }
+
+            void IdeDisk::write8(std::uint32_t offset, std::uint8_t data) {
+                if ((offset >> 1) == REG_DATA) {
+                    writeData(data);
+                } else if (offset & 1) {
+                    writeRegister(offset >> 1, data);
+                }
+            }
+
+            std::uint16_t IdeDisk::read16(std::uint32_t offset) {
+                return (offset >> 1) == REG_DATA ? readData() : readRegister(offset >> 1);
+            }
+
+            void IdeDisk::write16(std::uint32_t offset, std::uint16_t data) {
+                if ((offset >> 1) == REG_DATA) {
+                    writeData(data);
+                } else {
+                    writeRegister(offset >> 1, data);
+                }
+            }
+
+            std::uint8_t IdeDisk::readRegister(unsigned reg) {
+                // Nobody answers for the slave
+                if (!masterSelected() && reg != REG_DEVSEL) {
+                    return 0;
+                }
+
+                switch (reg) {
+                case REG_ERROR:
+                    return this->error;
+                case REG_SECTOR_COUNT:
+                    return this->sectorCount;
+                case REG_LBA_7_0:
+                case REG_LBA_15_8:
+                case REG_LBA_23_16:
+                    return this->lba[reg - REG_LBA_7_0];
+                case REG_DEVSEL:
+                    return this->devsel;
+                case REG_STATUS:
+                case REG_ALT_STATUS:
+                    if (this->current) {
+                        this->stats[this->current].statusReads++;
+                    }
+                    return this->status;
+                default:
+                    return 0xff;
+                }
+            }
+
+            void IdeDisk::writeRegister(unsigned reg, std::uint8_t data) {
+                switch (reg) {
+                case REG_ERROR:
+                    this->features = data;
+                    break;
+                case REG_SECTOR_COUNT:
+                    this->sectorCount = data;
+                    break;
+                case REG_LBA_7_0:
+                case REG_LBA_15_8:
+                case REG_LBA_23_16:
+                    this->lba[reg - REG_LBA_7_0] = data;
+                    break;
+                case REG_DEVSEL:
+                    this->devsel = data;
+                    break;
+                case REG_STATUS:
+                    if (masterSelected()) {
+                        command(data);
+                    }
+                    break;
+                case REG_ALT_STATUS:
+                    if ((this->control & DC_SRST) && !(data & DC_SRST)) {
+                        reset();
+                    }
+                    this->control = data;
+                    break;
+                }
+            }
+
+            std::uint16_t IdeDisk::readData() {
+                if (!(this->status & SR_DRQ) || this->writing) {
+                    return 0xffff;
+                }
+
+                std::uint16_t word = this->data[0] | (this->data[1] << 8);
+                this->data += 2;
+
+                if ((this->blockLeft -= 2) == 0) {
+                    nextBlock();
+                }
+
+                return word;
+            }
+
+            void IdeDisk::writeData(std::uint16_t word) {
+                if (!(this->status & SR_DRQ) || !this->writing) {
+                    return;
+                }
+
+                this->data[0] = word;
+                this->data[1] = word >> 8;
+                this->data += 2;
+
+                if ((this->blockLeft -= 2) == 0) {
+                    nextBlock();
+                }
+            }
+
+            void IdeDisk::command(std::uint8_t cmd) {
+                // A new command abandons whatever was in progress
+                this->current = cmd;
+                this->started = this->machine.now();
+                this->stats[cmd].commands++;
+                this->status = SR_DRDY | SR_DSC;
+                this->error = 0;
+                this->sectorsLeft = 0;
+
+                switch (cmd) {
+                case CMD_READ_SECTORS:
+                case CMD_READ_SECTORS_NR:
+                    startTransfer(false, 1);
+                    break;
+                case CMD_WRITE_SECTORS:
+                case CMD_WRITE_SECTORS_NR:
+                    startTransfer(true, 1);
+                    break;
+                case CMD_READ_MULTIPLE:
+                case CMD_WRITE_MULTIPLE:
+                    if (this->multiple == 0) {
+                        abort(ER_ABRT);
+                    } else {
+                        startTransfer(cmd == CMD_WRITE_MULTIPLE, this->multiple);
+                    }
+                    break;
+                case CMD_SET_MULTIPLE:
+                    // Block sizes are powers of two up to the limit; 0 turns it off
+                    if (this->sectorCount > MAX_MULTIPLE || (this->sectorCount & (this->sectorCount - 1))) {
+                        abort(ER_ABRT);
+                    } else {
+                        this->multiple = this->sectorCount;
+                        complete();
+                    }
+                    break;
+                case CMD_IDENTIFY:
+                    if (!this->disk.isOpen()) {
+                        abort(ER_ABRT);
+                    } else {
+                        identify();
+                    }
+                    break;
+                case 0x10:          // RECALIBRATE
+                case 0x40:          // READ VERIFY SECTORS
+                case 0x91:          // INITIALIZE DEVICE PARAMETERS
+                case 0xe0:          // STANDBY IMMEDIATE
+                case 0xe1:          // IDLE IMMEDIATE
+                case 0xe7:          // FLUSH CACHE (the image is written through)
+                case 0xef:          // SET FEATURES
+                    complete();
+                    break;
+                default:
+                    abort(ER_ABRT);
+                    break;
+                }
+            }
+
+            bool IdeDisk::startTransfer(bool write, std::uint32_t perBlock) {
+                std::uint32_t block;
+
+                if (this->devsel & 0x40) {
+                    block = ((this->devsel & 0x0f) << 24) | (this->lba[2] << 16) | (this->lba[1] << 8) | this->lba[0];
+                } else {
+                    std::uint32_t cylinder = (this->lba[2] << 8) | this->lba[1];
+                    std::uint32_t sector = this->lba[0];
+
+                    if (sector == 0) {
+                        abort(ER_IDNF);
+                        return false;
+                    }
+                    block = (cylinder * HEADS + (this->devsel & 0x0f)) * SECTORS_PER_TRACK + sector - 1;
+                }
+
+                std::uint32_t count = this->sectorCount ? this->sectorCount : 256;
+                std::uint8_t *data = this->disk.blocks(block, count);
+
+                if (data == nullptr) {
+                    abort(ER_IDNF);
+                    return false;
+                }
+
+                this->data = data;
+                this->sectorsLeft = count;
+                this->perBlock = perBlock;
+                this->writing = write;
+                nextBlock();
+                return true;
+            }
+
+            void IdeDisk::identify() {
+                std::uint64_t total = std::min<std::uint64_t>(this->disk.blockCount(), 0x0fffffff);
+                std::uint32_t cylinders = std::min<std::uint64_t>(total / (HEADS * SECTORS_PER_TRACK), MAX_CYLINDERS);
+
+                auto word = [this](unsigned index, std::uint16_t value) {
+                    this->identity[index * 2] = value;
+                    this->identity[index * 2 + 1] = value >> 8;
+                };
+
+                // ATA strings are space-padded, two characters to a word, first
+                // character in the high byte
+                auto text = [&word](unsigned index, unsigned words, const char *s) {
+                    std::size_t length = std::strlen(s);
+
+                    for (unsigned i = 0; i < words * 2; i += 2) {
+                        char hi = i < length ? s[i] : ' ';
+                        char lo = i + 1 < length ? s[i + 1] : ' ';
+                        word(index + i / 2, ((std::uint8_t)hi << 8) | (std::uint8_t)lo);
+                    }
+                };
+
+                std::memset(this->identity, 0, sizeof(this->identity));
+                word(0, 0x0040);                            // fixed disk
+                word(1, cylinders);
+                word(3, HEADS);
+                word(6, SECTORS_PER_TRACK);
+                text(10, 10, "R68K0001");
+                text(23, 4, "1.0");
+                text(27, 20, "r68k IDE disk image");
+                word(47, 0x8000 | MAX_MULTIPLE);
+                word(49, 0x0200);                           // LBA
+                word(53, 0x0001);                           // words 54-58 valid
+                word(54, cylinders);
+                word(55, HEADS);
+                word(56, SECTORS_PER_TRACK);
+                word(57, (cylinders * HEADS * SECTORS_PER_TRACK) & 0xffff);
+                word(58, (cylinders * HEADS * SECTORS_PER_TRACK) >> 16);
+                word(59, this->multiple ? 0x0100 | this->multiple : 0);
+                word(60, total & 0xffff);
+                word(61, total >> 16);
+
+                this->data = this->identity;
+                this->sectorsLeft = 1;
+                this->perBlock = 1;
+                this->writing = false;
+                nextBlock();
+            }
+
+            void IdeDisk::nextBlock() {
+                if (this->sectorsLeft == 0) {
+                    complete();
+                    return;
+                }
+
+                std::uint32_t sectors = std::min(this->perBlock, this->sectorsLeft);
+                Stats &stats = this->stats[this->current];
+
+                this->sectorsLeft -= sectors;
+                this->blockLeft = sectors * BlockDevice::BLOCK_SIZE;
+                this->status |= SR_DRQ;
+
+                if (this->data != this->identity) {
+                    stats.sectors += sectors;
+                    stats.bytes += sectors * BlockDevice::BLOCK_SIZE;
+                } else {
+                    stats.bytes += BlockDevice::BLOCK_SIZE;
+                }
+            }
+
+            void IdeDisk::complete() {
+                Stats &stats = this->stats[this->current];
+                std::uint64_t cycles = this->machine.now() - this->started;
+
+                stats.cycles += cycles;
+                stats.maxCycles = std::max(stats.maxCycles, cycles);
+
+                this->status &= ~(SR_DRQ | SR_BSY);
+                this->data = nullptr;
+            }
+
+            void IdeDisk::abort(std::uint8_t error) {
+                this->stats[this->current].errors++;
+                this->error = error;
+                this->status |= SR_ERR;
+                complete();
+            }
+
+            void IdeDisk::report(std::ostream &out) const {
+                std::uint32_t hz = this->machine.scheduler().cpuHz();
+
+                out << std::left << std::setw(26) << "IDE command" << std::right
+                    << std::setw(9) << "count" << std::setw(8) << "errors"
+                    << std::setw(10) << "sectors" << std::setw(12) << "bytes"
+                    << std::setw(10) << "polls" << std::setw(12) << "avg us"
+                    << std::setw(12) << "max us" << std::endl;
+
+                for (auto &entry : this->stats) {
+                    const Stats &stats = entry.second;
+                    const char *name = commandName(entry.first);
+                    std::ostringstream label;
+
+                    if (name) {
+                        label << name << " ";
+                    }
+                    label << "(0x" << std::hex << std::setw(2) << std::setfill('0') << (int)entry.first << ")";
+
+                    out << std::left << std::setw(26) << label.str() << std::right << std::dec
+                        << std::setw(9) << stats.commands << std::setw(8) << stats.errors
+                        << std::setw(10) << stats.sectors << std::setw(12) << stats.bytes
+                        << std::setw(10) << stats.statusReads
+                        << std::fixed << std::setprecision(1)
+                        << std::setw(12) << (stats.commands ? stats.cycles * 1e6 / hz / stats.commands : 0.0)
+                        << std::setw(12) << stats.maxCycles * 1e6 / hz << std::endl;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,170 @@
+//
+// Record/replay journal of a machine's nondeterministic inputs.
+//
+
+#include <cstring>
+#include "Journal.h"
+
+#define JOURNAL_MAGIC   "R68KJRN1"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            static const char *eventNames[] = {
+                "?", "check_char", "read_char", "sd_init", "sd_read", "sd_write", "exit"
+            };
+
+            static const char* eventName(std::uint8_t type) {
+                return type < sizeof(eventNames) / sizeof(eventNames[0]) ? eventNames[type] : "?";
+            }
+
+            // Header fields are little-endian; cycle deltas are LEB128
+            static void putLE(std::fstream &file, std::uint64_t value, int bytes) {
+                for (int i = 0; i < bytes; i++) {
+                    file.put((char)(value >> (i * 8)));
+                }
+            }
+
+            static std::uint64_t getLE(std::fstream &file, int bytes) {
+                std::uint64_t value = 0;
+
+                for (int i = 0; i < bytes; i++) {
+                    value |= (std::uint64_t)(std::uint8_t)file.get() << (i * 8);
+                }
+
+                return value;
+            }
+
+            bool Journal::record(char const* filename, const Header &header) {
+                this->file.open(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+
+                if (!this->file) {
+                    return fail(std::string("cannot create ") + filename);
+                }
+
+                this->file.write(JOURNAL_MAGIC, 8);
+                putLE(this->file, header.cpuHz, 4);
+                putLE(this->file, header.tickHz, 4);
+                putLE(this->file, header.imageHash, 8);
+
+                this->mode = Mode::Record;
+                return true;
+            }
+
+            bool Journal::replay(char const* filename, Header &header) {
+                char magic[8];
+
+                this->file.open(filename, std::ios::binary | std::ios::in);
+
+                if (!this->file || !this->file.read(magic, 8) || std::memcmp(magic, JOURNAL_MAGIC, 8) != 0) {
+                    return fail(std::string(filename) + " is not an r68k journal");
+                }
+
+                header.cpuHz = getLE(this->file, 4);
+                header.tickHz = getLE(this->file, 4);
+                header.imageHash = getLE(this->file, 8);
+
+                this->mode = Mode::Replay;
+                return bool(this->file);
+            }
+
+            void Journal::event(Event type, std::uint64_t cycle) {
+                std::uint64_t delta = cycle - this->lastCycle;
+
+                this->file.put(type);
+                do {
+                    this->file.put((char)((delta & 0x7f) | (delta > 0x7f ? 0x80 : 0)));
+                    delta >>= 7;
+                } while (delta);
+
+                this->lastCycle = cycle;
+            }
+
+            void Journal::put(const void *data, std::size_t size) {
+                this->file.write(static_cast<const char*>(data), size);
+            }
+
+            // Decode the next entry's type and cycle, if not already done
+            bool Journal::peek() {
+                if (this->peeked) {
+                    return true;
+                }
+
+                int type = this->file.get();
+                if (type == EOF) {
+                    return false;
+                }
+
+                std::uint64_t delta = 0;
+                for (int shift = 0; ; shift += 7) {
+                    int b = this->file.get();
+                    if (b == EOF || shift > 63) {
+                        return fail("journal is truncated");
+                    }
+                    delta |= (std::uint64_t)(b & 0x7f) << shift;
+                    if (!(b & 0x80)) {
+                        break;
+                    }
+                }
+
+                this->nextType = type;
+                this->nextCycle = this->lastCycle + delta;
+                this->lastCycle = this->nextCycle;
+                this->peeked = true;
+                return true;
+            }
+
+            bool Journal::expect(Event type, std::uint64_t cycle) {
+                if (!this->lastError.empty()) {
+                    return false;
+                }
+
+                if (!peek()) {
+                    return fail(this->lastError.empty() ? std::string("journal ended, but guest wants ") + eventName(type)
+                                                          + " at cycle " + std::to_string(cycle)
+                                                        : this->lastError);
+                }
+
+                if (this->nextType != type || this->nextCycle != cycle) {
+                    return fail(std::string("diverged: journal has ") + eventName(this->nextType) + " at cycle "
+                                + std::to_string(this->nextCycle) + ", guest wants " + eventName(type)
+                                + " at cycle " + std::to_string(cycle));
+                }
+
+                this->peeked = false;
+                return true;
+            }
+
+            bool Journal::poll(Event type, std::uint64_t cycle) {
+                if (!this->lastError.empty()) {
+                    return false;
+                }
+
+                // Past the end, or at or beyond the next entry, it has to be
+                // this one; anything else is reported by expect()
+                if (!peek() || this->nextCycle <= cycle) {
+                    return expect(type, cycle);
+                }
+
+                return false;
+            }
+
+            bool Journal::get(void *data, std::size_t size) {
+                if (!this->lastError.empty()) {
+                    return false;
+                }
+
+                if (!this->file.read(static_cast<char*>(data), size)) {
+                    return fail("journal is truncated");
+                }
+
+                return true;
+            }
+
+            bool Journal::fail(const std::string &message) {
+                this->lastError = message;
+                return false;
+            }
+        }
+    }
+}
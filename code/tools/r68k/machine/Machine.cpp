@@ -0,0 +1,494 @@
+//
+// A complete emulated rosco_m68k machine.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ElfImage.h"
+#include "Machine.h"
+#include "../musashi/m68k.h"
+
+#define EXECUTE_SLICE     100000
+#define CONSOLE_FLUSH_HZ  50
+#define SNAPSHOT_MAGIC    "R68KSNP3"
+#define IDLE_POLLS        32        // identical empty polls before going idle
+#define IDLE_POLL_GAP     5000      // most cycles between them
+#define FAULT_REPORTS     10
+
+extern "C" {
+    // Decoder of the machine loaded on this thread, used by the memory glue
+    thread_local rosco::m68k::emu::AddressDecoder *sys_mem;
+
+    // Its tracer, if it has one, for the glue to log writes to
+    thread_local rosco::m68k::emu::Tracer *sys_trace;
+}
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            static thread_local Machine *currentMachine;
+
+            // Snapshot files start with this, followed by the raw CPU context,
+            // the DUART's registers, then the address decoder's state and
+            // memory.
+            struct SnapshotHeader {
+                char magic[8];
+                std::uint32_t contextSize;
+                std::uint32_t reserved;
+                std::uint64_t cycles;
+            };
+
+            Machine::Machine(char const* romFile, std::uint32_t cpuHz, char const* sdImage, bool sdOverlay, const MemoryMap &memoryMap)
+                    : sched(cpuHz), sd(sdImage, sdOverlay), uart(*this) {
+                this->decoder = new AddressDecoder(memoryMap, romFile);
+                this->decoder->attach(Duart::BASE, Duart::SIZE, &this->uart);
+                this->decoder->setFaultHandler([this](std::uint32_t address, bool write) {
+                    this->fault(address, write);
+                });
+                this->busErrors = memoryMap.busErrors;
+                this->stopOnFault = false;
+                this->hasFaulted = false;
+                this->stopPc = 0;
+                this->faultCount = 0;
+                this->hostAccesses = 0;
+                this->out = &std::cout;
+                this->in = nullptr;
+                this->inputWanted = false;
+                this->hasExited = false;
+                this->hasHalted = false;
+                this->code = 0;
+                this->context.resize(m68k_context_size());
+                this->profiler = nullptr;
+                this->tracer = nullptr;
+                this->coverage = nullptr;
+                this->traceDumped = false;
+                this->jrnl = nullptr;
+                this->pollState = {};
+                this->lastPoll = 0;
+                this->idlePolls = 0;
+                this->idle = false;
+                this->breakpoint = 0;
+                this->watching = false;
+                this->atBreakpoint = false;
+                this->executing = false;
+
+                // Console output is buffered; make sure it still trickles out
+                this->sched.schedulePeriodic(cpuHz / CONSOLE_FLUSH_HZ, [this]() {
+                    this->out->flush();
+                });
+
+                // Build a fresh CPU context on the core, then keep it loaded
+                if (currentMachine) {
+                    m68k_get_context(currentMachine->context.data());
+                }
+                currentMachine = this;
+                sys_mem = this->decoder;
+                sys_trace = nullptr;
+
+                m68k_set_cpu_type(M68K_CPU_TYPE_68010);
+                m68k_init();
+                m68k_set_bus_error_rollback(this->busErrors);
+                m68k_pulse_reset();
+            }
+
+            Machine::~Machine() {
+                if (currentMachine == this) {
+                    currentMachine = nullptr;
+                    sys_mem = nullptr;
+                    sys_trace = nullptr;
+
+                    // Nothing else runs on this thread's core now
+                    m68k_set_context(NULL);
+                }
+
+                delete this->decoder;
+            }
+
+            Machine* Machine::current() {
+                return currentMachine;
+            }
+
+            void Machine::activate() {
+                if (currentMachine == this) {
+                    return;
+                }
+
+                if (currentMachine) {
+                    m68k_get_context(currentMachine->context.data());
+                }
+                m68k_set_context(this->context.data());
+
+                currentMachine = this;
+                sys_mem = this->decoder;
+                sys_trace = this->tracer;
+            }
+
+            // The core has one per-instruction hook, shared by the exact
+            // profiler, the tracer and runTo's breakpoint
+            void Machine::instructionHook(unsigned int pc, unsigned int ir, int cycles) {
+                Machine *machine = currentMachine;
+
+                if (machine->tracer) {
+                    machine->tracer->instruction(pc, ir, cycles);
+                }
+                if (machine->profiler && machine->profiler->mode() == Profiler::Mode::Exact) {
+                    machine->profiler->record(pc, ir, cycles);
+                }
+                if (machine->watching && m68k_get_reg(NULL, M68K_REG_PC) == machine->breakpoint) {
+                    machine->atBreakpoint = true;
+                    m68k_end_timeslice();
+                }
+            }
+
+            void Machine::updateHook() {
+                bool exact = this->profiler && this->profiler->mode() == Profiler::Mode::Exact;
+
+                m68k_set_instr_profile_callback(exact || this->tracer || this->watching ? instructionHook : NULL);
+            }
+
+            void Machine::setProfiler(Profiler *profiler, std::uint64_t samplePeriod) {
+                this->activate();
+                this->profiler = profiler;
+
+                if (profiler->mode() == Profiler::Mode::Exact) {
+                    this->updateHook();
+                } else {
+                    this->sched.schedulePeriodic(samplePeriod, [this, samplePeriod]() {
+                        this->profiler->sample(m68k_get_reg(NULL, M68K_REG_PPC), samplePeriod);
+                    });
+                }
+            }
+
+            void Machine::setCoverage(Coverage *coverage) {
+                this->activate();
+                this->coverage = coverage;
+                m68k_set_coverage_map(coverage ? coverage->map() : NULL);
+            }
+
+            void Machine::setTracer(Tracer *tracer) {
+                this->activate();
+                this->tracer = tracer;
+                sys_trace = tracer;
+                this->updateHook();
+            }
+
+            void Machine::dumpTrace(std::ostream &out, const std::string &why) {
+                out << why << " at PC 0x" << std::hex << m68k_get_reg(NULL, M68K_REG_PPC) << std::dec << std::endl;
+
+                if (this->tracer && !this->traceDumped) {
+                    // Possibly from a signal handler on another thread, so
+                    // point the disassembler at this machine's memory
+                    AddressDecoder *mem = sys_mem;
+                    HostAccess host(*this);
+
+                    sys_mem = this->decoder;
+                    this->tracer->dump(out, this->syms, m68k_get_reg(NULL, M68K_REG_CPU_TYPE));
+                    sys_mem = mem;
+                    this->traceDumped = true;
+                }
+            }
+
+            bool Machine::runTo(std::uint32_t address, std::uint64_t deadline) {
+                this->activate();
+                this->breakpoint = address;
+                this->watching = true;
+                this->updateHook();
+
+                run(deadline);
+
+                this->watching = false;
+                this->updateHook();
+                return this->atBreakpoint;
+            }
+
+            void Machine::saveSnapshot(char const* filename) {
+                this->activate();
+                m68k_get_context(this->context.data());
+
+                SnapshotHeader header = {};
+                std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+                header.contextSize = this->context.size();
+                header.cycles = this->sched.now();
+
+                std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+                out.write((char*)&header, sizeof(header));
+                out.write((char*)this->context.data(), this->context.size());
+                this->uart.save(out);
+                this->decoder->save(out);
+
+                if (!out) {
+                    throw std::runtime_error(std::string("Failed to write snapshot ") + filename);
+                }
+            }
+
+            void Machine::restoreSnapshot(char const* filename) {
+                int fd = open(filename, O_RDONLY);
+                if (fd < 0) {
+                    throw std::runtime_error(std::string("Failed to open snapshot ") + filename);
+                }
+
+                SnapshotHeader header;
+                std::vector<std::uint8_t> context(this->context.size());
+
+                try {
+                    if (pread(fd, &header, sizeof(header), 0) != sizeof(header)
+                            || std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+                        throw std::runtime_error(std::string(filename) + " is not an r68k snapshot");
+                    }
+                    if (header.contextSize != context.size()) {
+                        throw std::runtime_error(std::string(filename) + " was saved by a different build of r68k");
+                    }
+                    if (pread(fd, context.data(), context.size(), sizeof(header)) != (ssize_t)context.size()) {
+                        throw std::runtime_error("Snapshot is truncated");
+                    }
+
+                    this->uart.restore(fd, sizeof(header) + context.size());
+                    this->decoder->restore(fd, sizeof(header) + context.size() + Duart::stateSize());
+                } catch (...) {
+                    close(fd);
+                    throw;
+                }
+
+                // The mappings keep the file open
+                close(fd);
+
+                this->sched.setNow(header.cycles);
+                this->hasExited = false;
+                this->code = 0;
+
+                // The saved context carries the saving process's pointers to
+                // cycle tables and callbacks; rebuild them for this one
+                this->activate();
+                m68k_set_context(context.data());
+                m68k_set_cpu_type(m68k_get_reg(NULL, M68K_REG_CPU_TYPE));
+                m68k_init();
+                m68k_set_bus_error_rollback(this->busErrors);
+                this->updateHook();
+                m68k_set_coverage_map(this->coverage ? this->coverage->map() : NULL);
+                m68k_invalidate_code(0, AddressDecoder::BUS_SIZE);
+
+                // Counter events go on the restored timeline
+                this->uart.resume();
+            }
+
+            void Machine::checkpoint() {
+                this->activate();
+                this->savedContext.resize(this->context.size());
+                m68k_get_context(this->savedContext.data());
+                this->decoder->checkpoint();
+            }
+
+            void Machine::rollback() {
+                // Same memory, so the core keeps its translated code; the
+                // decoder invalidates the pages it copies back
+                this->activate();
+                m68k_restore_context(this->savedContext.data());
+                this->decoder->rollback();
+
+                this->hasExited = false;
+                this->hasHalted = false;
+                this->hasFaulted = false;
+                this->code = 0;
+            }
+
+            std::uint32_t Machine::load(const uint32_t baseAddr, char const* filename) {
+                std::uint32_t entry = baseAddr;
+
+                if (ElfImage::isElf(filename)) {
+                    ElfImage image;
+
+                    if (!image.load(filename)) {
+                        throw std::runtime_error(image.error());
+                    }
+
+                    image.place(*this->decoder);
+                    this->syms = image.symbols();
+                    entry = image.entry();
+                } else {
+                    this->decoder->LoadMemoryFile(baseAddr, filename);
+                }
+
+                if (currentMachine == this) {
+                    m68k_invalidate_code(0, AddressDecoder::BUS_SIZE);
+                }
+
+                return entry;
+            }
+
+            bool Machine::attachIde(char const* image, bool overlay) {
+                auto disk = std::make_unique<IdeDisk>(*this, image, overlay);
+
+                if (!disk->isOpen()) {
+                    return false;
+                }
+
+                this->hdd = std::move(disk);
+                this->decoder->attach(IdeDisk::BASE, IdeDisk::SIZE, this->hdd.get());
+                return true;
+            }
+
+            void Machine::reset() {
+                this->activate();
+                this->hasExited = false;
+                this->hasHalted = false;
+                this->code = 0;
+                this->uart.reset();
+                this->uart.updateIrq();
+                if (this->hdd) {
+                    this->hdd->reset();
+                }
+                m68k_pulse_reset();
+            }
+
+            bool Machine::run(std::uint64_t deadline) {
+                this->activate();
+                this->atBreakpoint = false;
+                this->hasFaulted = false;
+
+                while (!this->hasExited && !this->atBreakpoint && !this->hasFaulted && this->sched.now() < deadline) {
+                    std::uint64_t slice = std::min<std::uint64_t>(EXECUTE_SLICE, this->sched.cyclesUntilNextEvent());
+                    slice = std::min(slice, deadline - this->sched.now());
+
+                    this->executing = true;
+                    int ran = m68k_execute(slice);
+                    this->executing = false;
+
+                    this->sched.advance(ran);
+
+                    // Nothing but a reset gets the CPU going again
+                    if (!this->hasExited && m68k_is_halted()) {
+                        this->hasHalted = true;
+                        break;
+                    }
+
+                    if (this->idle && !this->hasExited) {
+                        skipIdle(deadline);
+                    }
+                }
+
+                this->out->flush();
+                return this->hasExited;
+            }
+
+            void Machine::pollIdle() {
+                std::array<std::uint32_t, 17> state;
+                std::uint64_t when = now();
+
+                for (int i = 0; i < 16; i++) {
+                    state[i] = m68k_get_reg(NULL, (m68k_register_t)(M68K_REG_D0 + i));
+                }
+                state[16] = m68k_get_reg(NULL, M68K_REG_PPC);
+
+                if (state == this->pollState && when - this->lastPoll <= IDLE_POLL_GAP) {
+                    if (++this->idlePolls >= IDLE_POLLS) {
+                        this->idle = true;
+                        m68k_end_timeslice();
+                    }
+                } else {
+                    this->pollState = state;
+                    this->idlePolls = 0;
+                }
+
+                this->lastPoll = when;
+            }
+
+            void Machine::skipIdle(std::uint64_t deadline) {
+                std::uint64_t gap = std::min(this->sched.cyclesUntilNextEvent(), deadline - this->sched.now());
+
+                this->idle = false;
+
+                if (this->idleWait) {
+                    this->out->flush();
+                    this->idleWait(std::chrono::nanoseconds(gap * 1000000000ULL / this->sched.cpuHz()));
+                }
+
+                this->sched.advance(gap);
+                this->lastPoll = this->sched.now();
+            }
+
+            void Machine::fault(std::uint32_t address, bool write) {
+                this->faultCount++;
+
+                if (this->tracer) {
+                    this->tracer->fault(address, write);
+                }
+
+                this->stop();
+
+                if (this->busErrors && this->executing && this->hostAccesses == 0) {
+                    // Unwinds to the core's exception handling, unless this
+                    // fault came while stacking another, which halts the CPU.
+                    // It's a longjmp, so nothing on the way here may have a
+                    // destructor waiting to run; host code that does holds a
+                    // HostAccess, which keeps this from being reached.
+                    m68k_pulse_bus_error_at(address, write);
+                    m68k_end_timeslice();
+                }
+
+                if (this->faultCount <= FAULT_REPORTS) {
+                    std::uint32_t pc = m68k_get_reg(NULL, M68K_REG_PPC);
+
+                    std::cerr << "Bus fault: " << (write ? "write to 0x" : "read from 0x") << std::hex << address
+                              << " at PC 0x" << pc << std::dec;
+                    if (this->syms.lookup(pc)) {
+                        std::cerr << " (" << this->syms.describe(pc) << ")";
+                    }
+                    std::cerr << (this->faultCount == FAULT_REPORTS ? "; no more will be reported" : "") << std::endl;
+                }
+            }
+
+            void Machine::illegal(std::uint32_t opcode) {
+                if (this->tracer) {
+                    std::ostringstream why;
+                    why << "WARN: Illegal instruction 0x" << std::hex << opcode << "; ignored";
+                    this->dumpTrace(std::cerr, why.str());
+                }
+                this->stop();
+            }
+
+            void Machine::stop() {
+                if (this->stopOnFault && this->executing && !this->hasFaulted) {
+                    // The CPU may get a little further before it stops
+                    this->hasFaulted = true;
+                    this->stopPc = m68k_get_reg(NULL, M68K_REG_PPC);
+                    m68k_end_timeslice();
+                }
+            }
+
+            void Machine::reschedule() {
+                if (this->executing) {
+                    m68k_end_timeslice();
+                }
+            }
+
+            std::uint64_t Machine::now() const {
+                return this->sched.now() + (this->executing ? m68k_cycles_run() : 0);
+            }
+
+            void Machine::exit(int code) {
+                if (this->jrnl && this->jrnl->recording()) {
+                    std::int32_t logged = code;
+
+                    this->jrnl->event(Journal::Exit, now());
+                    this->jrnl->put(&logged, sizeof(logged));
+                } else if (this->jrnl && this->jrnl->replaying()) {
+                    std::int32_t logged;
+
+                    if (this->jrnl->expect(Journal::Exit, now()) && this->jrnl->get(&logged, sizeof(logged)) && logged != code) {
+                        this->jrnl->fail("diverged: exit code " + std::to_string(code) + ", journal has " + std::to_string(logged));
+                    }
+                }
+
+                this->hasExited = true;
+                this->code = code;
+                m68k_pulse_halt();
+                m68k_end_timeslice();
+            }
+        }
+    }
+}
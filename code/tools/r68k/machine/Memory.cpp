@@ -4,6 +4,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
 #include "Memory.h"
 
 namespace rosco {
@@ -11,11 +13,21 @@ namespace rosco {
         namespace emu {
             Memory::Memory(const uint32_t size) {
                 this->size = size;
-                this->store = new uint8_t[size];
+
+                // Anonymous pages come zeroed, as the ROM expects, and cost
+                // nothing until touched. (Heap memory could hold an earlier
+                // machine's RAM when several run in one process.)
+                void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+                if (data == MAP_FAILED) {
+                    throw std::bad_alloc();
+                }
+
+                this->store = static_cast<uint8_t*>(data);
             }
 
             Memory::~Memory() {
-                delete(this->store);
+                munmap(this->store, this->size);
             }
 
             uint32_t Memory::read32(const uint32_t address) {
@@ -99,8 +111,8 @@ namespace rosco {
 
                 std::ifstream::pos_type pos = ifs.tellg();
 
-                if (pos > this->size) {
-                    throw std::exception();
+                if (std::streamoff(pos) > std::streamoff(this->size - baseAddr)) {
+                    throw std::runtime_error(std::string(filename) + " doesn't fit in memory");
                 } else {
                     ifs.seekg(0, std::ios::beg);
                     ifs.read((char*)&this->store[baseAddr], pos);
@@ -108,6 +120,21 @@ namespace rosco {
 
             }
 
+            void Memory::SaveData(std::ostream &out) {
+                out.write((char*)this->store, this->size);
+            }
+
+            void Memory::MapData(int fd, off_t offset) {
+                void *data = mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+
+                if (data == MAP_FAILED) {
+                    throw std::runtime_error("Failed to map memory from snapshot");
+                }
+
+                munmap(this->store, this->size);
+                this->store = static_cast<uint8_t*>(data);
+            }
+
         }
     }
 }
@@ -0,0 +1,145 @@
+//
+// Layout of the emulated machine's address space.
+//
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "AddressDecoder.h"
+#include "MemoryMap.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            // A number in any C base, optionally scaled by a K or M suffix
+            static bool parseSize(const std::string &text, std::uint64_t &value) {
+                char *end;
+
+                value = std::strtoull(text.c_str(), &end, 0);
+
+                if (end == text.c_str()) {
+                    return false;
+                }
+                if (*end == 'K' || *end == 'k') {
+                    value <<= 10;
+                    end++;
+                } else if (*end == 'M' || *end == 'm') {
+                    value <<= 20;
+                    end++;
+                }
+
+                return *end == 0;
+            }
+
+            MemoryMap MemoryMap::standard() {
+                MemoryMap map;
+
+                map.add({ MemoryRegion::Ram, 0x00000000, 0x00100000 });
+                map.add({ MemoryRegion::Rom, 0x00e00000, 0x00100000 });
+                map.add({ MemoryRegion::Io, 0x00f00000, 0x00100000 });
+                return map;
+            }
+
+            bool MemoryMap::add(const MemoryRegion &region) {
+                std::ostringstream where;
+                where << std::hex << "0x" << region.base << "-0x" << (std::uint64_t)region.base + region.size - 1;
+
+                if (region.size == 0 || ((region.base | region.size) & AddressDecoder::PAGE_MASK)) {
+                    this->message = "region " + where.str() + " is not in whole 4K pages";
+                    return false;
+                }
+                if ((std::uint64_t)region.base + region.size > AddressDecoder::BUS_SIZE) {
+                    this->message = "region " + where.str() + " is off the end of the bus";
+                    return false;
+                }
+
+                if (this->list.size() >= AddressDecoder::MAX_REGIONS) {
+                    this->message = "too many regions, " + std::to_string(AddressDecoder::MAX_REGIONS) + " at most";
+                    return false;
+                }
+
+                for (auto &other : this->list) {
+                    if (region.base < other.base + other.size && other.base < region.base + region.size) {
+                        this->message = "region " + where.str() + " overlaps another";
+                        return false;
+                    }
+                }
+
+                this->list.push_back(region);
+                return true;
+            }
+
+            bool MemoryMap::addRam(const std::string &spec) {
+                std::size_t colon = spec.find(':');
+                std::uint64_t base, size;
+
+                if (colon == std::string::npos || !parseSize(spec.substr(0, colon), base) || !parseSize(spec.substr(colon + 1), size)
+                        || base >= AddressDecoder::BUS_SIZE || size > AddressDecoder::BUS_SIZE) {
+                    this->message = "expected <base>:<size>, not '" + spec + "'";
+                    return false;
+                }
+
+                return add({ MemoryRegion::Ram, (std::uint32_t)base, (std::uint32_t)size });
+            }
+
+            bool MemoryMap::load(char const* filename) {
+                std::ifstream in(filename);
+                std::string line;
+                unsigned number = 0;
+
+                if (!in) {
+                    this->message = std::string("cannot open memory map ") + filename;
+                    return false;
+                }
+
+                this->list.clear();
+                this->busErrors = false;
+
+                while (std::getline(in, line)) {
+                    number++;
+
+                    if (!parseLine(line.substr(0, line.find('#')))) {
+                        this->message = std::string(filename) + ":" + std::to_string(number) + ": " + this->message;
+                        return false;
+                    }
+                }
+
+                return true;
+            }
+
+            bool MemoryMap::parseLine(const std::string &line) {
+                std::istringstream fields(line);
+                std::string type, baseText, sizeText, extra;
+                std::uint64_t base, size;
+
+                if (!(fields >> type)) {
+                    return true;
+                }
+                if (type == "bus-errors" && !(fields >> extra)) {
+                    this->busErrors = true;
+                    return true;
+                }
+
+                if (!(fields >> baseText >> sizeText) || (fields >> extra)
+                        || !parseSize(baseText, base) || !parseSize(sizeText, size)
+                        || base >= AddressDecoder::BUS_SIZE || size > AddressDecoder::BUS_SIZE) {
+                    this->message = "expected <ram|rom|io> <base> <size>";
+                    return false;
+                }
+
+                MemoryRegion region = { MemoryRegion::Ram, (std::uint32_t)base, (std::uint32_t)size };
+
+                if (type == "rom") {
+                    region.type = MemoryRegion::Rom;
+                } else if (type == "io") {
+                    region.type = MemoryRegion::Io;
+                } else if (type != "ram") {
+                    this->message = "unknown region type '" + type + "'";
+                    return false;
+                }
+
+                return add(region);
+            }
+        }
+    }
+}
@@ -0,0 +1,186 @@
+//
+// Guest code profiler.
+//
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include "Profiler.h"
+#include "../musashi/m68k.h"
+
+#define HOT_ADDRESSES   50
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            Profiler::Profiler(Mode mode) : pages(1 << (24 - PAGE_BITS)) {
+                this->profMode = mode;
+                this->nodes.push_back(Node { 0, 0, 0 });
+                this->leaf = 0;
+            }
+
+            Profiler::Page& Profiler::page(std::uint32_t pc) {
+                std::unique_ptr<Page> &p = this->pages[(pc & 0x00ffffff) >> PAGE_BITS];
+
+                if (!p) {
+                    p.reset(new Page());
+                }
+
+                return *p;
+            }
+
+            void Profiler::record(std::uint32_t pc, std::uint16_t ir, int cycles) {
+                Page &p = page(pc);
+                std::uint32_t slot = (pc & ((1 << PAGE_BITS) - 1)) >> 1;
+
+                p.count[slot]++;
+                p.cycles[slot] += cycles;
+                this->nodes[this->leaf].cycles += cycles;
+
+                if ((ir & 0xffc0) == 0x4e80 || (ir & 0xff00) == 0x6100) {
+                    // JSR / BSR: now at the callee, return address on the stack
+                    call(m68k_get_reg(NULL, M68K_REG_PC), m68k_get_reg(NULL, M68K_REG_A7));
+                } else if (ir == 0x4e75 || ir == 0x4e73 || ir == 0x4e77 || ir == 0x4e74) {
+                    // RTS / RTE / RTR / RTD
+                    unwind(m68k_get_reg(NULL, M68K_REG_A7));
+                }
+            }
+
+            void Profiler::sample(std::uint32_t pc, std::uint64_t cycles) {
+                Page &p = page(pc);
+                std::uint32_t slot = (pc & ((1 << PAGE_BITS) - 1)) >> 1;
+
+                p.count[slot]++;
+                p.cycles[slot] += cycles;
+            }
+
+            void Profiler::call(std::uint32_t function, std::uint32_t sp) {
+                std::uint64_t key = ((std::uint64_t)this->leaf << 32) | function;
+                auto it = this->children.find(key);
+                std::uint32_t node;
+
+                if (it != this->children.end()) {
+                    node = it->second;
+                } else {
+                    node = this->nodes.size();
+                    this->nodes.push_back(Node { this->leaf, function, 0 });
+                    this->children.emplace(key, node);
+                }
+
+                this->stack.push_back(Frame { node, sp });
+                this->leaf = node;
+            }
+
+            void Profiler::unwind(std::uint32_t sp) {
+                // Drop every frame whose return address is now above the
+                // stack pointer. Copes with longjmp, and with exceptions,
+                // which return without having been seen as calls.
+                while (!this->stack.empty() && this->stack.back().sp < sp) {
+                    this->stack.pop_back();
+                }
+
+                this->leaf = this->stack.empty() ? 0 : this->stack.back().node;
+            }
+
+            void Profiler::writeFlat(std::ostream &out, const ElfSymbols &symbols) const {
+                struct Entry {
+                    std::uint32_t address;
+                    std::uint64_t count;
+                    std::uint64_t cycles;
+                };
+
+                std::vector<Entry> addresses;
+                std::map<std::string, Entry> functions;
+                std::uint64_t totalCount = 0, totalCycles = 0;
+
+                for (std::size_t i = 0; i < this->pages.size(); i++) {
+                    if (!this->pages[i]) {
+                        continue;
+                    }
+
+                    for (std::uint32_t slot = 0; slot < PAGE_SLOTS; slot++) {
+                        if (this->pages[i]->count[slot] == 0) {
+                            continue;
+                        }
+
+                        Entry e { (std::uint32_t)(i << PAGE_BITS) | (slot << 1), this->pages[i]->count[slot], this->pages[i]->cycles[slot] };
+                        Entry &f = functions.emplace(symbols.function(e.address), Entry { e.address, 0, 0 }).first->second;
+
+                        f.count += e.count;
+                        f.cycles += e.cycles;
+                        totalCount += e.count;
+                        totalCycles += e.cycles;
+                        addresses.push_back(e);
+                    }
+                }
+
+                std::vector<std::pair<std::string, Entry>> byFunction(functions.begin(), functions.end());
+                std::sort(byFunction.begin(), byFunction.end(), [](const auto &a, const auto &b) {
+                    return a.second.cycles > b.second.cycles;
+                });
+                std::sort(addresses.begin(), addresses.end(), [](const Entry &a, const Entry &b) {
+                    return a.cycles > b.cycles;
+                });
+
+                auto percent = [&](std::uint64_t cycles) {
+                    return totalCycles ? 100.0 * cycles / totalCycles : 0.0;
+                };
+
+                const char *counted = this->profMode == Mode::Exact ? "instructions" : "samples";
+
+                out << "Flat profile (" << (this->profMode == Mode::Exact ? "exact" : "sampled") << "): "
+                    << totalCount << " " << counted << ", " << totalCycles << " cycles" << std::endl << std::endl;
+
+                out << "  %cycles          cycles  " << std::setw(12) << counted << "  function" << std::endl;
+                for (auto &f : byFunction) {
+                    out << std::fixed << std::setprecision(2) << std::setw(8) << percent(f.second.cycles) << "%"
+                        << std::setw(16) << f.second.cycles << std::setw(14) << f.second.count << "  " << f.first << std::endl;
+                }
+
+                out << std::endl << "Hottest addresses:" << std::endl << std::endl;
+                out << "  %cycles          cycles  " << std::setw(12) << counted << "  address" << std::endl;
+                for (std::size_t i = 0; i < addresses.size() && i < HOT_ADDRESSES; i++) {
+                    out << std::fixed << std::setprecision(2) << std::setw(8) << percent(addresses[i].cycles) << "%"
+                        << std::setw(16) << addresses[i].cycles << std::setw(14) << addresses[i].count << "  "
+                        << std::hex << std::setfill('0') << "0x" << std::setw(8) << addresses[i].address
+                        << std::dec << std::setfill(' ') << "  " << symbols.describe(addresses[i].address) << std::endl;
+                }
+            }
+
+            void Profiler::writeFolded(std::ostream &out, const ElfSymbols &symbols) const {
+                std::map<std::string, std::uint64_t> stacks;
+
+                if (this->profMode == Mode::Exact) {
+                    for (std::size_t i = 0; i < this->nodes.size(); i++) {
+                        if (this->nodes[i].cycles == 0) {
+                            continue;
+                        }
+
+                        std::string path;
+                        for (std::uint32_t n = i; n != 0; n = this->nodes[n].parent) {
+                            path = symbols.function(this->nodes[n].function) + (path.empty() ? "" : ";") + path;
+                        }
+
+                        stacks[path.empty() ? "[root]" : path] += this->nodes[i].cycles;
+                    }
+                } else {
+                    for (std::size_t i = 0; i < this->pages.size(); i++) {
+                        if (!this->pages[i]) {
+                            continue;
+                        }
+
+                        for (std::uint32_t slot = 0; slot < PAGE_SLOTS; slot++) {
+                            if (this->pages[i]->cycles[slot]) {
+                                stacks[symbols.function((i << PAGE_BITS) | (slot << 1))] += this->pages[i]->cycles[slot];
+                            }
+                        }
+                    }
+                }
+
+                for (auto &s : stacks) {
+                    out << s.first << " " << s.second << std::endl;
+                }
+            }
+        }
+    }
+}
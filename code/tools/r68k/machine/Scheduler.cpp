@@ -0,0 +1,101 @@
+//
+// Cycle-based event scheduler for the emulated machine.
+//
+
+#include <thread>
+#include "Scheduler.h"
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            Scheduler::Scheduler(std::uint32_t cpuHz) {
+                this->cycles = 0;
+                this->sequence = 0;
+                this->hz = cpuHz;
+                this->realTime = false;
+                this->epochCycles = 0;
+            }
+
+            void Scheduler::push(std::uint64_t when, std::uint64_t period, Callback callback) {
+                this->events.push(Event { when, this->sequence++, period, std::move(callback) });
+            }
+
+            void Scheduler::scheduleAt(std::uint64_t when, Callback callback) {
+                push(when, 0, std::move(callback));
+            }
+
+            void Scheduler::scheduleIn(std::uint64_t delta, Callback callback) {
+                push(this->cycles + delta, 0, std::move(callback));
+            }
+
+            void Scheduler::schedulePeriodic(std::uint64_t period, Callback callback) {
+                push(this->cycles + period, period, std::move(callback));
+            }
+
+            std::uint64_t Scheduler::cyclesUntilNextEvent() const {
+                if (this->events.empty()) {
+                    return UINT64_MAX;
+                }
+
+                std::uint64_t when = this->events.top().when;
+                return when > this->cycles ? when - this->cycles : 0;
+            }
+
+            void Scheduler::advance(std::uint64_t ran) {
+                this->cycles += ran;
+
+                while (!this->events.empty() && this->events.top().when <= this->cycles) {
+                    Event event = this->events.top();
+                    this->events.pop();
+
+                    if (event.period) {
+                        push(event.when + event.period, event.period, event.callback);
+                    }
+
+                    event.callback();
+                }
+
+                if (this->realTime) {
+                    throttle();
+                }
+            }
+
+            void Scheduler::setNow(std::uint64_t cycles) {
+                decltype(this->events) moved;
+
+                while (!this->events.empty()) {
+                    Event event = this->events.top();
+                    this->events.pop();
+
+                    event.when = event.when - this->cycles + cycles;
+                    moved.push(std::move(event));
+                }
+
+                this->events = std::move(moved);
+                this->cycles = cycles;
+                this->epoch = std::chrono::steady_clock::now();
+                this->epochCycles = cycles;
+            }
+
+            void Scheduler::setRealTime(bool realTime) {
+                this->realTime = realTime;
+                this->epoch = std::chrono::steady_clock::now();
+                this->epochCycles = this->cycles;
+            }
+
+            void Scheduler::throttle() {
+                using namespace std::chrono;
+
+                std::uint64_t elapsed = this->cycles - this->epochCycles;
+                auto due = this->epoch + seconds(elapsed / this->hz)
+                                       + nanoseconds((elapsed % this->hz) * 1000000000ULL / this->hz);
+                auto ahead = due - steady_clock::now();
+
+                // Don't bother the OS for less than a millisecond
+                if (ahead > milliseconds(1)) {
+                    std::this_thread::sleep_for(ahead);
+                }
+            }
+        }
+    }
+}
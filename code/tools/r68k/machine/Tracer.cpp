@@ -0,0 +1,88 @@
+//
+// Ring buffer of the guest's most recent instructions and writes.
+//
+
+#include <iomanip>
+#include "Tracer.h"
+#include "../musashi/m68k.h"
+
+#define MAX_TRACE_SIZE  (1u << 28)
+
+namespace rosco {
+    namespace m68k {
+        namespace emu {
+            static void hex(std::ostream &out, std::uint32_t value, int digits) {
+                out << std::hex << std::setfill('0') << std::setw(digits) << value << std::setfill(' ') << std::dec;
+            }
+
+            Tracer::Tracer(std::uint32_t size) {
+                std::uint64_t slots = 1;
+
+                while (slots < size && slots < MAX_TRACE_SIZE) {
+                    slots <<= 1;
+                }
+
+                this->ring.resize(slots);
+                this->mask = slots - 1;
+                this->count = 0;
+            }
+
+            void Tracer::dump(std::ostream &out, const ElfSymbols &symbols, unsigned cpuType) const {
+                std::uint64_t first = this->count > this->ring.size() ? this->count - this->ring.size() : 0;
+                std::vector<const Entry*> effects;
+
+                out << "Trace: last " << (this->count - first) << " of " << this->count << " entries, oldest first" << std::endl;
+
+                for (std::uint64_t i = first; i < this->count; i++) {
+                    const Entry &entry = this->ring[i & this->mask];
+
+                    if (entry.kind != Instruction) {
+                        effects.push_back(&entry);
+                        continue;
+                    }
+
+                    dumpInstruction(out, entry, symbols, cpuType);
+
+                    for (const Entry *effect : effects) {
+                        out << "              ";
+                        if (effect->kind == Write) {
+                            out << "write." << (effect->size == 1 ? 'b' : effect->size == 2 ? 'w' : 'l') << " ";
+                            hex(out, effect->address, 6);
+                            out << " = ";
+                            hex(out, effect->value, effect->size * 2);
+                        } else {
+                            out << "fault " << (effect->opcode ? "write to " : "read from ");
+                            hex(out, effect->address, 6);
+                        }
+                        out << std::endl;
+                    }
+                    effects.clear();
+                }
+
+                // Left by the instruction that was running when the trace
+                // was dumped, which never reached the hook
+                for (const Entry *effect : effects) {
+                    out << "  (unfinished instruction) " << (effect->kind == Write ? "write to " : "fault at ");
+                    hex(out, effect->address, 6);
+                    out << std::endl;
+                }
+            }
+
+            void Tracer::dumpInstruction(std::ostream &out, const Entry &entry, const ElfSymbols &symbols, unsigned cpuType) const {
+                char text[100];
+
+                m68k_disassemble(text, entry.address, cpuType);
+
+                out << "  ";
+                hex(out, entry.address, 6);
+                out << "  ";
+                hex(out, entry.opcode, 4);
+                out << "  " << std::left << std::setw(36) << text << std::right << std::setw(3) << entry.value;
+                if (symbols.lookup(entry.address)) {
+                    out << "  " << symbols.describe(entry.address);
+                }
+                out << std::endl;
+            }
+        }
+    }
+}
@@ -2,22 +2,44 @@
 #include <filesystem>
 #include <stdint.h>
 #include <unistd.h>
-#include <thread>
-#include <atomic>
+#include <getopt.h>
 #include <termios.h>
-#include <sys/select.h>
 #include <fcntl.h>
 #include <iomanip>
+#include <cstring>
+#include <fstream>
+#include <sstream>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 
 #include "musashi/m68k.h"
 #include "musashi/m68kcpu.h"
-#include "AddressDecoder.h"
+#include "Machine.h"
+#include "ConsoleBuffer.h"
+#include "Disassembler.h"
+#include "ElfImage.h"
+#include "ElfLines.h"
+#include "ElfSymbols.h"
+#include "Fuzzer.h"
 
 using namespace std;
-
-#define DUART_IRQ	4
-#define DUART_VEC	0x45
+using rosco::m68k::emu::Machine;
+using rosco::m68k::emu::Profiler;
+using rosco::m68k::emu::Journal;
+using rosco::m68k::emu::ConsoleInput;
+using rosco::m68k::emu::ElfSymbols;
+using rosco::m68k::emu::ElfLines;
+using rosco::m68k::emu::ElfImage;
+using rosco::m68k::emu::Coverage;
+using rosco::m68k::emu::Disassembler;
+using rosco::m68k::emu::MemoryMap;
+using rosco::m68k::emu::MemoryRegion;
+using rosco::m68k::emu::Tracer;
+using rosco::m68k::emu::Fuzzer;
 
 #define TICK_COUNT 0x408
 #define ECHO_ON    0x410
@@ -41,31 +63,181 @@ void init_term() {
     fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
 }
 
-bool check_char() {
-    fd_set readfds;
-    FD_ZERO(&readfds);
-    FD_SET(STDIN_FILENO, &readfds);
+// Inputs go through the machine's journal, if it has one. Recording logs
+// each live result; replaying hands back the logged result instead of
+// touching the terminal or SD card, and ends the run once the guest has
+// diverged from the journal.
+static bool replaying(Machine *machine) {
+    return machine->journal() && machine->journal()->replaying();
+}
+
+static void replay_failed(Machine *machine) {
+    if (!machine->exited()) {
+        machine->exit(-1);
+    }
+}
+
+static bool replay_input(Machine *machine, Journal::Event type, void *data, size_t size) {
+    Journal *journal = machine->journal();
+
+    if (journal->expect(type, machine->now()) && journal->get(data, size)) {
+        return true;
+    }
+
+    replay_failed(machine);
+    return false;
+}
+
+static void record_input(Machine *machine, Journal::Event type, const void *data, size_t size) {
+    Journal *journal = machine->journal();
+
+    if (journal && journal->recording()) {
+        journal->event(type, machine->now());
+        journal->put(data, size);
+    }
+}
 
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 0;
+// Whether a key is waiting, for the check_char traps and the DUART
+static bool key_ready(Machine *machine) {
+    bool ready = false;
 
-    return select(STDIN_FILENO + 1, &readfds, NULL, NULL, &timeout) > 0;
+    if (replaying(machine)) {
+        // Only polls that found a key are logged
+        ready = machine->journal()->poll(Journal::CheckChar, machine->now());
+        if (!machine->journal()->error().empty()) {
+            replay_failed(machine);
+        }
+    } else if (machine->interactive()) {
+        // Whatever the guest is waiting on a reply to should be on screen
+        machine->console().flush();
+
+        ready = machine->input()->ready();
+        if (ready) {
+            record_input(machine, Journal::CheckChar, nullptr, 0);
+        }
+    }
+
+    return ready;
+}
+
+bool check_char() {
+    Machine *machine = Machine::current();
+    bool ready = key_ready(machine);
+
+    if (!ready) {
+        machine->pollIdle();
+    }
+    return ready;
 }
 
 char read_char() {
-    char c = 0;
-    while (c == 0) {
-        read(STDIN_FILENO, &c, 1);
+    Machine *machine = Machine::current();
+
+    if (replaying(machine)) {
+        char c;
+        return replay_input(machine, Journal::ReadChar, &c, 1) ? c : 0x0D;
+    }
+
+    if (!machine->interactive()) {
+        // Nobody to type anything in batch mode; fail the run rather than
+        // block the worker forever. CR ends any line-reading trap early.
+        machine->requestInput();
+        machine->exit(-1);
+        return 0x0D;
+    }
+
+    machine->console().flush();
+
+    int c;
+    do {
+        c = machine->input()->read();
+    } while (c == 0);
+
+    if (c < 0) {
+        // The script or pipe feeding the guest has run dry, and nothing
+        // else will ever answer; end the run as batch mode does
+        machine->requestInput();
+        machine->exit(-1);
+        return 0x0D;
+    }
+
+    char key = c;
+    record_input(machine, Journal::ReadChar, &key, 1);
+    return key;
+}
+
+static bool sd_ready(Machine *machine) {
+    uint8_t ready = 0;
+
+    if (replaying(machine)) {
+        replay_input(machine, Journal::SdInit, &ready, 1);
+        return ready;
+    }
+
+    ready = machine->sdCard().isOpen();
+    record_input(machine, Journal::SdInit, &ready, 1);
+    return ready;
+}
+
+#define SD_NOT_READY    0
+#define SD_FAILED       1
+#define SD_OK           2
+
+// Move one block between the SD card and guest memory. In a journal, reads
+// carry their data so a replay needn't have the same image, or any image.
+static uint8_t sd_transfer(Machine *machine, bool write, uint32_t block, uint32_t address) {
+    using rosco::m68k::emu::BlockDevice;
+
+    BlockDevice &sd = machine->sdCard();
+    Journal::Event type = write ? Journal::SdWrite : Journal::SdRead;
+    uint8_t status, data[BlockDevice::BLOCK_SIZE];
+
+    if (replaying(machine)) {
+        if (!replay_input(machine, type, &status, 1)) {
+            return SD_FAILED;
+        }
+
+        if (!write && status == SD_OK) {
+            if (!machine->journal()->get(data, sizeof(data))) {
+                replay_failed(machine);
+                return SD_FAILED;
+            }
+            machine->memory().writeBlock(address, data, sizeof(data));
+        }
+
+        return status;
+    }
+
+    if (!sd.isOpen()) {
+        status = SD_NOT_READY;
+    } else if (write) {
+        status = sd.write(block, 1, machine->memory(), address) ? SD_OK : SD_FAILED;
+    } else {
+        status = sd.read(block, 1, machine->memory(), address) ? SD_OK : SD_FAILED;
     }
-    return c;
+
+    record_input(machine, type, &status, 1);
+
+    if (!write && status == SD_OK && machine->journal() && machine->journal()->recording()) {
+        machine->memory().readBlock(address, data, sizeof(data));
+        machine->journal()->put(data, sizeof(data));
+    }
+
+    return status;
+}
+
+// Trap handlers write guest memory behind the CPU's back, so any code the
+// block cache translated from there has to go
+static void write_guest_8(uint32_t address, uint8_t value) {
+    m68k_write_memory_8(address, value);
+    m68k_invalidate_code(address, 1);
 }
 
 // easy68k helper functions
 
 #define BUF_LEN 78
 #define BUF_MAX BUF_LEN - 2
-static uint8_t buf[BUF_LEN];
+static thread_local uint8_t buf[BUF_LEN];
 
 static uint8_t digit(unsigned char digit) {
     if (digit < 10) {
@@ -95,11 +267,46 @@ static char* print_unsigned(uint32_t num, uint8_t base) {
     return ((char*)&buf[bp+1]);
 }
 
-extern "C" {
-    rosco::m68k::emu::AddressDecoder* sys_mem;
-    std::fstream ifs("rosco_sd.bin", std::ios::binary | std::ios::ate | std::ios::in | std::ios::out);
+// Write the NUL-terminated guest string at address, up to max bytes, to out.
+// Directly-mapped memory is written a span at a time.
+static void print_guest_string(std::ostream &out, uint32_t address, uint32_t max = UINT32_MAX) {
+    rosco::m68k::emu::AddressDecoder &mem = Machine::current()->memory();
+
+    while (max > 0) {
+        uint32_t length;
+        const uint8_t *span = mem.readSpan(address, length);
+
+        if (span == nullptr) {
+            char c = mem.read8(address++);
+            if (c == 0) {
+                return;
+            }
+            out << c;
+            max--;
+            continue;
+        }
+
+        length = std::min(length, max);
 
-    int illegal_instruction_handler(int __attribute__((unused)) opcode) {
+        const uint8_t *nul = (const uint8_t *)memchr(span, 0, length);
+        uint32_t n = nul ? nul - span : length;
+
+        out.write((const char *)span, n);
+
+        if (nul) {
+            return;
+        }
+
+        address += n;
+        max -= n;
+    }
+}
+
+extern "C" {
+    int illegal_instruction_handler(int opcode) {
+        Machine *machine = Machine::current();
+        Machine::HostAccess host(*machine);
+        std::ostream &out = machine->console();
         m68ki_cpu_core ctx;
         m68k_get_context(&ctx);
 
@@ -123,51 +330,36 @@ extern "C" {
             } 
 
             uint8_t c;
+            uint8_t status;
             bool r;
             int ptr;
             int chars_left = 0;
             int chars_read = 0;
             int num = 0;
 
-            cout << flush;
-            
             switch (op) {				
                 case 0:
                     // Print
-                    do {
-                         c = m68k_read_memory_8(a0++);
-                         if (c) {
-                            cout << c;
-                         }
-                    } while (c != 0);
-                    cout << flush;
+                    print_guest_string(out, a0);
 
                     break;
                 case 1:
                     // println
-                    do {
-                         c = m68k_read_memory_8(a0++);
-                         if (c) {
-                            cout << c;
-                         }
-                    } while (c != 0);
-
-                    cout << endl;
+                    print_guest_string(out, a0);
+                    out << '\n';
 
                     break;
                 case 2:
                     // printchar
                     c = (d0 & 0xFF);
                     if (c) {
-                        cout << c << flush;
+                        out << c;
                     }
 
                     break;
                 case 3:
                     // prog_exit
-                    m68k_pulse_halt();
-                    tcsetattr(STDIN_FILENO, TCSANOW, &originalTermios);
-                    exit(m68k_read_memory_32(a7 + 4));       // assuming called from cstdlib - C will have stacked an exit code
+                    machine->exit(m68k_read_memory_32(a7 + 4));  // assuming called from cstdlib - C will have stacked an exit code
                     break;
                 case 4:
                     // check_char
@@ -178,13 +370,12 @@ extern "C" {
                 case 5:
                     // read_char
                     c = read_char();
-                    cout << flush;
                     m68k_set_reg(M68K_REG_D0, c);
 
                     break;
                 case 6:
                     // sd_init
-                    if (!ifs) {
+                    if (!sd_ready(machine)) {
                         m68k_set_reg(M68K_REG_D0, 1);
                     } else {
                         m68k_write_memory_8(a1+0, 1);		// Initialized
@@ -193,36 +384,32 @@ extern "C" {
                         m68k_write_memory_32(a1+3, 0);		// Ignored (current block num)
                         m68k_write_memory_16(a1+7, 0);		// Ignored (current block offset)
                         m68k_write_memory_8(a1+9, 0);		// No partial reads (_could_ support, just don't yet)
+                        m68k_invalidate_code(a1, 10);
                         m68k_set_reg(M68K_REG_D0, 0);		// Success
                     }
                     break;
                 case 7:
                     // sd_read
-                    if (ifs && m68k_read_memory_8(a1) > 0) {
-                        std::vector<char> buf(512);
+                    status = m68k_read_memory_8(a1) > 0 ? sd_transfer(machine, false, d1, a2) : SD_NOT_READY;
 
-                        ifs.clear();
-                        ifs.seekg(d1 * 512, std::ios::beg);
-                        ifs.read(&buf.front(), 512);
+                    if (status != SD_NOT_READY) {
 #ifdef DEBUG_LOG_IO
                         cerr << "READ " << hex << d1*512 << endl;
 #endif
 
-                        if (ifs.gcount() == 512) {
-                            for (auto data : buf) {
-                                m68k_write_memory_8(a2++, data);
-                            }
+                        if (status == SD_OK) {
+                            m68k_invalidate_code(a2, rosco::m68k::emu::BlockDevice::BLOCK_SIZE);
 
                             m68k_set_reg(M68K_REG_D0, 1);		    // succeed
                         } else {
-                            cout << "!!! Bad Read" << endl;
+                            out << "!!! Bad Read\n";
 #ifdef DEBUG_LOG_IO
                             cerr << "!!! Bad Read" << endl;
 #endif
                             m68k_set_reg(M68K_REG_D0, 0);		// fail
                         }
                     } else {						
-                        cout << "!!! Not init" << endl;
+                        out << "!!! Not init\n";
 #ifdef DEBUG_LOG_IO
                         cerr << "!!! Not init" << endl;
 #endif
@@ -232,32 +419,24 @@ extern "C" {
                     break;
                 case 8:
                     // sd_write
-                    if (a2 < 0xe00000 && ifs && m68k_read_memory_8(a1) > 0) {
-                        std::vector<char> buf(512);
-
-                        for (int i = 0; i < 512; i++) {
-                            buf[i] = m68k_read_memory_8(a2++);
-                        }
-
-                        ifs.clear();
-                        ifs.seekg(d1 * 512, std::ios::beg);
-                        ifs.write(&buf.front(), 512);
+                    status = a2 < 0xe00000 && m68k_read_memory_8(a1) > 0 ? sd_transfer(machine, true, d1, a2) : SD_NOT_READY;
 
+                    if (status != SD_NOT_READY) {
 #ifdef DEBUG_LOG_IO
                         cerr << "WRITE " << hex << d1*512 << endl;
 #endif
 
-                        if (ifs.gcount() == 512) {
+                        if (status == SD_OK) {
                             m68k_set_reg(M68K_REG_D0, 1);		    // succeed
                         } else {
-                            cout << "!!! Bad Write" << endl;
+                            out << "!!! Bad Write\n";
 #ifdef DEBUG_LOG_IO
                             cerr << "!!! Bad Write" << endl;
 #endif
                             m68k_set_reg(M68K_REG_D0, 0);		// fail
                         }
                     } else {						
-                        cout << "!!! Not init or out of bounds" << endl;
+                        out << "!!! Not init or out of bounds\n";
 #ifdef DEBUG_LOG_IO
                         cerr << "!!! Not init or out of bounds" << endl;
 #endif
@@ -268,25 +447,18 @@ extern "C" {
                 // Start of Easy68k traps
                 case 0xD0:
                 case 0xD1:
-                    // PRINT_LN_LEN / PRINT_LEN
-                    do {
-                         c = m68k_read_memory_8(a1++);
-                         if (c) {
-                            cout << c;
-                         }
-                    } while ((c != 0) && ((--d1 & 0xFF) > 0));
+                    // PRINT_LN_LEN / PRINT_LEN (a length of 0 means 256)
+                    print_guest_string(out, a1, ((d1 - 1) & 0xFF) + 1);
 
                     if (op == 0xD0) {
-                        cout << endl;
-                    } else {
-                        cout << flush;
+                        out << '\n';
                     }
 
                     break;
                 case 0xD2:
                     // READSTR
                     if (m68k_read_memory_8(PROMPT_ON) == 1) {
-                        cout << "Input$> " << flush;
+                        out << "Input$> ";
                     } 
 
                     chars_read = 0;
@@ -294,25 +466,23 @@ extern "C" {
                     
                     while (chars_read++ < 80) {
                         c = read_char();
-                        cout << flush;
 
                         if (c == 0x0D) {
                             break;
                         }
 
                         if (m68k_read_memory_8(ECHO_ON) == 1) {
-                            cout << c << flush;
+                            out << c;
                         }
 
                         m68k_write_memory_8(a1++, c);
                     }
 
                     m68k_write_memory_8(a1++, 0);
+                    m68k_invalidate_code(ptr, a1 - ptr);
 
                     if (m68k_read_memory_8(LF_DISPLAY) == 1) {
-                        cout << endl;
-                    } else {
-                        cout << flush;
+                        out << '\n';
                     }
 
                     m68k_set_reg(M68K_REG_D1, (chars_read - 1)); 
@@ -321,18 +491,17 @@ extern "C" {
                     break;
                 case 0xD3:
                     // DISPLAYNUM_SIGNED
-                    cout << (int)d1 << flush;
+                    out << (int)d1;
 
                     break;
                 case 0xD4:
                     // READNUM
                     if (m68k_read_memory_8(PROMPT_ON) == 1) {
-                        cout << "Input#> " << flush;
+                        out << "Input#> ";
                     }
                     
                     while (--chars_left) {
                         c = read_char();
-                        cout << flush;
 
                         if (c == 0x0D) {
                             break;
@@ -341,27 +510,25 @@ extern "C" {
                         if ((c >= '0') && (c <= '9')) {
                             num = (num * 10) + (c - '0');
                             if (m68k_read_memory_8(ECHO_ON) == 1) {
-                                cout << c;
+                                out << c;
                             }
                         } 
                     }
                     if (m68k_read_memory_8(LF_DISPLAY) == 1) {
-                        cout << endl;
+                        out << '\n';
                     }
                     m68k_set_reg(M68K_REG_D1, num);
 
                     break;
                 case 0xD5:
                     // READCHAR
-                    cout << flush;
                     c = read_char();
-                    cout << flush;
                     m68k_set_reg(M68K_REG_D1, c);
 
                     break;
                 case 0xD6:
                     // SENDCHAR
-                    cout << (char) (d1 & 0xFF) << flush;
+                    out << (char) (d1 & 0xFF);
                     
                     break;
                 case 0xD7:
@@ -377,9 +544,7 @@ extern "C" {
                     break;
                 case 0xD9:
                     // TERMINATE
-                    m68k_pulse_halt();
-                    tcsetattr(STDIN_FILENO, TCSANOW, &originalTermios);
-                    exit(0);
+                    machine->exit(0);
 
                     break;
                 // case 0xDA:
@@ -389,87 +554,69 @@ extern "C" {
                     // MOVEXY
                     if ((d1 & 0xFFFF) == 0xFF00) {
                         // clear screen
-                        cout << endl << "easy68k CLRSCR 0xDB not implemneted" << endl;
+                        out << "\neasy68k CLRSCR 0xDB not implemneted\n";
                     } else {
                         // Move X, Y
-                        cout << endl << "easy68k MOVE X,Y 0xDB " << ((d1 & 0xFF00) >> 8) << "," << (d1 & 0xFF) << " not implemented" << endl;
+                        out << "\neasy68k MOVE X,Y 0xDB " << ((d1 & 0xFF00) >> 8) << "," << (d1 & 0xFF) << " not implemented\n";
                     }
 
                     break;
                 case 0xDC:
                     // SETECHO
                     if (d1 == 0) {
-                        m68k_write_memory_8(ECHO_ON, 0);
+                        write_guest_8(ECHO_ON, 0);
                     }
                     if (d1 == 1) {
-                        m68k_write_memory_8(ECHO_ON, 1);
+                        write_guest_8(ECHO_ON, 1);
                     }
 
                     break;
                 case 0xDD:
                 case 0xDE:
                     // PRINTLN_SZ / PRINT_SZ
-                    do {
-                         c = m68k_read_memory_8(a1++);
-                         if (c) {
-                            cout << c;
-                         }
-                    } while (c != 0);
+                    print_guest_string(out, a1);
 
                     if (op == 0xDD) {
-                        cout << endl;
-                    } else {
-                        cout << flush;
+                        out << '\n';
                     }
 
                     break;
                 case 0xDF:
                     // PRINT_UNSIGNED
-                    cout << print_unsigned(d1, d2) << flush;
+                    out << print_unsigned(d1, d2);
 
                     break;
                 case 0xE0:
                     // SETDISPLAY
                     if (d1 == 0) {  
-                        m68k_write_memory_8(PROMPT_ON, 0);                        
+                        write_guest_8(PROMPT_ON, 0);                        
                     }
                     if (d1 == 1) {  
-                        m68k_write_memory_8(PROMPT_ON, 1);                        
+                        write_guest_8(PROMPT_ON, 1);                        
                     }
                     if (d1 == 2) {  
-                        m68k_write_memory_8(LF_DISPLAY, 0);                        
+                        write_guest_8(LF_DISPLAY, 0);                        
                     }
                     if (d1 == 3) {  
-                        m68k_write_memory_8(LF_DISPLAY, 1);                        
+                        write_guest_8(LF_DISPLAY, 1);                        
                     }
 
                     break;
                 case 0xE1:
                     // PRINTSZ_NUM
-                    do {
-                         c = m68k_read_memory_8(a1++);
-                         if (c) {
-                            cout << c;
-                         }
-                    } while (c != 0);
+                    print_guest_string(out, a1);
 
-                    cout << (int)d1 << flush;
+                    out << (int)d1;
 
                     break;
                 case 0xE2:
                     // PRINTSZ_READ_NUM
-                    do {
-                         c = m68k_read_memory_8(a1++);
-                         if (c) {
-                            cout << c << flush;
-                         }
-                    } while (c != 0);
+                    print_guest_string(out, a1);
                     
                     chars_left = 10;
                     
                     while (--chars_left) {
                         c = read_char();
-                        cout << flush;
 
                         if (c == 0x0D) {
                             break;
@@ -478,12 +625,12 @@ extern "C" {
                         if ((c >= '0') && (c <= '9')) {
                             num = (num * 10) + (c - '0');
                             if (m68k_read_memory_8(ECHO_ON) == 1) {
-                                cout << c;
+                                out << c;
                             }
                         } 
                     }
                     if (m68k_read_memory_8(LF_DISPLAY) == 1) {
-                        cout << endl;
+                        out << '\n';
                     }
                     m68k_set_reg(M68K_REG_D1, num);
 
@@ -493,12 +640,14 @@ extern "C" {
 
                 case 0xE4:
                     // PRINTNUM_SIGNED_WIDTH
-                    cout << setw(d2) << (int)d1 << flush;
+                    out << setw(d2) << (int)d1;
                     break;
                 
                 default:
                     cerr << "<UNKNOWN OP " << hex << op << "; D7=0x" << hex << d7 << "; D6=0x" << d6 << ": IGNORED>" << endl;
             }
+        } else {
+            machine->illegal(opcode);
         }
 
         return 1;
@@ -506,62 +655,931 @@ extern "C" {
 
     int interrupt_ack_handler(unsigned int irq) {
         switch (irq) {
-        case DUART_IRQ:
-            // DUART timer tick - vector to 0x45
-            m68k_set_irq(0);
-            return DUART_VEC;
+        case rosco::m68k::emu::Duart::IRQ:
+            // DUART timer tick (vector 0x45), or whatever the guest set in IVR
+            return Machine::current()->duart().acknowledge();
         default:
-            cerr << "WARN: Unexpected IRQ " << irq << "; Autovectoring, but machine will probably lock up!" << endl;
+            Machine::current()->dumpTrace(cerr, "WARN: Unexpected IRQ " + std::to_string(irq) + "; Autovectoring, but machine will probably lock up!");
             return M68K_INT_ACK_AUTOVECTOR;
         }
     }
 }
 
-std::atomic_bool is_done;
+#define DEFAULT_CPU_MHZ   10
+#define DEFAULT_TICK_HZ   100
+#define DEFAULT_TIMEOUT   60
+#define DEFAULT_SD_IMAGE  "rosco_sd.bin"
+#define DEFAULT_SAMPLE    1000
+#define PROGRAM_BASE      0x40000
+#define ROM_BASE          0xe00000
+#define DEFAULT_MAX_LEN   4096
+
+// Long options with no short form
+#define OPT_SAMPLE        256
+#define OPT_SAVE_SNAPSHOT 257
+#define OPT_IDE_STATS     258
+#define OPT_RAM           259
+#define OPT_BUS_ERRORS    260
+#define OPT_TRACE         261
+#define OPT_COVERAGE      262
+#define OPT_FUZZ          263
+#define OPT_CORPUS        264
+#define OPT_RUNS          265
+#define OPT_MAX_LEN       266
+#define OPT_BASE          267
+
+struct RunOptions {
+    bool realtime = false;
+    uint32_t cpu_mhz = DEFAULT_CPU_MHZ;
+    uint32_t tick_hz = DEFAULT_TICK_HZ;
+    uint32_t timeout = 0;               // guest seconds, 0 for none
+    std::string sd_image = DEFAULT_SD_IMAGE;
+    bool sd_overlay = false;            // keep guest writes off the image file
+    std::string ide_image;              // no IDE disk if empty
+    bool ide_stats = false;
+    MemoryMap memory = MemoryMap::standard();
+    std::string snapshot;               // start from this instead of booting the ROM
+    bool profile = false;
+    Profiler::Mode profile_mode = Profiler::Mode::Exact;
+    uint32_t sample_period = DEFAULT_SAMPLE;
+    bool coverage = false;
+    uint32_t trace = 0;                 // entries in the trace ring, 0 for no tracing
+    bool trace_signals = false;         // dump the trace if the process is signalled
+};
+
+struct RunResult {
+    bool exited;
+    bool timed_out;
+    bool halted;
+    bool wanted_input;
+    int exit_code;
+    uint64_t cycles;
+};
+
+// Results about a binary are written next to it, named after it minus any
+// .bin or .elf extension
+static std::filesystem::path output_stem(const std::string &binary) {
+    std::filesystem::path stem(binary);
+    if (stem.extension() == ".bin" || stem.extension() == ".elf") {
+        stem.replace_extension();
+    }
+    return stem;
+}
+
+// The program itself if it was an ELF, or else the .elf the build leaves
+// alongside the binary
+static std::string source_elf(const std::string &binary) {
+    if (ElfImage::isElf(binary.c_str())) {
+        return binary;
+    }
+
+    std::filesystem::path elf = output_stem(binary);
+    elf += ".elf";
+    return elf.string();
+}
+
+// Write <binary>.profile and <binary>.folded, symbolized from the
+// program's ELF.
+static void write_profile(const std::string &binary, const Profiler &profiler, const ElfSymbols &loaded) {
+    std::filesystem::path stem = output_stem(binary);
+    std::filesystem::path flat = stem, folded = stem;
+    std::string elf = source_elf(binary);
+    flat += ".profile";
+    folded += ".folded";
+
+    ElfSymbols symbols = loaded;
+    if (symbols.empty() && !symbols.load(elf.c_str())) {
+        cerr << "No symbols from " << elf << "; profile will show raw addresses" << endl;
+    }
+
+    std::ofstream flatOut(flat), foldedOut(folded);
+    profiler.writeFlat(flatOut, symbols);
+    profiler.writeFolded(foldedOut, symbols);
+
+    cerr << "Profile written to " << flat.string() << " and " << folded.string() << endl;
+}
+
+// Write <binary>.coverage, a per-function summary, and <binary>.info, an lcov
+// tracefile of the source lines run, from the program's ELF
+static void write_coverage(const std::string &binary, Coverage &coverage, const ElfSymbols &loaded) {
+    std::filesystem::path stem = output_stem(binary);
+    std::filesystem::path summary = stem, info = stem;
+    std::string elf = source_elf(binary);
+    summary += ".coverage";
+    info += ".info";
+
+    coverage.collect(m68k_get_reg(NULL, M68K_REG_CPU_TYPE));
+
+    ElfSymbols symbols = loaded;
+    if (symbols.empty() && !symbols.load(elf.c_str())) {
+        cerr << "No symbols from " << elf << "; coverage has no functions" << endl;
+    }
+
+    std::ofstream summaryOut(summary);
+    coverage.writeSummary(summaryOut, symbols);
+
+    ElfLines lines;
+    if (!lines.load(elf.c_str())) {
+        cerr << "No line table in " << elf << " (build it with -g); coverage written to " << summary.string() << endl;
+        return;
+    }
 
-void timer_interrupt() {
-    int i = 100;
+    std::ofstream infoOut(info);
+    coverage.writeLcov(infoOut, stem.filename().string(), symbols, lines);
 
-    while (!is_done) {
-        if (i++ == 100) {
-            m68k_set_irq(DUART_IRQ);
-            i = 0;
+    cerr << "Coverage written to " << summary.string() << " and " << info.string() << endl;
+}
+
+// The machine being traced, so a run that crashes or is killed (say by a CI
+// job's timeout) still leaves its trace behind
+static Machine *traced_machine;
+
+static void trace_signal_handler(int sig) {
+    // Only the thread running the guest has its CPU loaded
+    if (traced_machine && Machine::current() == traced_machine) {
+        traced_machine->dumpTrace(cerr, std::string("Caught ") + strsignal(sig));
+    }
+
+    // The handler was reset on entry; die as the signal would have
+    raise(sig);
+}
+
+static void trace_signals(Machine *machine) {
+    struct sigaction action = {};
+
+    traced_machine = machine;
+
+    action.sa_handler = machine ? trace_signal_handler : SIG_DFL;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+
+    for (int sig : { SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGSEGV, SIGBUS, SIGFPE, SIGABRT }) {
+        sigaction(sig, &action, nullptr);
+    }
+}
+
+// Boot a fresh machine on the calling thread and run binary until it exits,
+// asks for input in batch mode, or uses up its guest-time budget.
+static RunResult run_binary(const std::string &rom, const std::string &binary, const RunOptions &options,
+                            std::ostream &console, ConsoleInput *input, Journal *journal = nullptr) {
+    std::unique_ptr<Profiler> profiler;
+    std::unique_ptr<Tracer> tracer;
+    std::unique_ptr<Coverage> coverage;
+    bool warm = !options.snapshot.empty();
+    Machine machine(warm ? nullptr : rom.c_str(), options.cpu_mhz * 1000000, options.sd_image.c_str(), options.sd_overlay, options.memory);
+    rosco::m68k::emu::Scheduler &scheduler = machine.scheduler();
+
+    if (warm) {
+        machine.restoreSnapshot(options.snapshot.c_str());
+    }
+
+    // The disk is part of what a journal was recorded against, so a
+    // recorded or replayed run must leave it as it found it
+    if (!options.ide_image.empty() && !machine.attachIde(options.ide_image.c_str(), options.sd_overlay || journal)) {
+        throw std::runtime_error("Failed to open IDE image " + options.ide_image);
+    }
+
+    machine.setConsole(console);
+    machine.setInput(input);
+    machine.setJournal(journal);
+    uint32_t entry = machine.load(PROGRAM_BASE, binary.c_str());
+
+    // An idle guest is waiting for a key; let the host sleep until one comes
+    if (input) {
+        machine.setIdleWait([input](std::chrono::nanoseconds timeout) {
+            input->wait(timeout);
+        });
+    }
+
+    if (options.profile) {
+        profiler.reset(new Profiler(options.profile_mode));
+        machine.setProfiler(profiler.get(), options.sample_period);
+    }
+
+    if (options.coverage) {
+        coverage.reset(new Coverage());
+        machine.setCoverage(coverage.get());
+    }
+
+    if (options.trace) {
+        tracer.reset(new Tracer(options.trace));
+        machine.setTracer(tracer.get());
+        if (options.trace_signals) {
+            trace_signals(&machine);
         }
+    }
 
-        usleep(100);
+    // The DUART's receiver takes keys just as the input traps do
+    machine.duart().setInput([&machine]() { return key_ready(&machine); }, read_char);
+
+    // DUART timer tick, counted in guest cycles rather than host time
+    scheduler.schedulePeriodic(scheduler.cpuHz() / options.tick_hz, [&machine]() {
+        machine.duart().legacyTick();
+    });
+    scheduler.setRealTime(options.realtime);
+
+    uint64_t deadline = options.timeout ? (uint64_t)options.timeout * scheduler.cpuHz() : UINT64_MAX;
+
+    // The ROM always calls the program at PROGRAM_BASE; an ELF that starts
+    // anywhere else is sent to its entry point from there
+    if (entry != PROGRAM_BASE && (warm || machine.runTo(PROGRAM_BASE, deadline))) {
+        m68k_set_reg(M68K_REG_PC, entry);
+    }
+
+    bool exited = machine.run(deadline);
+
+    if (machine.halted()) {
+        machine.dumpTrace(cerr, "CPU halted by a double fault");
     }
+    if (tracer && options.trace_signals) {
+        trace_signals(nullptr);
+    }
+
+    if (profiler) {
+        write_profile(binary, *profiler, machine.symbols());
+    }
+    if (coverage) {
+        Machine::HostAccess host(machine);
+        write_coverage(binary, *coverage, machine.symbols());
+    }
+    if (options.ide_stats && machine.ide()) {
+        machine.ide()->report(cerr);
+    }
+
+    return RunResult {
+        .exited = exited,
+        .timed_out = !exited && !machine.halted(),
+        .halted = machine.halted(),
+        .wanted_input = machine.wantedInput(),
+        .exit_code = machine.exitCode(),
+        .cycles = scheduler.now(),
+    };
 }
 
-int main(int argc, char** argv) {
-    if (argc != 2) {
-        cout << "Usage: r68k <binary>" << endl;
+// Boot the ROM with no program loaded, up to the point where it calls into
+// the program, and save the machine there. Runs started from the snapshot
+// skip straight to the program.
+static int save_snapshot(const std::string &rom, const RunOptions &options, const char *filename) {
+    Machine machine(rom.c_str(), options.cpu_mhz * 1000000, options.sd_image.c_str(), true, options.memory);
+    rosco::m68k::emu::Scheduler &scheduler = machine.scheduler();
+
+    scheduler.schedulePeriodic(scheduler.cpuHz() / options.tick_hz, [&machine]() {
+        machine.duart().legacyTick();
+    });
+
+    if (!machine.runTo(PROGRAM_BASE, (uint64_t)DEFAULT_TIMEOUT * scheduler.cpuHz())) {
+        cerr << "ROM never reached the program at 0x" << hex << PROGRAM_BASE << "; no snapshot saved" << endl;
         return 1;
+    }
+
+    try {
+        machine.saveSnapshot(filename);
+    } catch (std::exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    cerr << "Snapshot saved to " << filename << " after " << dec << scheduler.now() << " boot cycles" << endl;
+    return 0;
+}
+
+static bool read_input(const std::string &filename, Fuzzer::Input &input) {
+    std::ifstream in(filename, std::ios::binary);
+
+    if (!in) {
+        return false;
+    }
+
+    input.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Fuzz the function target (a symbol or an address) in binary, starting
+// from the corpus directory's inputs and adding new ones to it. Given a
+// file rather than a directory, runs the target on just that input, to
+// reproduce a crash. Returns the process exit status.
+static int run_fuzz(const std::string &rom, const std::string &binary, const std::string &target, const std::string &corpus,
+                    uint64_t runs, uint32_t max_len, const RunOptions &options) {
+    bool warm = !options.snapshot.empty();
+    bool reproduce = !corpus.empty() && !std::filesystem::is_directory(corpus);
+    Machine machine(warm ? nullptr : rom.c_str(), options.cpu_mhz * 1000000, options.sd_image.c_str(), true, options.memory);
+    Coverage coverage;
+    std::unique_ptr<Tracer> tracer;
+    std::vector<Fuzzer::Input> seeds;
+    uint32_t code_start = PROGRAM_BASE, code_end;
+
+    rosco::m68k::emu::ConsoleBuffer buffer(STDOUT_FILENO);
+    std::ostream console(&buffer);
+    std::ostream discard(nullptr);
+
+    // Only a reproduction shows what the guest prints; thousands of runs a
+    // second would bury everything else
+    machine.setConsole(reproduce ? console : discard);
+
+    try {
+        if (warm) {
+            machine.restoreSnapshot(options.snapshot.c_str());
+        }
+        if (!options.ide_image.empty() && !machine.attachIde(options.ide_image.c_str(), true)) {
+            throw std::runtime_error("Failed to open IDE image " + options.ide_image);
+        }
+
+        uint32_t entry = machine.load(PROGRAM_BASE, binary.c_str());
+        const ElfSymbols &symbols = machine.symbols();
+        const ElfSymbols::Symbol *symbol = symbols.find(target);
+        char *end;
+        uint32_t address = symbol ? symbol->address : strtoul(target.c_str(), &end, 0);
+
+        if (!symbol && (target.empty() || *end)) {
+            throw std::runtime_error("No function " + target + " in " + binary);
+        }
+
+        // Feedback comes from the program's code, not the ROM's
+        code_end = PROGRAM_BASE + std::filesystem::file_size(binary);
+        if (!symbols.empty()) {
+            code_start = symbols.all().front().address;
+            code_end = std::max_element(symbols.all().begin(), symbols.all().end(),
+                                        [](auto &a, auto &b) { return a.end < b.end; })->end;
+        }
+
+        if (reproduce) {
+            seeds.emplace_back();
+            if (!read_input(corpus, seeds.back())) {
+                throw std::runtime_error("Failed to read " + corpus);
+            }
+        } else if (!corpus.empty()) {
+            for (auto &file : std::filesystem::directory_iterator(corpus)) {
+                if (file.is_regular_file()) {
+                    seeds.emplace_back();
+                    if (!read_input(file.path().string(), seeds.back())) {
+                        throw std::runtime_error("Failed to read " + file.path().string());
+                    }
+                }
+            }
+        }
+
+        uint64_t deadline = (uint64_t)DEFAULT_TIMEOUT * machine.scheduler().cpuHz();
+
+        if (entry != PROGRAM_BASE && (warm || machine.runTo(PROGRAM_BASE, deadline))) {
+            m68k_set_reg(M68K_REG_PC, entry);
+        }
+        if (!machine.runTo(address, deadline)) {
+            throw std::runtime_error("The program never called " + target);
+        }
+    } catch (std::exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    if (options.trace) {
+        tracer.reset(new Tracer(options.trace));
+        machine.setTracer(tracer.get());
+    }
+
+    machine.setCoverage(&coverage);
+    machine.setStopOnFault(true);
+
+    Fuzzer fuzzer(machine, coverage, code_start, code_end, (uint64_t)options.timeout * machine.scheduler().cpuHz());
+
+    if (reproduce) {
+        Fuzzer::Outcome outcome = fuzzer.execute(seeds.front());
+        console.flush();
+        cerr << Fuzzer::describe(outcome) << " on " << corpus << endl;
+        return outcome == Fuzzer::Outcome::Returned ? 0 : 1;
+    }
+
+    return fuzzer.fuzz(std::move(seeds), corpus, runs, max_len, cerr) ? 0 : 1;
+}
+
+// Identifies the ROM, program and IDE disk a journal was recorded against
+static uint64_t hash_files(const std::vector<std::string> &filenames) {
+    uint64_t hash = 0xcbf29ce484222325ULL;          // FNV-1a
+
+    for (auto &filename : filenames) {
+        std::ifstream in(filename, std::ios::binary);
+        char c;
+
+        while (in.get(c)) {
+            hash = (hash ^ (uint8_t)c) * 0x100000001b3ULL;
+        }
+    }
+
+    return hash;
+}
+
+struct BatchTest {
+    std::string binary;
+    std::string expected;               // empty to check the exit code only
+};
+
+// Manifest lines are "<binary> [expected-output-file]", relative to the
+// manifest itself. '#' starts a comment.
+static bool read_manifest(const char *filename, std::vector<BatchTest> &tests) {
+    std::ifstream manifest(filename);
+
+    if (!manifest) {
+        cerr << "Failed to open manifest " << filename << endl;
+        return false;
+    }
+
+    std::filesystem::path base = std::filesystem::path(filename).parent_path();
+    std::string line;
+
+    while (std::getline(manifest, line)) {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        std::string binary, expected;
+
+        if (!(fields >> binary)) {
+            continue;
+        }
+        fields >> expected;
+
+        BatchTest test;
+        test.binary = (base / binary).string();
+        if (!expected.empty()) {
+            test.expected = (base / expected).string();
+        }
+        tests.push_back(test);
+    }
+
+    return true;
+}
+
+static bool read_file(const std::string &filename, std::string &contents) {
+    std::ifstream in(filename, std::ios::binary);
+
+    if (!in) {
+        return false;
+    }
+
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    contents = ss.str();
+    return true;
+}
+
+// Run every test in the manifest on a pool of worker threads, each with its
+// own machine. Returns the number of failures.
+static int run_batch(const std::string &rom, const std::vector<BatchTest> &tests, const RunOptions &options, unsigned jobs) {
+    std::atomic<size_t> next(0);
+    std::atomic<int> failures(0);
+    std::mutex report_lock;
+
+    auto worker = [&]() {
+        size_t i;
+
+        while ((i = next++) < tests.size()) {
+            const BatchTest &test = tests[i];
+            std::ostringstream output;
+            std::string status = "PASS";
+            std::string reason;
+            RunResult result = {};
+
+            auto start = std::chrono::steady_clock::now();
+
+            try {
+                result = run_binary(rom, test.binary, options, output, nullptr);
+
+                std::string expected;
+                if (result.wanted_input) {
+                    reason = "program requested console input";
+                } else if (result.halted) {
+                    reason = "CPU halted by a double fault";
+                } else if (result.timed_out) {
+                    reason = "timed out after " + std::to_string(options.timeout) + "s guest time";
+                } else if (result.exit_code != 0) {
+                    reason = "exit code " + std::to_string(result.exit_code);
+                } else if (!test.expected.empty() && !read_file(test.expected, expected)) {
+                    reason = "cannot read " + test.expected;
+                } else if (!test.expected.empty() && output.str() != expected) {
+                    reason = "output differs from " + test.expected;
+                }
+            } catch (std::exception &e) {
+                reason = e.what();
+            }
+
+            auto wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (!reason.empty()) {
+                status = "FAIL";
+                failures++;
+            }
+
+            std::lock_guard<std::mutex> guard(report_lock);
+            cout << status << " " << test.binary
+                 << " (" << std::fixed << std::setprecision(2) << wall << "s, "
+                 << result.cycles << " cycles)";
+            if (!reason.empty()) {
+                cout << ": " << reason;
+            }
+            cout << endl;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned j = 0; j < std::min<size_t>(jobs, tests.size()); j++) {
+        workers.emplace_back(worker);
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    cout << (tests.size() - failures) << " passed, " << failures << " failed" << endl;
+    return failures;
+}
+
+// List the code in a ROM, .bin or ELF without running it. A raw image is
+// taken to be at base, or if none is given where r68k would put it.
+static int disassemble(const std::string &binary, int64_t base, unsigned jobs) {
+    Disassembler disassembler(M68K_CPU_TYPE_68010, jobs);
+    std::string elf = source_elf(binary);
+    ElfImage image;
+    ElfSymbols symbols;
+    std::string contents;
+
+    if (ElfImage::isElf(binary.c_str())) {
+        if (!image.load(binary.c_str())) {
+            cerr << image.error() << endl;
+            return 1;
+        }
+        for (auto &code : image.code()) {
+            disassembler.add(code.address, code.bytes, code.size);
+        }
+        symbols = image.symbols();
     } else {
-        init_term();
+        if (!read_file(binary, contents)) {
+            cerr << "Failed to read " << binary << endl;
+            return 1;
+        }
+        if (base < 0) {
+            base = std::filesystem::path(binary).extension() == ".rom" ? ROM_BASE : PROGRAM_BASE;
+        }
+        disassembler.add(base, (const uint8_t*)contents.data(), contents.size());
+        symbols.load(elf.c_str());
+    }
 
-        std::filesystem::path path = std::filesystem::path(argv[0]).parent_path();
-        path += "/firmware/rosco_m68k.rom";
+    auto start = std::chrono::steady_clock::now();
+    uint64_t count = disassembler.write(cout, symbols);
+    auto wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-        sys_mem = new rosco::m68k::emu::AddressDecoder(0x40000, 0x100000, path.string().c_str());
-        sys_mem->LoadMemoryFile(0x40000, argv[1]);
+    cout.flush();
+    cerr << count << " instructions in " << std::fixed << std::setprecision(3) << wall << "s" << endl;
+    return 0;
+}
 
-        m68k_set_cpu_type(M68K_CPU_TYPE_68010);
-        m68k_init();
-        m68k_pulse_reset();
+static void usage() {
+    cout << "Usage: r68k [options] <binary or ELF>" << endl
+         << "       r68k [options] -b <manifest>" << endl
+         << "       r68k -d [--base <address>] [-j <n>] <ROM, binary or ELF>" << endl
+         << endl
+         << "Options:" << endl
+         << "  -r, --realtime       Throttle the guest to its clock speed in wall time" << endl
+         << "                       (default: run as fast as possible in virtual time)" << endl
+         << "  -c, --clock <MHz>    Guest CPU clock speed (default: " << DEFAULT_CPU_MHZ << ")" << endl
+         << "  -t, --tick <Hz>      System timer tick rate (default: " << DEFAULT_TICK_HZ << ")" << endl
+         << "  -b, --batch <file>   Run every binary listed in a manifest and report results" << endl
+         << "  -j, --jobs <n>       Machines to run in parallel in batch mode, or threads to" << endl
+         << "                       disassemble with (default: all cores)" << endl
+         << "  -T, --timeout <s>    Guest seconds before a run is abandoned" << endl
+         << "                       (default: " << DEFAULT_TIMEOUT << " in batch mode, none otherwise)" << endl
+         << "  -s, --sd <file>      SD card image (default: " << DEFAULT_SD_IMAGE << ")" << endl
+         << "  -o, --sd-overlay     Keep SD card writes in memory rather than in the image" << endl
+         << "                       (always on in batch mode)" << endl
+         << "  -m, --memory-map <file>" << endl
+         << "                       Lay out RAM, ROM and I/O space as described in a file" << endl
+         << "      --ram <base>:<size>" << endl
+         << "                       Add a bank of RAM (e.g. 0x100000:13M for all the" << endl
+         << "                       expansion space below the ROM)" << endl
+         << "      --bus-errors     Raise a bus error for unmapped accesses and ROM writes" << endl
+         << "                       (default: they read zero or are dropped, and are reported)" << endl
+         << "  -I, --ide <file>     Disk image for the IDE interface (default: none)" << endl
+         << "      --ide-stats      Report per-command IDE counters and timings at exit" << endl
+         << "  -P, --profile <mode> Profile the guest, 'exact' (every instruction, with call" << endl
+         << "                       stacks) or 'sample'; writes <binary>.profile and .folded" << endl
+         << "      --sample <n>     Cycles between samples (default: " << DEFAULT_SAMPLE << ")" << endl
+         << "      --coverage       Record the code the guest runs; writes <binary>.coverage" << endl
+         << "                       and an lcov tracefile, <binary>.info" << endl
+         << "      --trace <n>      Keep the last n instructions and writes, and print them" << endl
+         << "                       if the CPU halts, takes an unexpected interrupt, hits an" << endl
+         << "                       illegal instruction or r68k is killed by a signal" << endl
+         << "      --fuzz <function>" << endl
+         << "                       Fuzz a libFuzzer-style target in the program," << endl
+         << "                       int function(const uint8_t *data, size_t size), from" << endl
+         << "                       where the program first calls it; -T is per input" << endl
+         << "                       (default: 1 guest second)" << endl
+         << "      --corpus <dir>   Seed inputs for --fuzz, where new ones are saved; a file" << endl
+         << "                       instead runs the target on just that input" << endl
+         << "      --runs <n>       Inputs to try before stopping (default: no limit)" << endl
+         << "      --max-len <n>    Longest input to generate (default: " << DEFAULT_MAX_LEN << ")" << endl
+         << "  -R, --record <file>  Log every input the guest takes to a journal" << endl
+         << "  -p, --replay <file>  Re-run a recorded session from its journal, at full speed" << endl
+         << "                       and without the terminal" << endl
+         << "  -i, --input <file>   Take console input from a file rather than the terminal" << endl
+         << "  -S, --snapshot <file>" << endl
+         << "                       Start from a saved snapshot rather than booting the ROM" << endl
+         << "      --save-snapshot <file>" << endl
+         << "                       Boot the ROM up to the program's entry point, save a" << endl
+         << "                       snapshot there and exit (takes no binary)" << endl
+         << "  -d, --disassemble    List the code in a ROM, binary or ELF rather than run it," << endl
+         << "                       labelling its symbols and branch targets" << endl
+         << "      --base <address> Where a raw image sits for -d (default: 0x" << hex << ROM_BASE << " for" << endl
+         << "                       a .rom, 0x" << PROGRAM_BASE << dec << " otherwise)" << endl;
+}
 
-        m68ki_cpu_core ctx;
-        m68k_get_context(&ctx);
-        
-        std::thread timer_thread(timer_interrupt);
-        while (1) {
-            m68k_execute(100000);
-            m68k_get_context(&ctx);
+int main(int argc, char** argv) {
+    static const struct option long_options[] = {
+        { "realtime",   no_argument,        nullptr, 'r' },
+        { "clock",      required_argument,  nullptr, 'c' },
+        { "tick",       required_argument,  nullptr, 't' },
+        { "batch",      required_argument,  nullptr, 'b' },
+        { "jobs",       required_argument,  nullptr, 'j' },
+        { "timeout",    required_argument,  nullptr, 'T' },
+        { "sd",         required_argument,  nullptr, 's' },
+        { "sd-overlay", no_argument,        nullptr, 'o' },
+        { "memory-map", required_argument,  nullptr, 'm' },
+        { "ram",        required_argument,  nullptr, OPT_RAM },
+        { "bus-errors", no_argument,        nullptr, OPT_BUS_ERRORS },
+        { "ide",        required_argument,  nullptr, 'I' },
+        { "ide-stats",  no_argument,        nullptr, OPT_IDE_STATS },
+        { "profile",    required_argument,  nullptr, 'P' },
+        { "sample",     required_argument,  nullptr, OPT_SAMPLE },
+        { "trace",      required_argument,  nullptr, OPT_TRACE },
+        { "coverage",   no_argument,        nullptr, OPT_COVERAGE },
+        { "fuzz",       required_argument,  nullptr, OPT_FUZZ },
+        { "corpus",     required_argument,  nullptr, OPT_CORPUS },
+        { "runs",       required_argument,  nullptr, OPT_RUNS },
+        { "max-len",    required_argument,  nullptr, OPT_MAX_LEN },
+        { "record",     required_argument,  nullptr, 'R' },
+        { "replay",     required_argument,  nullptr, 'p' },
+        { "snapshot",   required_argument,  nullptr, 'S' },
+        { "save-snapshot", required_argument, nullptr, OPT_SAVE_SNAPSHOT },
+        { "input",      required_argument,  nullptr, 'i' },
+        { "disassemble", no_argument,       nullptr, 'd' },
+        { "base",       required_argument,  nullptr, OPT_BASE },
+        { "help",       no_argument,        nullptr, 'h' },
+        { nullptr,      0,                  nullptr, 0 }
+    };
+
+    RunOptions options;
+    const char *manifest = nullptr;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    const char *record = nullptr;
+    const char *replay = nullptr;
+    const char *save = nullptr;
+    const char *script = nullptr;
+    const char *memory_map = nullptr;
+    const char *fuzz = nullptr;
+    std::string corpus;
+    uint64_t runs = 0;
+    uint32_t max_len = DEFAULT_MAX_LEN;
+    std::vector<std::string> ram_banks;
+    bool bus_errors = false;
+    bool listing = false;
+    int64_t base = -1;
+    int timeout = -1;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "rc:t:b:j:T:s:om:I:P:R:p:S:i:dh", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'r':
+            options.realtime = true;
+            break;
+        case 'c':
+            options.cpu_mhz = strtoul(optarg, nullptr, 0);
+            break;
+        case 't':
+            options.tick_hz = strtoul(optarg, nullptr, 0);
+            break;
+        case 'b':
+            manifest = optarg;
+            break;
+        case 'j':
+            jobs = strtoul(optarg, nullptr, 0);
+            break;
+        case 'T':
+            timeout = strtoul(optarg, nullptr, 0);
+            break;
+        case 's':
+            options.sd_image = optarg;
+            break;
+        case 'o':
+            options.sd_overlay = true;
+            break;
+        case 'm':
+            memory_map = optarg;
+            break;
+        case OPT_RAM:
+            ram_banks.push_back(optarg);
+            break;
+        case OPT_BUS_ERRORS:
+            bus_errors = true;
+            break;
+        case 'I':
+            options.ide_image = optarg;
+            break;
+        case OPT_IDE_STATS:
+            options.ide_stats = true;
+            break;
+        case 'P':
+            options.profile = true;
+            if (strcmp(optarg, "exact") == 0) {
+                options.profile_mode = Profiler::Mode::Exact;
+            } else if (strcmp(optarg, "sample") == 0) {
+                options.profile_mode = Profiler::Mode::Sample;
+            } else {
+                usage();
+                return 1;
+            }
+            break;
+        case OPT_SAMPLE:
+            options.sample_period = strtoul(optarg, nullptr, 0);
+            break;
+        case OPT_TRACE:
+            options.trace = strtoul(optarg, nullptr, 0);
+            break;
+        case OPT_COVERAGE:
+            options.coverage = true;
+            break;
+        case OPT_FUZZ:
+            fuzz = optarg;
+            break;
+        case OPT_CORPUS:
+            corpus = optarg;
+            break;
+        case OPT_RUNS:
+            runs = strtoull(optarg, nullptr, 0);
+            break;
+        case OPT_MAX_LEN:
+            max_len = strtoul(optarg, nullptr, 0);
+            break;
+        case 'R':
+            record = optarg;
+            break;
+        case 'p':
+            replay = optarg;
+            break;
+        case 'S':
+            options.snapshot = optarg;
+            break;
+        case OPT_SAVE_SNAPSHOT:
+            save = optarg;
+            break;
+        case 'i':
+            script = optarg;
+            break;
+        case 'd':
+            listing = true;
+            break;
+        case OPT_BASE:
+            base = strtoul(optarg, nullptr, 0);
+            break;
+        default:
+            usage();
+            return 1;
         }
+    }
+
+    if (optind != argc - (manifest || save ? 0 : 1) || options.cpu_mhz == 0 || options.tick_hz == 0 || jobs == 0 || options.sample_period == 0
+            || (manifest && (record || replay)) || (record && replay) || (save && (manifest || record || replay)) || (script && (manifest || replay || save)) || (options.ide_stats && manifest)
+            || (fuzz && (manifest || record || replay || save || script || options.profile || options.coverage))
+            || (listing && (manifest || record || replay || save || script || fuzz)) || (base >= 0 && !listing)) {
+        usage();
+        return 1;
+    }
 
-        is_done = true;
-        timer_thread.join();
+    if (memory_map && !options.memory.load(memory_map)) {
+        cerr << options.memory.error() << endl;
+        return 1;
+    }
+    for (auto &bank : ram_banks) {
+        if (!options.memory.addRam(bank)) {
+            cerr << "--ram: " << options.memory.error() << endl;
+            return 1;
+        }
+    }
+    options.memory.busErrors |= bus_errors;
+
+    if (std::none_of(options.memory.regions().begin(), options.memory.regions().end(),
+                     [](const MemoryRegion &region) { return region.type == MemoryRegion::Rom; })) {
+        cerr << "The memory map needs a ROM region for the firmware" << endl;
+        return 1;
+    }
+
+    std::filesystem::path path = std::filesystem::path(argv[0]).parent_path();
+    path += "/firmware/rosco_m68k.rom";
+
+    // Builds the core's shared tables before any worker thread starts
+    m68k_init();
+
+    // A warm start stands in for the ROM when identifying a recording
+    std::string image = options.snapshot.empty() ? path.string() : options.snapshot;
+
+    if (listing) {
+        return disassemble(argv[optind], base, jobs);
+    } else if (save) {
+        return save_snapshot(path.string(), options, save);
+    } else if (fuzz) {
+        // Each input gets the timeout, a second by default
+        options.timeout = timeout <= 0 ? 1 : timeout;
+        return run_fuzz(path.string(), argv[optind], fuzz, corpus, runs, max_len, options);
+    } else if (manifest) {
+        std::vector<BatchTest> tests;
+
+        if (!read_manifest(manifest, tests)) {
+            return 1;
+        }
+
+        // Tests run side by side off one image, so none may change it
+        options.timeout = timeout < 0 ? DEFAULT_TIMEOUT : timeout;
+        options.sd_overlay = true;
+        return run_batch(path.string(), tests, options, jobs) ? 1 : 0;
+    } else if (replay) {
+        Journal journal;
+        Journal::Header header;
+
+        if (!journal.replay(replay, header)) {
+            cerr << journal.error() << endl;
+            return 1;
+        }
+        if (header.imageHash != hash_files({ image, argv[optind], options.ide_image })) {
+            cerr << "WARN: ROM or program differs from the one recorded in " << replay << endl;
+        }
+
+        // Same clock and tick as the recording, but as fast as possible and
+        // with no terminal: every input comes from the journal
+        options.cpu_mhz = header.cpuHz / 1000000;
+        options.tick_hz = header.tickHz;
+        options.realtime = false;
+        options.timeout = timeout < 0 ? 0 : timeout;
+        options.trace_signals = true;
+
+        rosco::m68k::emu::ConsoleBuffer buffer(STDOUT_FILENO);
+        std::ostream console(&buffer);
+
+        RunResult result;
+        try {
+            result = run_binary(path.string(), argv[optind], options, console, nullptr, &journal);
+        } catch (std::exception &e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        console.flush();
+
+        if (!journal.error().empty()) {
+            cerr << "Replay failed: " << journal.error() << endl;
+            return 1;
+        }
+
+        cerr << "Replay matched: " << result.cycles << " cycles, exit code " << result.exit_code << endl;
+        return result.exited ? result.exit_code : 1;
+    } else {
+        Journal journal;
+
+        if (record && !journal.record(record, Journal::Header {
+                    .cpuHz = options.cpu_mhz * 1000000,
+                    .tickHz = options.tick_hz,
+                    .imageHash = hash_files({ image, argv[optind], options.ide_image }) })) {
+            cerr << journal.error() << endl;
+            return 1;
+        }
+
+        options.timeout = timeout < 0 ? 0 : timeout;
+        options.trace_signals = true;
+
+        rosco::m68k::emu::ConsoleBuffer buffer(STDOUT_FILENO);
+        std::ostream console(&buffer);
+
+        // Keys come from a script if given, otherwise the terminal
+        int input_fd = STDIN_FILENO;
+        if (script && (input_fd = open(script, O_RDONLY)) < 0) {
+            cerr << "Failed to open input script " << script << endl;
+            return 1;
+        }
+
+        RunResult result;
+        bool terminal = !script && isatty(STDIN_FILENO);
+        if (terminal) {
+            init_term();
+        }
+        try {
+            ConsoleInput input(input_fd);
+            result = run_binary(path.string(), argv[optind], options, console, &input, record ? &journal : nullptr);
+        } catch (std::exception &e) {
+            if (terminal) {
+                tcsetattr(STDIN_FILENO, TCSANOW, &originalTermios);
+            }
+            cerr << e.what() << endl;
+            return 1;
+        }
+        if (terminal) {
+            tcsetattr(STDIN_FILENO, TCSANOW, &originalTermios);
+        }
+        if (script) {
+            close(input_fd);
+        }
 
-        delete(sys_mem);
-        return 0;
+        return result.exited ? result.exit_code : 1;
     }
 }
@@ -57,6 +57,17 @@ extern "C" {
 /* ======================================================================== */
 /* ============================ GENERAL DEFINES =========================== */
 
+/* Storage class of the core's mutable state (see M68K_THREAD_LOCAL_STATE) */
+#if M68K_THREAD_LOCAL_STATE
+#ifdef __cplusplus
+#define M68K_THREAD_LOCAL thread_local
+#else
+#define M68K_THREAD_LOCAL _Thread_local
+#endif
+#else
+#define M68K_THREAD_LOCAL
+#endif
+
 /* ======================================================================== */
 
 /* There are 7 levels of interrupt to the 68K.
@@ -208,6 +219,15 @@ void m68k_write_memory_32(unsigned int address, unsigned int value);
  */
 void m68k_write_memory_32_pd(unsigned int address, unsigned int value);
 
+/* Host view of the guest memory from address to the end of its page, for
+ * the block cache to translate code from, and RTE to size an instruction,
+ * without going through the read callbacks (which may raise bus errors).
+ * Set *length to the bytes there are and return a pointer to them, or
+ * return NULL if the page isn't plain memory (I/O, unmapped...); code there
+ * runs an instruction at a time, fetched as it executes.
+ */
+const unsigned char* m68k_read_code_span(unsigned int address, unsigned int* length);
+
 
 
 /* ======================================================================== */
@@ -293,6 +313,23 @@ void m68k_set_fc_callback(void  (*callback)(unsigned int new_fc));
  */
 void m68k_set_instr_hook_callback(void  (*callback)(unsigned int pc));
 
+/* Set a callback for profiling the CPU.
+ * You must enable M68K_PROFILE_HOOK in m68kconf.h.
+ * The CPU calls this callback just after each instruction, with the address
+ * and opcode of the instruction and the number of cycles it took.
+ * Default behavior: no callback.
+ */
+void m68k_set_instr_profile_callback(void  (*callback)(unsigned int pc, unsigned int ir, int cycles));
+
+/* Set a map for code coverage.
+ * You must enable M68K_COVERAGE_MAP in m68kconf.h.
+ * The map has a byte for each word of the 16MB 24-bit address space.  When
+ * the CPU runs n instructions in a straight line from address, the byte for
+ * address is raised to n if it was lower; the instructions themselves can be
+ * found by disassembling from there.  Default behavior: no map.
+ */
+void m68k_set_coverage_map(unsigned char* map);
+
 
 
 /* ======================================================================== */
@@ -347,10 +384,49 @@ unsigned int m68k_get_virq(unsigned int level);
 /* Halt the CPU as if you pulsed the HALT pin. */
 void m68k_pulse_halt(void);
 
+/* Whether the CPU is halted, by m68k_pulse_halt() or by a bus or address
+ * error while it was building the frame for another (a double fault).
+ */
+int m68k_is_halted(void);
+
 
 /* Trigger a bus error exception */
 void m68k_pulse_bus_error(void);
 
+/* Trigger a bus error exception for a faulting access to address, from inside
+ * a memory callback.  The 68010 stack frame records the address and whether
+ * it was a read or a write.  If the handler sets the RR (rerun) bit in the
+ * frame's special status word, meaning it has dealt with the access itself,
+ * RTE resumes after the faulting instruction rather than re-running it.
+ * This doesn't return, unless the fault halts the CPU: it longjmps back into
+ * m68k_execute(), out of the callback and everything the callback called on
+ * the way.  None of those frames may be left holding anything that needs
+ * cleaning up, such as a lock or a C++ object with a destructor.
+ */
+void m68k_pulse_bus_error_at(unsigned int address, int write);
+
+/* Whether to snapshot D0-D7/A0-A7 before each instruction, so a bus error
+ * rolls back what the faulting instruction did to them.  Needs
+ * M68K_EMULATE_BUS_ERROR_ROLLBACK.  Turn it off only if the host never raises
+ * bus errors.  Part of the context.  Default behavior: on.
+ */
+void m68k_set_bus_error_rollback(int enable);
+
+
+/* Tell the core that guest memory in [address, address+size) was changed by
+ * the host (e.g. a block device transfer) so that any cached translation of
+ * code in that range is discarded.  Writes made by the CPU itself are
+ * tracked automatically.  A no-op unless M68K_BLOCK_CACHE is enabled.
+ */
+void m68k_invalidate_code(unsigned int address, unsigned int size);
+
+/* Tell the core that the CPU just accessed a device register, whose value
+ * may change without the CPU writing anything.  A loop that reads devices
+ * is then never taken for an idle loop.  A no-op unless M68K_IDLE_SKIP is
+ * enabled.
+ */
+void m68k_device_access(void);
+
 
 /* Context switching to allow multiple CPUs */
 
@@ -360,9 +436,18 @@ unsigned int m68k_context_size(void);
 /* Get a cpu context */
 unsigned int m68k_get_context(void* dst);
 
-/* set the current cpu context */
+/* set the current cpu context.  NULL instead frees this thread's block
+ * cache, for a thread that is done running a CPU.
+ */
 void m68k_set_context(void* dst);
 
+/* Like m68k_set_context(), for a context of the same CPU on the same memory,
+ * such as one saved to roll the CPU back to: code the block cache translated
+ * from that memory is kept.  Whatever the host changed in memory since needs
+ * m68k_invalidate_code().
+ */
+void m68k_restore_context(void* src);
+
 /* Register the CPU state information */
 void m68k_state_register(const char *type, int index);
 
@@ -389,6 +474,15 @@ unsigned int m68k_disassemble(char* str_buff, unsigned int pc, unsigned int cpu_
  */
 unsigned int m68k_disassemble_raw(char* str_buff, unsigned int pc, const unsigned char* opdata, const unsigned char* argdata, unsigned int cpu_type);
 
+/* Same again, from an image of memory in buffer: size bytes starting at
+ * address base.  Returns 0 if the instruction runs off the end.  If target
+ * isn't NULL it gets the address a branch or jump goes to, when that is
+ * known without running it, or M68K_NO_TARGET.
+ */
+#define M68K_NO_TARGET 0xffffffff
+
+unsigned int m68k_disassemble_buffer(char* str_buff, unsigned int pc, const unsigned char* buffer, unsigned int base, unsigned int size, unsigned int* target, unsigned int cpu_type);
+
 
 /* ======================================================================== */
 /* ============================== MAME STUFF ============================== */
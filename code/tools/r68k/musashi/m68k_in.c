@@ -115,6 +115,20 @@ void m68ki_build_opcode_table(void);
 extern void (*m68ki_instruction_jump_table[0x10000])(void); /* opcode handler jump table */
 extern unsigned char m68ki_cycles[][0x10000];
 
+/* A handler set built for one CPU model alone (m68kmake's model arguments).
+ * CPU_TYPE is a constant in those, so the checks for other models fold away.
+ * m68ki_build_opcode_table() builds their tables too; the cycle counts are
+ * shared with the generic set.
+ */
+typedef struct
+{
+	unsigned int cpu_type;               /* CPU_TYPE_xxx */
+	void (**jump_table)(void);           /* its opcode handler jump table */
+	void (*build)(void);                 /* builds the jump table */
+} m68ki_ops_model;
+
+extern const m68ki_ops_model m68ki_ops_models[]; /* ends with cpu_type 0 */
+
 
 /* ======================================================================== */
 /* ============================== END OF FILE ============================= */
@@ -136,8 +150,17 @@ M68KMAKE_TABLE_HEADER
 
 #define NUM_CPU_TYPES 5
 
+#ifndef M68KI_OPS_CPU_TYPE
 void  (*m68ki_instruction_jump_table[0x10000])(void); /* opcode handler jump table */
 unsigned char m68ki_cycles[NUM_CPU_TYPES][0x10000]; /* Cycles used by CPU type */
+#else
+/* Built for one model: the table and its builder take the model's suffix */
+#define M68KI_OPS_PASTE(A, B)  A ## B
+#define M68KI_OPS_NAME_(A, B)  M68KI_OPS_PASTE(A, B)
+#define M68KI_OPS_NAME(A)      M68KI_OPS_NAME_(A, M68KI_OPS_SUFFIX)
+
+void  (*M68KI_OPS_NAME(m68ki_instruction_jump_table)[0x10000])(void); /* this model's jump table */
+#endif
 
 /* This is used to generate the opcode handler jump table */
 typedef struct
@@ -163,8 +186,21 @@ M68KMAKE_TABLE_FOOTER
 };
 
 
-/* Build the opcode handler jump table */
-void m68ki_build_opcode_table(void)
+/* Point an opcode at a handler, with its cycles if they're being filled in */
+static void set_opcode(void (**jump_table)(void), unsigned char (*cycles)[0x10000], int instr, const opcode_handler_struct *ostruct)
+{
+	int k;
+
+	jump_table[instr] = ostruct->opcode_handler;
+	if(cycles)
+		for(k=0;k<NUM_CPU_TYPES;k++)
+			cycles[k][instr] = ostruct->cycles[k];
+}
+
+/* Build a jump table from the handler table, and the cycle counts unless
+ * cycles is NULL
+ */
+static void build_opcode_table(void (**jump_table)(void), unsigned char (*cycles)[0x10000])
 {
 	const opcode_handler_struct *ostruct;
 	int cycle_cost;
@@ -176,9 +212,10 @@ void m68ki_build_opcode_table(void)
 	for(i = 0; i < 0x10000; i++)
 	{
 		/* default to illegal */
-		m68ki_instruction_jump_table[i] = m68k_op_illegal;
-		for(k=0;k<NUM_CPU_TYPES;k++)
-			m68ki_cycles[k][i] = 0;
+		jump_table[i] = m68k_op_illegal;
+		if(cycles)
+			for(k=0;k<NUM_CPU_TYPES;k++)
+				cycles[k][i] = 0;
 	}
 
 	ostruct = m68k_opcode_handler_table;
@@ -187,22 +224,14 @@ void m68ki_build_opcode_table(void)
 		for(i = 0;i < 0x10000;i++)
 		{
 			if((i & ostruct->mask) == ostruct->match)
-			{
-				m68ki_instruction_jump_table[i] = ostruct->opcode_handler;
-				for(k=0;k<NUM_CPU_TYPES;k++)
-					m68ki_cycles[k][i] = ostruct->cycles[k];
-			}
+				set_opcode(jump_table, cycles, i, ostruct);
 		}
 		ostruct++;
 	}
 	while(ostruct->mask == 0xff00)
 	{
 		for(i = 0;i <= 0xff;i++)
-		{
-			m68ki_instruction_jump_table[ostruct->match | i] = ostruct->opcode_handler;
-			for(k=0;k<NUM_CPU_TYPES;k++)
-				m68ki_cycles[k][ostruct->match | i] = ostruct->cycles[k];
-		}
+			set_opcode(jump_table, cycles, ostruct->match | i, ostruct);
 		ostruct++;
 	}
 	while(ostruct->mask == 0xf1f8)
@@ -212,19 +241,17 @@ void m68ki_build_opcode_table(void)
 			for(j = 0;j < 8;j++)
 			{
 				instr = ostruct->match | (i << 9) | j;
-				m68ki_instruction_jump_table[instr] = ostruct->opcode_handler;
-				for(k=0;k<NUM_CPU_TYPES;k++)
-					m68ki_cycles[k][instr] = ostruct->cycles[k];
+				set_opcode(jump_table, cycles, instr, ostruct);
 				// For all shift operations with known shift distance (encoded in instruction word)
-				if((instr & 0xf000) == 0xe000 && (!(instr & 0x20)))
+				if(cycles && (instr & 0xf000) == 0xe000 && (!(instr & 0x20)))
 				{
 					// On the 68000 and 68010 shift distance affect execution time.
 					// Add the cycle cost of shifting; 2 times the shift distance
 					cycle_cost = ((((i-1)&7)+1)<<1);
-					m68ki_cycles[0][instr] += cycle_cost;
-					m68ki_cycles[1][instr] += cycle_cost;
+					cycles[0][instr] += cycle_cost;
+					cycles[1][instr] += cycle_cost;
 					// On the 68020 shift distance does not affect execution time
-					m68ki_cycles[2][instr] += 0;
+					cycles[2][instr] += 0;
 				}
 			}
 		}
@@ -233,42 +260,47 @@ void m68ki_build_opcode_table(void)
 	while(ostruct->mask == 0xfff0)
 	{
 		for(i = 0;i <= 0x0f;i++)
-		{
-			m68ki_instruction_jump_table[ostruct->match | i] = ostruct->opcode_handler;
-			for(k=0;k<NUM_CPU_TYPES;k++)
-				m68ki_cycles[k][ostruct->match | i] = ostruct->cycles[k];
-		}
+			set_opcode(jump_table, cycles, ostruct->match | i, ostruct);
 		ostruct++;
 	}
 	while(ostruct->mask == 0xf1ff)
 	{
 		for(i = 0;i <= 0x07;i++)
-		{
-			m68ki_instruction_jump_table[ostruct->match | (i << 9)] = ostruct->opcode_handler;
-			for(k=0;k<NUM_CPU_TYPES;k++)
-				m68ki_cycles[k][ostruct->match | (i << 9)] = ostruct->cycles[k];
-		}
+			set_opcode(jump_table, cycles, ostruct->match | (i << 9), ostruct);
 		ostruct++;
 	}
 	while(ostruct->mask == 0xfff8)
 	{
 		for(i = 0;i <= 0x07;i++)
-		{
-			m68ki_instruction_jump_table[ostruct->match | i] = ostruct->opcode_handler;
-			for(k=0;k<NUM_CPU_TYPES;k++)
-				m68ki_cycles[k][ostruct->match | i] = ostruct->cycles[k];
-		}
+			set_opcode(jump_table, cycles, ostruct->match | i, ostruct);
 		ostruct++;
 	}
 	while(ostruct->mask == 0xffff)
 	{
-		m68ki_instruction_jump_table[ostruct->match] = ostruct->opcode_handler;
-		for(k=0;k<NUM_CPU_TYPES;k++)
-			m68ki_cycles[k][ostruct->match] = ostruct->cycles[k];
+		set_opcode(jump_table, cycles, ostruct->match, ostruct);
 		ostruct++;
 	}
 }
 
+#ifndef M68KI_OPS_CPU_TYPE
+/* Build the opcode handler jump table, and those of the single-model sets */
+void m68ki_build_opcode_table(void)
+{
+	const m68ki_ops_model *model;
+
+	build_opcode_table(m68ki_instruction_jump_table, m68ki_cycles);
+
+	for(model = m68ki_ops_models; model->cpu_type; model++)
+		model->build();
+}
+#else
+/* Build this model's jump table; it uses the generic set's cycle counts */
+void M68KI_OPS_NAME(m68ki_build_opcode_table)(void)
+{
+	build_opcode_table(M68KI_OPS_NAME(m68ki_instruction_jump_table), NULL);
+}
+#endif
+
 
 /* ======================================================================== */
 /* ============================== END OF FILE ============================= */
@@ -281,6 +313,7 @@ M68KMAKE_OPCODE_HANDLER_HEADER
 
 #include <stdio.h>
 #include "m68kcpu.h"
+#include "m68kops.h"
 extern void m68040_fpu_op0(void);
 extern void m68040_fpu_op1(void);
 extern void m68881_mmu_ops(void);
@@ -9236,7 +9269,13 @@ M68KMAKE_OP(rte, 32, ., .)
 				CPU_RUN_MODE = RUN_MODE_NORMAL;
 				return;
 			} else if (format_word == 8) {
-				/* Format 8 stack frame -- 68010 only. 29 word bus/address error */
+				/* Format 8 stack frame -- 68010 only. 29 word bus/address error.
+				 * The core can't continue an instruction part way through, so
+				 * if the handler set RR to say it did the faulted access
+				 * itself, skip the rest of the instruction instead.  One that
+				 * can't be sized (code outside plain memory) runs again.
+				 */
+				uint ssw = m68ki_read_16(REG_A[7]+8);
 				new_sr = m68ki_pull_16();
 				new_pc = m68ki_pull_32();
 				m68ki_fake_pull_16();	/* format word */
@@ -9256,6 +9295,8 @@ M68KMAKE_OP(rte, 32, ., .)
 				m68ki_fake_pull_32();
 				m68ki_fake_pull_32();
 				m68ki_fake_pull_32();
+				if(ssw & 0x8000)
+					new_pc += m68ki_instruction_size(new_pc);
 				m68ki_jump(new_pc);
 				m68ki_set_sr(new_sr);
 				CPU_INSTR_MODE = INSTRUCTION_YES;
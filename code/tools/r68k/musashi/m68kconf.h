@@ -165,6 +165,18 @@ int interrupt_ack_handler(unsigned int);
 #define M68K_INSTRUCTION_HOOK       OPT_OFF
 #define M68K_INSTRUCTION_CALLBACK(pc) your_instruction_hook_function(pc)
 
+/* If ON, CPU will call the profile callback after every instruction with its
+ * address, opcode and the cycles it used (effective address and exception
+ * time included).  Costs one test per instruction while no callback is set.
+ */
+#define M68K_PROFILE_HOOK           OPT_ON
+
+/* If ON, the CPU marks the code it runs in a coverage map set with
+ * m68k_set_coverage_map(): one byte store for each straight-line run of
+ * instructions.  Costs one test per run while no map is set.
+ */
+#define M68K_COVERAGE_MAP           OPT_ON
+
 
 /* If ON, the CPU will emulate the 4-byte prefetch queue of a real 68000 */
 #define M68K_EMULATE_PREFETCH       OPT_OFF
@@ -177,6 +189,17 @@ int interrupt_ack_handler(unsigned int);
 #define M68K_EMULATE_ADDRESS_ERROR  OPT_OFF
 
 
+/* If ON, the CPU can snapshot D0-D7/A0-A7 before every instruction so that
+ * a bus error raised part way through an instruction (m68k_pulse_bus_error()
+ * from a memory callback) rolls them back before stacking the fault frame.
+ * The snapshot is taken while m68k_set_bus_error_rollback() has it on, which
+ * it is by default; a host that never raises bus errors can turn it off at
+ * run time and pay one test per instruction instead of the copy.  If OFF, a
+ * bus error stacks the registers as they stand.
+ */
+#define M68K_EMULATE_BUS_ERROR_ROLLBACK OPT_ON
+
+
 /* Turn ON to enable logging of illegal instruction calls.
  * M68K_LOG_FILEHANDLE must be #defined to a stdio file stream.
  * Turn on M68K_LOG_1010_1111 to log all 1010 and 1111 calls.
@@ -189,6 +212,49 @@ int interrupt_ack_handler(unsigned int);
  * so enable this only if it's useful */
 #define M68K_EMULATE_PMMU   OPT_ON
 
+/* If ON, FADD, FSUB, FMUL, FDIV and FSQRT use the host's doubles when the
+ * FPCR selects single or double precision and rounding to nearest, and the
+ * operands and result fit that precision.  The results are the same as
+ * softfloat's bit for bit; anything else (extended precision, other rounding
+ * modes, denormals, overflow...) still goes through softfloat.  Only used on
+ * hosts that evaluate doubles in double precision (FLT_EVAL_METHOD 0).
+ */
+#define M68K_FPU_NATIVE_DOUBLE  OPT_ON
+
+/* Translations the PMMU keeps, direct mapped on logical page and supervisor
+ * state, so most accesses skip the table walk.  Must be a power of two.
+ */
+#define M68K_PMMU_TLB_SIZE  256
+
+/* If ON, m68k_execute() decodes straight-line code into a cache of basic
+ * blocks (handler pointers, opcodes, cycle counts and pre-fetched extension
+ * words) and runs those, rather than fetching and dispatching every opcode
+ * through the memory callbacks.  CPU writes into a page holding cached code
+ * invalidate that page; if the host writes guest code behind the CPU's back
+ * it must call m68k_invalidate_code().  Blocks are bypassed while tracing or
+ * while the PMMU is enabled.
+ */
+#define M68K_BLOCK_CACHE            OPT_ON
+
+/* If ON, the core spots the CPU spinning in a loop it can never leave on its
+ * own: a backward branch coming back to the same place with every register
+ * and flag as it was last time round, and no memory written (or illegal
+ * instruction handed to the host) in between.  Only an interrupt can end
+ * such a loop, and interrupts are raised between timeslices, so the rest of
+ * the timeslice is skipped as if the CPU had executed a STOP.  Hosts whose
+ * devices can change what the CPU reads in the middle of a timeslice must
+ * call m68k_device_access() on each device access, or leave this off.
+ */
+#define M68K_IDLE_SKIP              OPT_ON
+
+/* If ON, all of the core's mutable state (CPU context, cycle counters, block
+ * cache, softfloat modes, disassembler buffers) is thread-local, so several
+ * emulated machines can run at once on separate host threads.  Call
+ * m68k_init() once before starting other threads, then on each thread that
+ * runs a CPU.
+ */
+#define M68K_THREAD_LOCAL_STATE     OPT_ON
+
 /* ----------------------------- COMPATIBILITY ---------------------------- */
 
 /* The following options set optimizations that violate the current ANSI
@@ -51,14 +51,17 @@ extern void m68ki_build_opcode_table(void);
 #include "m68kfpu.c"
 #include "m68kmmu.h" // uses some functions from m68kfpu.c which are static !
 
+#include <stdlib.h>
+#include <string.h>
+
 /* ======================================================================== */
 /* ================================= DATA ================================= */
 /* ======================================================================== */
 
-int  m68ki_initial_cycles;
-int  m68ki_remaining_cycles = 0;                     /* Number of clocks remaining */
-uint m68ki_tracing = 0;
-uint m68ki_address_space;
+M68K_THREAD_LOCAL int  m68ki_initial_cycles;
+M68K_THREAD_LOCAL int  m68ki_remaining_cycles = 0;                     /* Number of clocks remaining */
+M68K_THREAD_LOCAL uint m68ki_tracing = 0;
+M68K_THREAD_LOCAL uint m68ki_address_space;
 
 #ifdef M68K_LOG_ENABLE
 const char *const m68ki_cpu_names[] =
@@ -78,21 +81,21 @@ const char *const m68ki_cpu_names[] =
 #endif /* M68K_LOG_ENABLE */
 
 /* The CPU core */
-m68ki_cpu_core m68ki_cpu = {0};
+M68K_THREAD_LOCAL m68ki_cpu_core m68ki_cpu = {0};
 
 #if M68K_EMULATE_ADDRESS_ERROR
 #ifdef _BSD_SETJMP_H
-sigjmp_buf m68ki_aerr_trap;
+M68K_THREAD_LOCAL sigjmp_buf m68ki_aerr_trap;
 #else
-jmp_buf m68ki_aerr_trap;
+M68K_THREAD_LOCAL jmp_buf m68ki_aerr_trap;
 #endif
 #endif /* M68K_EMULATE_ADDRESS_ERROR */
 
-uint    m68ki_aerr_address;
-uint    m68ki_aerr_write_mode;
-uint    m68ki_aerr_fc;
+M68K_THREAD_LOCAL uint    m68ki_aerr_address;
+M68K_THREAD_LOCAL uint    m68ki_aerr_write_mode;
+M68K_THREAD_LOCAL uint    m68ki_aerr_fc;
 
-jmp_buf m68ki_bus_error_jmp_buf;
+M68K_THREAD_LOCAL jmp_buf m68ki_bus_error_jmp_buf;
 
 /* Used by shift & rotate instructions */
 const uint8 m68ki_shift_8_table[65] =
@@ -534,7 +537,7 @@ const uint8 m68ki_ea_idx_cycle_table[64] =
  */
 
 /* Interrupt acknowledge */
-static int default_int_ack_callback_data;
+static M68K_THREAD_LOCAL int default_int_ack_callback_data;
 static int default_int_ack_callback(int int_level)
 {
 	default_int_ack_callback_data = int_level;
@@ -543,7 +546,7 @@ static int default_int_ack_callback(int int_level)
 }
 
 /* Breakpoint acknowledge */
-static unsigned int default_bkpt_ack_callback_data;
+static M68K_THREAD_LOCAL unsigned int default_bkpt_ack_callback_data;
 static void default_bkpt_ack_callback(unsigned int data)
 {
 	default_bkpt_ack_callback_data = data;
@@ -580,14 +583,14 @@ static int default_illg_instr_callback(int opcode)
 }
 
 /* Called when the program counter changed by a large value */
-static unsigned int default_pc_changed_callback_data;
+static M68K_THREAD_LOCAL unsigned int default_pc_changed_callback_data;
 static void default_pc_changed_callback(unsigned int new_pc)
 {
 	default_pc_changed_callback_data = new_pc;
 }
 
 /* Called every time there's bus activity (read/write to/from memory */
-static unsigned int default_set_fc_callback_data;
+static M68K_THREAD_LOCAL unsigned int default_set_fc_callback_data;
 static void default_set_fc_callback(unsigned int new_fc)
 {
 	default_set_fc_callback_data = new_fc;
@@ -609,6 +612,319 @@ static void default_instr_hook_callback(unsigned int pc)
 	#endif
 #endif /* M68K_EMULATE_ADDRESS_ERROR */
 
+/* ======================================================================== */
+/* ============================== BLOCK CACHE ============================= */
+/* ======================================================================== */
+
+#if M68K_BLOCK_CACHE
+
+/* Straight-line code is decoded once into a block holding each instruction's
+ * handler, opcode and base cycle count, plus a copy of all of the block's
+ * instruction words so that extension words can be fetched without going
+ * through the memory callbacks.  Blocks never cross a code page, and every
+ * code page has a generation number which is bumped when it is written,
+ * which lazily invalidates all blocks translated from it.
+ */
+#define M68KI_BCACHE_BLOCKS     0x1000  /* Direct-mapped on PC, power of 2 */
+#define M68KI_BCACHE_MAX_INSNS  32
+#define M68KI_BCACHE_MAX_WORDS  64
+#define M68KI_BCACHE_NO_PC      1       /* Odd, so never a valid block address */
+
+typedef struct
+{
+	void (*handler)(void);
+	uint pc;
+	uint16 ir;
+	uint16 cycles;
+} m68ki_bcache_insn;
+
+typedef struct
+{
+	uint pc;           /* Address of the first instruction */
+	uint page_gen;     /* Generation of the code page when translated */
+	uint size;         /* Size of the block in bytes */
+	uint count;        /* Number of instructions, 0 if untranslatable */
+	m68ki_bcache_insn insn[M68KI_BCACHE_MAX_INSNS];
+	uint16 words[M68KI_BCACHE_MAX_WORDS];
+} m68ki_bcache_block;
+
+static M68K_THREAD_LOCAL m68ki_bcache_block* m68ki_bcache_blocks;
+static M68K_THREAD_LOCAL uint m68ki_bcache_page_gen[M68KI_BCACHE_PAGE_COUNT];
+M68K_THREAD_LOCAL uint8 m68ki_bcache_code_page[M68KI_BCACHE_PAGE_COUNT];
+
+/* Extension word window of the block currently being executed */
+M68K_THREAD_LOCAL uint m68ki_bcache_fetch_pc;
+M68K_THREAD_LOCAL uint m68ki_bcache_fetch_size;
+M68K_THREAD_LOCAL const uint16* m68ki_bcache_fetch_words;
+
+static void m68ki_bcache_flush(void)
+{
+	uint i;
+
+	m68ki_bcache_fetch_size = 0;
+
+	if(m68ki_bcache_blocks == NULL)
+		return;
+
+	for(i = 0; i < M68KI_BCACHE_BLOCKS; i++)
+		m68ki_bcache_blocks[i].pc = M68KI_BCACHE_NO_PC;
+	for(i = 0; i < M68KI_BCACHE_PAGE_COUNT; i++)
+		m68ki_bcache_code_page[i] = 0;
+}
+
+/* Give back this thread's blocks; they are allocated again if it runs more code */
+static void m68ki_bcache_release(void)
+{
+	m68ki_bcache_flush();
+	free(m68ki_bcache_blocks);
+	m68ki_bcache_blocks = NULL;
+}
+
+void m68ki_bcache_invalidate(uint address, uint size)
+{
+	uint page = M68KI_BCACHE_PAGE(address);
+	uint last = M68KI_BCACHE_PAGE(address + size - 1);
+
+	for(;;)
+	{
+		if(m68ki_bcache_code_page[page])
+		{
+			m68ki_bcache_code_page[page] = 0;
+			m68ki_bcache_page_gen[page]++;
+
+			/* The running block may have just overwritten itself */
+			if(m68ki_bcache_fetch_size && M68KI_BCACHE_PAGE(m68ki_bcache_fetch_pc) == page)
+				m68ki_bcache_fetch_size = 0;
+		}
+		if(page == last)
+			break;
+		page = (page + 1) & (M68KI_BCACHE_PAGE_COUNT - 1);
+	}
+}
+
+/* True if execution should not continue past this opcode within a block:
+ * flow control, exceptions, and anything that can change SR or the
+ * translation of addresses.
+ */
+static int m68ki_bcache_ends_block(uint ir)
+{
+	switch(ir >> 12)
+	{
+		case 0x0:
+			/* ORI/ANDI/EORI to SR */
+			return ir == 0x007c || ir == 0x027c || ir == 0x0a7c;
+		case 0x4:
+			return ir == 0x4afc                     /* ILLEGAL */
+				|| (ir & 0xffc0) == 0x46c0          /* MOVE to SR */
+				|| (ir & 0xfff8) == 0x4848          /* BKPT */
+				|| (ir & 0xfff0) == 0x4e40          /* TRAP */
+				|| (ir >= 0x4e72 && ir <= 0x4e7b)   /* STOP, RTE, RTD, RTS, TRAPV, RTR, MOVEC */
+				|| (ir & 0xff80) == 0x4e80          /* JSR, JMP */
+				|| (ir & 0xf140) == 0x4100;         /* CHK */
+		case 0x5:
+			return (ir & 0xf0f8) == 0x50c8          /* DBcc */
+				|| (ir & 0xf0f8) == 0x50f8;         /* TRAPcc */
+		case 0x6:                                   /* Bcc, BRA, BSR */
+		case 0xa:                                   /* Line A */
+		case 0xf:                                   /* Line F (FPU, PMMU) */
+			return 1;
+		case 0x8:
+			return (ir & 0xf0c0) == 0x80c0;         /* DIVU, DIVS */
+	}
+	return 0;
+}
+
+/* Instructions are sized from the host's view of the code page, bounds
+ * checked, so nothing is read through the memory callbacks ahead of being
+ * run: past the end of a region, or from a device, that could report a
+ * fault (or raise a bus error) for an instruction that never runs.
+ */
+static void m68ki_bcache_translate(m68ki_bcache_block* block, uint pc)
+{
+	char dasm[100];
+	uint cpu_type = m68k_get_reg(NULL, M68K_REG_CPU_TYPE);
+	uint page_end = (pc | ((1 << M68KI_BCACHE_PAGE_BITS) - 1)) + 1;
+	const unsigned char* span = NULL;
+	uint length = 0;
+	uint next = pc;
+	uint count = 0;
+	uint i;
+
+	block->pc = pc;
+	block->page_gen = m68ki_bcache_page_gen[M68KI_BCACHE_PAGE(pc)];
+
+	if(!(pc & 1))
+		span = m68k_read_code_span(ADDRESS_68K(pc), &length);
+
+	if(span != NULL)
+	{
+		if(length > page_end - pc)
+			length = page_end - pc;
+
+		while(count < M68KI_BCACHE_MAX_INSNS)
+		{
+			uint size = m68k_disassemble_buffer(dasm, next, span, pc, length, NULL, cpu_type) & 0xff;
+			uint ir;
+
+			if(size == 0 || next + size - pc > M68KI_BCACHE_MAX_WORDS * 2)
+				break;
+
+			ir = (span[next - pc] << 8) | span[next - pc + 1];
+
+			block->insn[count].handler = CPU_JUMP_TABLE[ir];
+			block->insn[count].pc = next;
+			block->insn[count].ir = ir;
+			block->insn[count].cycles = CYC_INSTRUCTION[ir];
+			count++;
+			next += size;
+
+			if(m68ki_bcache_ends_block(ir) || next - pc == length)
+				break;
+		}
+	}
+
+	block->count = count;
+	block->size = next - pc;
+	for(i = 0; i < block->size >> 1; i++)
+		block->words[i] = (span[i << 1] << 8) | span[(i << 1) + 1];
+
+	/* Even an untranslatable entry is tied to its page so it gets retried */
+	m68ki_bcache_code_page[M68KI_BCACHE_PAGE(pc)] = 1;
+}
+
+static m68ki_bcache_block* m68ki_bcache_lookup(uint pc)
+{
+	m68ki_bcache_block* block;
+
+	if(m68ki_bcache_blocks == NULL)
+	{
+		m68ki_bcache_blocks = malloc(M68KI_BCACHE_BLOCKS * sizeof(m68ki_bcache_block));
+		if(m68ki_bcache_blocks == NULL)
+			return NULL;
+		m68ki_bcache_flush();
+	}
+
+	block = &m68ki_bcache_blocks[(pc >> 1) & (M68KI_BCACHE_BLOCKS - 1)];
+	if(block->pc != pc || block->page_gen != m68ki_bcache_page_gen[M68KI_BCACHE_PAGE(pc)])
+		m68ki_bcache_translate(block, pc);
+
+	return block->count ? block : NULL;
+}
+
+/* Run a block until it ends, the timeslice runs out, or an instruction
+ * leaves the straight-line path (taken branch, exception, interrupt...).
+ */
+static void m68ki_bcache_execute(const m68ki_bcache_block* block)
+{
+	const m68ki_bcache_insn* insn = block->insn;
+	const m68ki_bcache_insn* end = insn + block->count;
+
+	m68ki_bcache_fetch_pc = block->pc;
+	m68ki_bcache_fetch_words = block->words;
+	m68ki_bcache_fetch_size = block->size;
+
+	for(;;)
+	{
+		int cycles_before = GET_CYCLES();
+
+		/* Call external hook to peek at CPU */
+		m68ki_instr_hook(REG_PC); /* auto-disable (see m68kcpu.h) */
+
+		/* Record previous program counter */
+		REG_PPC = REG_PC;
+
+		/* Record previous D/A register state (in case of bus error) */
+		m68ki_save_da(); /* auto-disable (see m68kcpu.h) */
+
+		/* Opcode is already decoded, just skip over it */
+		REG_IR = insn->ir;
+		REG_PC += 2;
+		insn->handler();
+		USE_CYCLES(insn->cycles);
+
+		/* Report the instruction to the profiler */
+		m68ki_profile_hook(cycles_before); /* auto-disable (see m68kcpu.h) */
+
+		if(++insn == end || REG_PC != insn->pc || GET_CYCLES() <= 0 || !m68ki_bcache_fetch_size)
+			break;
+	}
+
+	/* Mark the instructions run; a bus error part way through skips this */
+	m68ki_coverage_hook(block->pc, insn - block->insn);
+
+	m68ki_bcache_fetch_size = 0;
+}
+
+#else
+
+#define m68ki_bcache_flush()
+#define m68ki_bcache_release()
+
+#endif /* M68K_BLOCK_CACHE */
+
+
+#if M68K_IDLE_SKIP
+
+/* Every M68KI_IDLE_INTERVAL backward branches, the state at the branch
+ * target is saved.  If the next backward branch lands on the same spot with
+ * the same registers and flags, and nothing was written in between, the
+ * loop can only go round the same way until an interrupt.
+ */
+#define M68KI_IDLE_INTERVAL 16
+
+typedef struct
+{
+	uint pc;
+	uint dar[16];
+	uint flags[8];
+} m68ki_idle_state;
+
+M68K_THREAD_LOCAL uint m68ki_idle_countdown = M68KI_IDLE_INTERVAL;
+M68K_THREAD_LOCAL uint m68ki_idle_dirty;
+static M68K_THREAD_LOCAL int m68ki_idle_armed;
+static M68K_THREAD_LOCAL m68ki_idle_state m68ki_idle_saved;
+
+static void m68ki_idle_capture(m68ki_idle_state* state)
+{
+	state->pc = REG_PC;
+	memcpy(state->dar, REG_DA, sizeof(state->dar));
+	state->flags[0] = FLAG_X;
+	state->flags[1] = FLAG_N;
+	state->flags[2] = FLAG_Z;
+	state->flags[3] = FLAG_V;
+	state->flags[4] = FLAG_C;
+	state->flags[5] = FLAG_S;
+	state->flags[6] = FLAG_M;
+	state->flags[7] = FLAG_INT_MASK;
+}
+
+void m68ki_idle_check(void)
+{
+	m68ki_idle_state state;
+
+	m68ki_idle_capture(&state);
+
+	if(m68ki_idle_armed)
+	{
+		/* Stuck: eat the rest of the timeslice */
+		if(!m68ki_idle_dirty && memcmp(&state, &m68ki_idle_saved, sizeof(state)) == 0)
+			SET_CYCLES(0);
+
+		m68ki_idle_armed = 0;
+		m68ki_idle_countdown = M68KI_IDLE_INTERVAL;
+		return;
+	}
+
+	/* Compare against this at the next backward branch */
+	m68ki_idle_saved = state;
+	m68ki_idle_dirty = 0;
+	m68ki_idle_armed = 1;
+	m68ki_idle_countdown = 1;
+}
+
+#endif /* M68K_IDLE_SKIP */
+
+
 /* ======================================================================== */
 /* ================================= API ================================== */
 /* ======================================================================== */
@@ -667,7 +983,12 @@ unsigned int m68k_get_reg(void* context, m68k_register_t regnum)
 				case CPU_TYPE_010:		return (unsigned int)M68K_CPU_TYPE_68010;
 				case CPU_TYPE_EC020:	return (unsigned int)M68K_CPU_TYPE_68EC020;
 				case CPU_TYPE_020:		return (unsigned int)M68K_CPU_TYPE_68020;
+				case CPU_TYPE_EC030:	return (unsigned int)M68K_CPU_TYPE_68EC030;
+				case CPU_TYPE_030:		return (unsigned int)M68K_CPU_TYPE_68030;
+				case CPU_TYPE_EC040:	return (unsigned int)M68K_CPU_TYPE_68EC040;
+				case CPU_TYPE_LC040:	return (unsigned int)M68K_CPU_TYPE_68LC040;
 				case CPU_TYPE_040:		return (unsigned int)M68K_CPU_TYPE_68040;
+				case CPU_TYPE_SCC070:	return (unsigned int)M68K_CPU_TYPE_SCC68070;
 			}
 			return M68K_CPU_TYPE_INVALID;
 		default:			return 0;
@@ -776,8 +1097,18 @@ void m68k_set_instr_hook_callback(void  (*callback)(unsigned int pc))
 	CALLBACK_INSTR_HOOK = callback ? callback : default_instr_hook_callback;
 }
 
-/* Set the CPU type. */
-void m68k_set_cpu_type(unsigned int cpu_type)
+void m68k_set_instr_profile_callback(void  (*callback)(unsigned int pc, unsigned int ir, int cycles))
+{
+	CALLBACK_PROFILE = callback;
+}
+
+void m68k_set_coverage_map(unsigned char* map)
+{
+	m68ki_cpu.coverage_map = map;
+}
+
+/* Set up the registers and timings for a CPU type */
+static void m68ki_set_cpu_model(unsigned int cpu_type)
 {
 	switch(cpu_type)
 	{
@@ -941,6 +1272,23 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 	}
 }
 
+/* Set the CPU type. */
+void m68k_set_cpu_type(unsigned int cpu_type)
+{
+	const m68ki_ops_model *model;
+
+	/* Cached blocks hold per-CPU cycle counts and handlers */
+	m68ki_bcache_flush();
+
+	m68ki_set_cpu_model(cpu_type);
+
+	/* Use the handlers built for this model alone, if there are some */
+	CPU_JUMP_TABLE = m68ki_instruction_jump_table;
+	for(model = m68ki_ops_models; model->cpu_type; model++)
+		if(model->cpu_type == CPU_TYPE)
+			CPU_JUMP_TABLE = model->jump_table;
+}
+
 /* Execute some instructions until we use up num_cycles clock cycles */
 /* ASG: removed per-instruction interrupt checks */
 int m68k_execute(int num_cycles)
@@ -958,6 +1306,11 @@ int m68k_execute(int num_cycles)
 	SET_CYCLES(num_cycles);
 	m68ki_initial_cycles = num_cycles;
 
+#if M68K_IDLE_SKIP
+	/* The host may have changed anything between timeslices */
+	m68ki_idle_dirty = 1;
+#endif /* M68K_IDLE_SKIP */
+
 	/* See if interrupts came in */
 	m68ki_check_interrupts();
 
@@ -969,10 +1322,27 @@ int m68k_execute(int num_cycles)
 
 		m68ki_check_bus_error_trap();
 
+#if M68K_BLOCK_CACHE
+		/* We may have got here via a bus error part way through a block */
+		m68ki_bcache_fetch_size = 0;
+#endif /* M68K_BLOCK_CACHE */
+
 		/* Main loop.  Keep going until we run out of clock cycles */
 		do
 		{
-			int i;
+#if M68K_BLOCK_CACHE
+			if(!FLAG_T1 && !PMMU_ENABLED)
+			{
+				const m68ki_bcache_block* block = m68ki_bcache_lookup(REG_PC);
+
+				if(block != NULL)
+				{
+					m68ki_bcache_execute(block);
+					continue;
+				}
+			}
+#endif /* M68K_BLOCK_CACHE */
+
 			/* Set tracing accodring to T1. (T0 is done inside instruction) */
 			m68ki_trace_t1(); /* auto-disable (see m68kcpu.h) */
 
@@ -986,15 +1356,20 @@ int m68k_execute(int num_cycles)
 			REG_PPC = REG_PC;
 
 			/* Record previous D/A register state (in case of bus error) */
-			for (i = 15; i >= 0; i--){
-				REG_DA_SAVE[i] = REG_DA[i];
-			}
+			m68ki_save_da(); /* auto-disable (see m68kcpu.h) */
+
+			int cycles_before = GET_CYCLES();
 
 			/* Read an instruction and call its handler */
 			REG_IR = m68ki_read_imm_16();
-			m68ki_instruction_jump_table[REG_IR]();
+			CPU_JUMP_TABLE[REG_IR]();
 			USE_CYCLES(CYC_INSTRUCTION[REG_IR]);
 
+			/* Report the instruction to the profiler */
+			m68ki_profile_hook(cycles_before); /* auto-disable (see m68kcpu.h) */
+
+			m68ki_coverage_hook(REG_PPC, 1); /* auto-disable (see m68kcpu.h) */
+
 			/* Trace m68k_exception, if necessary */
 			m68ki_exception_if_trace(); /* auto-disable (see m68kcpu.h) */
 		} while(GET_CYCLES() > 0);
@@ -1030,11 +1405,17 @@ void m68k_modify_timeslice(int cycles)
 
 void m68k_end_timeslice(void)
 {
-	m68ki_initial_cycles = GET_CYCLES();
+	m68ki_initial_cycles -= GET_CYCLES();
 	SET_CYCLES(0);
 }
 
 
+void m68k_device_access(void)
+{
+	m68ki_idle_changed();
+}
+
+
 /* ASG: rewrote so that the int_level is a mask of the IPL0/IPL1/IPL2 bits */
 /* KS: Modified so that IPL* bits match with mask positions in the SR
  *     and cleaned out remenants of the interrupt controller.
@@ -1076,10 +1457,13 @@ void m68k_init(void)
 {
 	static uint emulation_initialized = 0;
 
+	m68ki_bcache_flush();
+
 	/* The first call to this function initializes the opcode handler jump table */
 	if(!emulation_initialized)
 		{
 		m68ki_build_opcode_table();
+		m68ki_dasm_init();
 		emulation_initialized = 1;
 	}
 
@@ -1093,19 +1477,75 @@ void m68k_init(void)
 	m68k_set_pc_changed_callback(NULL);
 	m68k_set_fc_callback(NULL);
 	m68k_set_instr_hook_callback(NULL);
+	m68k_set_instr_profile_callback(NULL);
+	m68k_set_coverage_map(NULL);
+	m68k_set_bus_error_rollback(1);
 }
 
 /* Trigger a Bus Error exception */
 void m68k_pulse_bus_error(void)
 {
+	m68k_pulse_bus_error_at(0, 0);
+}
+
+void m68k_pulse_bus_error_at(unsigned int address, int write)
+{
+	m68ki_aerr_address = ADDRESS_68K(address);
+	m68ki_aerr_write_mode = write ? MODE_WRITE : MODE_READ;
+	m68ki_aerr_fc = FLAG_S | m68ki_get_address_space();
 	m68ki_exception_bus_error();
 }
 
+/* Read straight from host memory, since the memory callbacks could raise
+ * another bus error in the middle of the RTE that called this
+ */
+uint m68ki_instruction_size(uint pc)
+{
+	unsigned char code[22];    /* The longest instruction there is */
+	char dasm[100];
+	uint have = 0;
+
+	while(have < sizeof(code))
+	{
+		uint length;
+		const unsigned char* span = m68k_read_code_span(ADDRESS_68K(pc + have), &length);
+
+		if(span == NULL || length == 0)
+			break;
+		if(length > sizeof(code) - have)
+			length = sizeof(code) - have;
+		memcpy(code + have, span, length);
+		have += length;
+	}
+
+	return m68k_disassemble_buffer(dasm, pc, code, pc, have, NULL, m68k_get_reg(NULL, M68K_REG_CPU_TYPE)) & 0xff;
+}
+
+void m68k_set_bus_error_rollback(int enable)
+{
+	m68ki_cpu.da_rollback = enable != 0;
+}
+
+void m68k_invalidate_code(unsigned int address, unsigned int size)
+{
+#if M68K_BLOCK_CACHE
+	if(size)
+		m68ki_bcache_invalidate(address, size);
+#else
+	(void)address;
+	(void)size;
+#endif /* M68K_BLOCK_CACHE */
+}
+
 /* Pulse the RESET line on the CPU */
 void m68k_pulse_reset(void)
 {
 	/* Disable the PMMU on reset */
 	m68ki_cpu.pmmu_enabled = 0;
+	pmmu_tlb_flush();
+
+	/* Memory map may change across a reset (e.g. /BOOT shadowing) */
+	m68ki_bcache_flush();
 
 	/* Clear all stop levels and eat up all remaining cycles */
 	CPU_STOPPED = 0;
@@ -1149,6 +1589,11 @@ void m68k_pulse_halt(void)
 	CPU_STOPPED |= STOP_LEVEL_HALT;
 }
 
+int m68k_is_halted(void)
+{
+	return (CPU_STOPPED & STOP_LEVEL_HALT) != 0;
+}
+
 /* Get and set the current CPU context */
 /* This is to allow for multiple CPUs */
 unsigned int m68k_context_size()
@@ -1164,7 +1609,28 @@ unsigned int m68k_get_context(void* dst)
 
 void m68k_set_context(void* src)
 {
-	if(src) m68ki_cpu = *(m68ki_cpu_core*)src;
+	if(src)
+	{
+		m68ki_cpu = *(m68ki_cpu_core*)src;
+
+		/* Softfloat keeps the FPCR's rounding outside the context */
+		fpcr_changed();
+
+		/* The block cache describes the previous context's memory */
+		m68ki_bcache_flush();
+	}
+	else
+		m68ki_bcache_release();
+}
+
+void m68k_restore_context(void* src)
+{
+	m68ki_cpu = *(m68ki_cpu_core*)src;
+	fpcr_changed();
+
+#if M68K_BLOCK_CACHE
+	m68ki_bcache_fetch_size = 0;
+#endif /* M68K_BLOCK_CACHE */
 }
 
 /* ======================================================================== */
@@ -40,6 +40,7 @@ extern "C" {
 #include "m68k.h"
 
 #include <limits.h>
+#include <string.h>
 
 #include <setjmp.h>
 
@@ -325,7 +326,12 @@ typedef uint32 uint64;
 /* ------------------------------ CPU Access ------------------------------ */
 
 /* Access the CPU registers */
+#ifdef M68KI_OPS_CPU_TYPE
+/* Handlers built for one model (see m68kmake) know which it is */
+#define CPU_TYPE         M68KI_OPS_CPU_TYPE
+#else
 #define CPU_TYPE         m68ki_cpu.cpu_type
+#endif
 
 #define REG_DA           m68ki_cpu.dar /* easy access to data and address regs */
 #define REG_DA_SAVE           m68ki_cpu.dar_save
@@ -370,6 +376,7 @@ typedef uint32 uint64;
 #define CPU_INSTR_MODE   m68ki_cpu.instr_mode
 #define CPU_RUN_MODE     m68ki_cpu.run_mode
 
+#define CPU_JUMP_TABLE   m68ki_cpu.jump_table
 #define CYC_INSTRUCTION  m68ki_cpu.cyc_instruction
 #define CYC_EXCEPTION    m68ki_cpu.cyc_exception
 #define CYC_BCC_NOTAKE_B m68ki_cpu.cyc_bcc_notake_b
@@ -382,7 +389,11 @@ typedef uint32 uint64;
 #define CYC_SHIFT        m68ki_cpu.cyc_shift
 #define CYC_RESET        m68ki_cpu.cyc_reset
 #define HAS_PMMU	 m68ki_cpu.has_pmmu
+#if defined(M68KI_OPS_CPU_TYPE) && !(M68KI_OPS_CPU_TYPE & (CPU_TYPE_030 | CPU_TYPE_LC040 | CPU_TYPE_040))
+#define PMMU_ENABLED	 0
+#else
 #define PMMU_ENABLED	 m68ki_cpu.pmmu_enabled
+#endif
 #define RESET_CYCLES	 m68ki_cpu.reset_cycles
 
 
@@ -396,6 +407,7 @@ typedef uint32 uint64;
 #define CALLBACK_PC_CHANGED  m68ki_cpu.pc_changed_callback
 #define CALLBACK_SET_FC      m68ki_cpu.set_fc_callback
 #define CALLBACK_INSTR_HOOK  m68ki_cpu.instr_hook_callback
+#define CALLBACK_PROFILE     m68ki_cpu.profile_callback
 
 
 
@@ -551,6 +563,23 @@ typedef uint32 uint64;
 	#define m68ki_instr_hook(pc)
 #endif /* M68K_INSTRUCTION_HOOK */
 
+#if M68K_PROFILE_HOOK
+	#define m68ki_profile_hook(cycles_before) \
+		if(CALLBACK_PROFILE) \
+			CALLBACK_PROFILE(REG_PPC, REG_IR, (cycles_before) - GET_CYCLES())
+#else
+	#define m68ki_profile_hook(cycles_before) (void)(cycles_before)
+#endif /* M68K_PROFILE_HOOK */
+
+#if M68K_COVERAGE_MAP
+	/* count instructions ran straight on from pc */
+	#define m68ki_coverage_hook(pc, count) \
+		if(m68ki_cpu.coverage_map && m68ki_cpu.coverage_map[((pc) & 0xffffff) >> 1] < (count)) \
+			m68ki_cpu.coverage_map[((pc) & 0xffffff) >> 1] = (count)
+#else
+	#define m68ki_coverage_hook(pc, count)
+#endif /* M68K_COVERAGE_MAP */
+
 #if M68K_MONITOR_PC
 	#if M68K_MONITOR_PC == OPT_SPECIFY_HANDLER
 		#define m68ki_pc_changed(A) M68K_SET_PC_CALLBACK(ADDRESS_68K(A))
@@ -598,6 +627,18 @@ typedef uint32 uint64;
 #endif /* M68K_EMULATE_TRACE */
 
 
+/* Enable or disable rolling back D/A registers on bus error */
+#if M68K_EMULATE_BUS_ERROR_ROLLBACK
+	/* Record D/A register state before each instruction */
+	#define m68ki_save_da() if(m68ki_cpu.da_rollback) memcpy(REG_DA_SAVE, REG_DA, sizeof(REG_DA_SAVE))
+	/* Undo any D/A changes made by the faulting instruction */
+	#define m68ki_restore_da() if(m68ki_cpu.da_rollback) memcpy(REG_DA, REG_DA_SAVE, sizeof(REG_DA_SAVE))
+#else
+	#define m68ki_save_da()
+	#define m68ki_restore_da()
+#endif /* M68K_EMULATE_BUS_ERROR_ROLLBACK */
+
+
 
 /* Address error */
 #if M68K_EMULATE_ADDRESS_ERROR
@@ -605,7 +646,7 @@ typedef uint32 uint64;
 
 /* sigjmp() on Mac OS X and *BSD in general saves signal contexts and is super-slow, use sigsetjmp() to tell it not to */
 #ifdef _BSD_SETJMP_H
-extern sigjmp_buf m68ki_aerr_trap;
+extern M68K_THREAD_LOCAL sigjmp_buf m68ki_aerr_trap;
 #define m68ki_set_address_error_trap(m68k) \
 	if(sigsetjmp(m68ki_aerr_trap, 0) != 0) \
 	{ \
@@ -627,7 +668,7 @@ extern sigjmp_buf m68ki_aerr_trap;
 		siglongjmp(m68ki_aerr_trap, 1); \
 	}
 #else
-extern jmp_buf m68ki_aerr_trap;
+extern M68K_THREAD_LOCAL jmp_buf m68ki_aerr_trap;
 	#define m68ki_set_address_error_trap() \
 		if(setjmp(m68ki_aerr_trap) != 0) \
 		{ \
@@ -929,6 +970,7 @@ typedef struct
 	uint dar[16];      /* Data and Address Registers */
 	uint dar_save[16];  /* Saved Data and Address Registers (pushed onto the
 						   stack when a bus error occurs)*/
+	uint da_rollback;  /* Whether dar_save is kept (m68k_set_bus_error_rollback) */
 	uint ppc;		   /* Previous program counter */
 	uint pc;           /* Program Counter */
 	uint sp[7];        /* User, Interrupt, and Master Stack Pointers */
@@ -986,6 +1028,12 @@ typedef struct
 	uint mmu_tc;
 	uint16 mmu_sr;
 
+	/* PMMU translation cache (see m68kmmu.h) */
+	uint mmu_tlb_tag[M68K_PMMU_TLB_SIZE];
+	uint mmu_tlb_page[M68K_PMMU_TLB_SIZE];
+	uint mmu_tlb_shift;
+
+	void (**jump_table)(void); /* Opcode handlers, specialised for the CPU type if built */
 	const uint8* cyc_instruction;
 	const uint8* cyc_exception;
 
@@ -1000,23 +1048,73 @@ typedef struct
 	void (*pc_changed_callback)(unsigned int new_pc); /* Called when the PC changes by a large amount */
 	void (*set_fc_callback)(unsigned int new_fc);     /* Called when the CPU function code changes */
 	void (*instr_hook_callback)(unsigned int pc);     /* Called every instruction cycle prior to execution */
+	void (*profile_callback)(unsigned int pc, unsigned int ir, int cycles); /* Called after every instruction, or NULL */
+	unsigned char* coverage_map;                      /* Straight-line run lengths by word address, or NULL */
 
 } m68ki_cpu_core;
 
 
-extern m68ki_cpu_core m68ki_cpu;
-extern sint           m68ki_remaining_cycles;
-extern uint           m68ki_tracing;
+extern M68K_THREAD_LOCAL m68ki_cpu_core m68ki_cpu;
+extern M68K_THREAD_LOCAL sint           m68ki_remaining_cycles;
+extern M68K_THREAD_LOCAL uint           m68ki_tracing;
 extern const uint8    m68ki_shift_8_table[];
 extern const uint16   m68ki_shift_16_table[];
 extern const uint     m68ki_shift_32_table[];
 extern const uint8    m68ki_exception_cycle_table[][256];
-extern uint           m68ki_address_space;
+extern M68K_THREAD_LOCAL uint           m68ki_address_space;
 extern const uint8    m68ki_ea_idx_cycle_table[];
 
-extern uint           m68ki_aerr_address;
-extern uint           m68ki_aerr_write_mode;
-extern uint           m68ki_aerr_fc;
+extern M68K_THREAD_LOCAL uint           m68ki_aerr_address;
+extern M68K_THREAD_LOCAL uint           m68ki_aerr_write_mode;
+extern M68K_THREAD_LOCAL uint           m68ki_aerr_fc;
+
+#if M68K_BLOCK_CACHE
+/* Block cache code page tracking and the extension word window of the block
+ * currently executing (see m68kcpu.c)
+ */
+#define M68KI_BCACHE_PAGE_BITS  12
+#define M68KI_BCACHE_PAGE_COUNT 0x1000
+#define M68KI_BCACHE_PAGE(A)    (((A) >> M68KI_BCACHE_PAGE_BITS) & (M68KI_BCACHE_PAGE_COUNT - 1))
+
+extern M68K_THREAD_LOCAL uint8          m68ki_bcache_code_page[];
+extern M68K_THREAD_LOCAL uint           m68ki_bcache_fetch_pc;
+extern M68K_THREAD_LOCAL uint           m68ki_bcache_fetch_size;
+extern M68K_THREAD_LOCAL const uint16*  m68ki_bcache_fetch_words;
+
+void m68ki_bcache_invalidate(uint address, uint size);
+
+/* Drop cached blocks if a CPU write lands in a page holding translated code */
+static inline void m68ki_bcache_check_write(uint address, uint size)
+{
+	if(m68ki_bcache_code_page[M68KI_BCACHE_PAGE(address)] | m68ki_bcache_code_page[M68KI_BCACHE_PAGE(address + size - 1)])
+		m68ki_bcache_invalidate(address, size);
+}
+#else
+#define m68ki_bcache_check_write(A, S)
+#endif /* M68K_BLOCK_CACHE */
+
+/* Size of the instruction at pc, for RTE to step over one a bus error
+ * handler finished; 0 if it isn't all in plain memory (see m68kcpu.c) */
+uint m68ki_instruction_size(uint pc);
+
+#if M68K_IDLE_SKIP
+/* Idle loop detection (see m68kcpu.c) */
+extern M68K_THREAD_LOCAL uint m68ki_idle_countdown;
+extern M68K_THREAD_LOCAL uint m68ki_idle_dirty;
+
+void m68ki_idle_check(void);
+
+/* A loop that writes memory or calls out to the host may yet leave by itself */
+#define m68ki_idle_changed() m68ki_idle_dirty = 1
+
+/* Every so often, look at where a backward branch went */
+#define m68ki_idle_branch(offset) \
+	if((sint)(offset) < 0 && --m68ki_idle_countdown == 0) \
+		m68ki_idle_check()
+#else
+#define m68ki_idle_changed()
+#define m68ki_idle_branch(offset)
+#endif /* M68K_IDLE_SKIP */
 
 /* Forward declarations to keep some of the macros happy */
 static inline uint m68ki_read_16_fc (uint address, uint fc);
@@ -1027,6 +1125,9 @@ static inline void m68ki_check_interrupts(void);            /* ASG: check for in
 /* quick disassembly (used for logging) */
 char* m68ki_disassemble_quick(unsigned int pc, unsigned int cpu_type);
 
+/* Build the disassembler's shared opcode table (called by m68k_init) */
+void m68ki_dasm_init(void);
+
 
 /* ======================================================================== */
 /* =========================== UTILITY FUNCTIONS ========================== */
@@ -1036,6 +1137,7 @@ char* m68ki_disassemble_quick(unsigned int pc, unsigned int cpu_type);
 /* ---------------------------- Read Immediate ---------------------------- */
 
 extern uint pmmu_translate_addr(uint addr_in);
+extern void pmmu_tlb_flush(void);
 
 /* Handles all immediate reads, does address error check, function code setting,
  * and prefetching if they are enabled in m68kconf.h
@@ -1067,6 +1169,14 @@ static inline uint m68ki_read_imm_16(void)
 	return result;
 }
 #else
+#if M68K_BLOCK_CACHE
+	if(REG_PC - m68ki_bcache_fetch_pc < m68ki_bcache_fetch_size)
+	{
+		uint result = m68ki_bcache_fetch_words[(REG_PC - m68ki_bcache_fetch_pc) >> 1];
+		REG_PC += 2;
+		return result;
+	}
+#endif /* M68K_BLOCK_CACHE */
 	REG_PC += 2;
 	return m68k_read_immediate_16(ADDRESS_68K(REG_PC-2));
 #endif /* M68K_EMULATE_PREFETCH */
@@ -1112,6 +1222,17 @@ static inline uint m68ki_read_imm_32(void)
 #else
 	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
 	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+#if M68K_BLOCK_CACHE
+	{
+		uint offset = REG_PC - m68ki_bcache_fetch_pc;
+		if(offset < m68ki_bcache_fetch_size && offset + 4 <= m68ki_bcache_fetch_size)
+		{
+			const uint16* words = m68ki_bcache_fetch_words + (offset >> 1);
+			REG_PC += 4;
+			return ((uint)words[0] << 16) | words[1];
+		}
+	}
+#endif /* M68K_BLOCK_CACHE */
 	REG_PC += 4;
 	return m68k_read_immediate_32(ADDRESS_68K(REG_PC-4));
 #endif /* M68K_EMULATE_PREFETCH */
@@ -1175,6 +1296,8 @@ static inline void m68ki_write_8_fc(uint address, uint fc, uint value)
 #endif
 
 	m68k_write_memory_8(ADDRESS_68K(address), value);
+	m68ki_bcache_check_write(ADDRESS_68K(address), 1);
+	m68ki_idle_changed(); /* auto-disable (see m68kcpu.h) */
 }
 static inline void m68ki_write_16_fc(uint address, uint fc, uint value)
 {
@@ -1188,6 +1311,8 @@ static inline void m68ki_write_16_fc(uint address, uint fc, uint value)
 #endif
 
 	m68k_write_memory_16(ADDRESS_68K(address), value);
+	m68ki_bcache_check_write(ADDRESS_68K(address), 2);
+	m68ki_idle_changed(); /* auto-disable (see m68kcpu.h) */
 }
 static inline void m68ki_write_32_fc(uint address, uint fc, uint value)
 {
@@ -1201,6 +1326,8 @@ static inline void m68ki_write_32_fc(uint address, uint fc, uint value)
 #endif
 
 	m68k_write_memory_32(ADDRESS_68K(address), value);
+	m68ki_bcache_check_write(ADDRESS_68K(address), 4);
+	m68ki_idle_changed(); /* auto-disable (see m68kcpu.h) */
 }
 
 #if M68K_SIMULATE_PD_WRITES
@@ -1216,6 +1343,8 @@ static inline void m68ki_write_32_pd_fc(uint address, uint fc, uint value)
 #endif
 
 	m68k_write_memory_32_pd(ADDRESS_68K(address), value);
+	m68ki_bcache_check_write(ADDRESS_68K(address), 4);
+	m68ki_idle_changed(); /* auto-disable (see m68kcpu.h) */
 }
 #endif
 
@@ -1483,11 +1612,13 @@ static inline void m68ki_jump_vector(uint vector)
 static inline void m68ki_branch_8(uint offset)
 {
 	REG_PC += MAKE_INT_8(offset);
+	m68ki_idle_branch(MAKE_INT_8(offset)); /* auto-disable (see m68kcpu.h) */
 }
 
 static inline void m68ki_branch_16(uint offset)
 {
 	REG_PC += MAKE_INT_16(offset);
+	m68ki_idle_branch(MAKE_INT_16(offset)); /* auto-disable (see m68kcpu.h) */
 }
 
 static inline void m68ki_branch_32(uint offset)
@@ -1697,10 +1828,10 @@ static inline void m68ki_stack_frame_1000(uint pc, uint sr, uint vector)
 	m68ki_fake_push_16();
 
 	/* FAULT ADDRESS */
-	m68ki_push_32(0);
+	m68ki_push_32(m68ki_aerr_address);
 
-	/* SPECIAL STATUS WORD */
-	m68ki_push_16(0);
+	/* SPECIAL STATUS WORD: data fault, R/W, function code */
+	m68ki_push_16(0x1000 | (m68ki_aerr_write_mode == MODE_READ ? 0x0100 : 0) | (m68ki_aerr_fc & 7));
 
 	/* 1000, VECTOR OFFSET */
 	m68ki_push_16(0x8000 | (vector<<2));
@@ -1907,22 +2038,20 @@ static inline void m68ki_exception_privilege_violation(void)
 	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_PRIVILEGE_VIOLATION] - CYC_INSTRUCTION[REG_IR]);
 }
 
-extern jmp_buf m68ki_bus_error_jmp_buf;
+extern M68K_THREAD_LOCAL jmp_buf m68ki_bus_error_jmp_buf;
 
 #define m68ki_check_bus_error_trap() setjmp(m68ki_bus_error_jmp_buf)
 
 /* Exception for bus error */
 static inline void m68ki_exception_bus_error(void)
 {
-	int i;
-
 	/* If we were processing a bus error, address error, or reset,
 	 * while writing the stack frame, this is a catastrophic failure.
-	 * Halt the CPU
+	 * Halt the CPU.  (No bus cycle to signal it: on a map where that faults
+	 * too, it would come straight back here.)
 	 */
 	if(CPU_RUN_MODE == RUN_MODE_BERR_AERR_RESET_WSF)
 	{
-		m68k_read_memory_8(0x00ffff01);
 		CPU_STOPPED = STOP_LEVEL_HALT;
 		return;
 	}
@@ -1931,9 +2060,7 @@ static inline void m68ki_exception_bus_error(void)
 	/* Use up some clock cycles and undo the instruction's cycles */
 	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_BUS_ERROR] - CYC_INSTRUCTION[REG_IR]);
 
-	for (i = 15; i >= 0; i--){
-		REG_DA[i] = REG_DA_SAVE[i];
-	}
+	m68ki_restore_da(); /* auto-disable (see m68kcpu.h) */
 
 	uint sr = m68ki_init_exception();
 
@@ -1999,7 +2126,10 @@ static inline void m68ki_exception_illegal(void)
 				 m68ki_cpu_names[CPU_TYPE], ADDRESS_68K(REG_PPC), REG_IR,
 				 m68ki_disassemble_quick(ADDRESS_68K(REG_PPC))));
 	if (m68ki_illg_callback(REG_IR))
+	{
+	    m68ki_idle_changed(); /* auto-disable (see m68kcpu.h) */
 	    return;
+	}
 
 	sr = m68ki_init_exception();
 
@@ -2035,11 +2165,11 @@ static inline void m68ki_exception_address_error(void)
 
 	/* If we were processing a bus error, address error, or reset,
 	 * while writing the stack frame, this is a catastrophic failure.
-	 * Halt the CPU
+	 * Halt the CPU.  (No bus cycle to signal it: on a map where that faults
+	 * too, it would come straight back here.)
 	 */
 	if(CPU_RUN_MODE == RUN_MODE_BERR_AERR_RESET_WSF)
 	{
-		m68k_read_memory_8(0x00ffff01);
 		CPU_STOPPED = STOP_LEVEL_HALT;
 		return;
 	}
@@ -212,16 +212,19 @@ static void (*g_instruction_table[0x10000])(void);
 static int  g_initialized = 0;
 
 /* Address mask to simulate address lines */
-static unsigned int g_address_mask = 0xffffffff;
-
-static char g_dasm_str[100]; /* string to hold disassembly */
-static char g_helper_str[100]; /* string to hold helpful info */
-static uint g_cpu_pc;        /* program counter */
-static uint g_cpu_ir;        /* instruction register */
-static uint g_cpu_type;
-static uint g_opcode_type;
-static const unsigned char* g_rawop;
-static uint g_rawbasepc;
+static M68K_THREAD_LOCAL unsigned int g_address_mask = 0xffffffff;
+
+static M68K_THREAD_LOCAL char g_dasm_str[100]; /* string to hold disassembly */
+static M68K_THREAD_LOCAL char g_helper_str[100]; /* string to hold helpful info */
+static M68K_THREAD_LOCAL uint g_cpu_pc;        /* program counter */
+static M68K_THREAD_LOCAL uint g_cpu_ir;        /* instruction register */
+static M68K_THREAD_LOCAL uint g_cpu_type;
+static M68K_THREAD_LOCAL uint g_opcode_type;
+static M68K_THREAD_LOCAL const unsigned char* g_rawop;
+static M68K_THREAD_LOCAL uint g_rawbasepc;
+static M68K_THREAD_LOCAL uint g_rawsize;        /* bytes of g_rawop past g_rawbasepc */
+static M68K_THREAD_LOCAL uint g_rawoverrun;     /* instruction ran off the end of g_rawop */
+static M68K_THREAD_LOCAL uint g_branch_target;  /* where a branch or jump goes */
 
 /* used by ops like asr, ror, addq, etc */
 static const uint g_3bit_qdata_table[8] = {8, 1, 2, 3, 4, 5, 6, 7};
@@ -271,11 +274,23 @@ static const char *const g_mmucond[16] =
 		return;								\
 	}
 
+/* Whether length bytes at the pc lie in the raw buffer; notes it if not */
+static int dasm_raw_ok(uint length)
+{
+	uint offset = g_cpu_pc - g_rawbasepc;
+	if(offset > g_rawsize || g_rawsize - offset < length)
+	{
+		g_rawoverrun = 1;
+		return 0;
+	}
+	return 1;
+}
+
 static uint dasm_read_imm_8(uint advance)
 {
 	uint result;
 	if (g_rawop)
-		result = g_rawop[g_cpu_pc + 1 - g_rawbasepc];
+		result = dasm_raw_ok(2) ? g_rawop[g_cpu_pc + 1 - g_rawbasepc] : 0;
 	else
 		result = m68k_read_disassembler_16(g_cpu_pc & g_address_mask) & 0xff;
 	g_cpu_pc += advance;
@@ -286,7 +301,8 @@ static uint dasm_read_imm_16(uint advance)
 {
 	uint result;
 	if (g_rawop)
-		result = (g_rawop[g_cpu_pc + 0 - g_rawbasepc] << 8) |
+		result = !dasm_raw_ok(2) ? 0 :
+		         (g_rawop[g_cpu_pc + 0 - g_rawbasepc] << 8) |
 		          g_rawop[g_cpu_pc + 1 - g_rawbasepc];
 	else
 		result = m68k_read_disassembler_16(g_cpu_pc & g_address_mask) & 0xffff;
@@ -298,7 +314,8 @@ static uint dasm_read_imm_32(uint advance)
 {
 	uint result;
 	if (g_rawop)
-		result = (g_rawop[g_cpu_pc + 0 - g_rawbasepc] << 24) |
+		result = !dasm_raw_ok(4) ? 0 :
+		         (g_rawop[g_cpu_pc + 0 - g_rawbasepc] << 24) |
 		         (g_rawop[g_cpu_pc + 1 - g_rawbasepc] << 16) |
 		         (g_rawop[g_cpu_pc + 2 - g_rawbasepc] << 8) |
 		          g_rawop[g_cpu_pc + 3 - g_rawbasepc];
@@ -316,6 +333,32 @@ static uint dasm_read_imm_32(uint advance)
 #define peek_imm_16() dasm_read_imm_16(0)
 #define peek_imm_32() dasm_read_imm_32(0)
 
+/* Note where a branch goes, for m68k_disassemble_buffer() */
+static uint branch_target(uint target)
+{
+	g_branch_target = target;
+	return target;
+}
+
+/* The same for jumps, whose target is known from the ea only when it is
+ * absolute or pc-relative (call before reading the ea)
+ */
+static void jump_target(uint instruction)
+{
+	switch(instruction & 0x3f)
+	{
+		case 0x38:
+			g_branch_target = make_int_16(peek_imm_16()) & 0xffffffff;
+			break;
+		case 0x39:
+			g_branch_target = peek_imm_32();
+			break;
+		case 0x3a:
+			g_branch_target = (g_cpu_pc + make_int_16(peek_imm_16())) & 0xffffffff;
+			break;
+	}
+}
+
 /* Fake a split interface */
 #define get_ea_mode_str_8(instruction) get_ea_mode_str(instruction, 0)
 #define get_ea_mode_str_16(instruction) get_ea_mode_str(instruction, 1)
@@ -354,7 +397,7 @@ static int make_int_32(int value)
 /* Get string representation of hex values */
 static char* make_signed_hex_str_8(uint val)
 {
-	static char str[20];
+	static M68K_THREAD_LOCAL char str[20];
 
 	val &= 0xff;
 
@@ -370,7 +413,7 @@ static char* make_signed_hex_str_8(uint val)
 
 static char* make_signed_hex_str_16(uint val)
 {
-	static char str[20];
+	static M68K_THREAD_LOCAL char str[20];
 
 	val &= 0xffff;
 
@@ -386,7 +429,7 @@ static char* make_signed_hex_str_16(uint val)
 
 static char* make_signed_hex_str_32(uint val)
 {
-	static char str[20];
+	static M68K_THREAD_LOCAL char str[20];
 
 	val &= 0xffffffff;
 
@@ -404,7 +447,7 @@ static char* make_signed_hex_str_32(uint val)
 /* make string of immediate value */
 static char* get_imm_str_s(uint size)
 {
-	static char str[15];
+	static M68K_THREAD_LOCAL char str[24];
 	if(size == 0)
 		sprintf(str, "#%s", make_signed_hex_str_8(read_imm_8()));
 	else if(size == 1)
@@ -416,7 +459,7 @@ static char* get_imm_str_s(uint size)
 
 static char* get_imm_str_u(uint size)
 {
-	static char str[15];
+	static M68K_THREAD_LOCAL char str[24];
 	if(size == 0)
 		sprintf(str, "#$%x", read_imm_8() & 0xff);
 	else if(size == 1)
@@ -429,9 +472,10 @@ static char* get_imm_str_u(uint size)
 /* Make string of effective address mode */
 static char* get_ea_mode_str(uint instruction, uint size)
 {
-	static char b1[64];
-	static char b2[64];
-	static char* mode = b2;
+	static M68K_THREAD_LOCAL char b1[64];
+	static M68K_THREAD_LOCAL char b2[64];
+	static M68K_THREAD_LOCAL uint use_b1;
+	char* mode;
 	uint extension;
 	uint base;
 	uint outer;
@@ -443,7 +487,8 @@ static char* get_ea_mode_str(uint instruction, uint size)
 	uint temp_value;
 
 	/* Switch buffers so we don't clobber on a double-call to this function */
-	mode = mode == b1 ? b2 : b1;
+	use_b1 ^= 1;
+	mode = use_b1 ? b1 : b2;
 
 	switch(instruction & 0x3f)
 	{
@@ -961,20 +1006,20 @@ static void d68000_asl_ea(void)
 static void d68000_bcc_8(void)
 {
 	uint temp_pc = g_cpu_pc;
-	sprintf(g_dasm_str, "b%-2s     $%x", g_cc[(g_cpu_ir>>8)&0xf], temp_pc + make_int_8(g_cpu_ir));
+	sprintf(g_dasm_str, "b%-2s     $%x", g_cc[(g_cpu_ir>>8)&0xf], branch_target(temp_pc + make_int_8(g_cpu_ir)));
 }
 
 static void d68000_bcc_16(void)
 {
 	uint temp_pc = g_cpu_pc;
-	sprintf(g_dasm_str, "b%-2s     $%x", g_cc[(g_cpu_ir>>8)&0xf], temp_pc + make_int_16(read_imm_16()));
+	sprintf(g_dasm_str, "b%-2s     $%x", g_cc[(g_cpu_ir>>8)&0xf], branch_target(temp_pc + make_int_16(read_imm_16())));
 }
 
 static void d68020_bcc_32(void)
 {
 	uint temp_pc = g_cpu_pc;
 	LIMIT_CPU_TYPES(M68020_PLUS);
-	sprintf(g_dasm_str, "b%-2s     $%x; (2+)", g_cc[(g_cpu_ir>>8)&0xf], temp_pc + read_imm_32());
+	sprintf(g_dasm_str, "b%-2s     $%x; (2+)", g_cc[(g_cpu_ir>>8)&0xf], branch_target(temp_pc + read_imm_32()));
 }
 
 static void d68000_bchg_r(void)
@@ -1176,20 +1221,20 @@ static void d68020_bftst(void)
 static void d68000_bra_8(void)
 {
 	uint temp_pc = g_cpu_pc;
-	sprintf(g_dasm_str, "bra     $%x", temp_pc + make_int_8(g_cpu_ir));
+	sprintf(g_dasm_str, "bra     $%x", branch_target(temp_pc + make_int_8(g_cpu_ir)));
 }
 
 static void d68000_bra_16(void)
 {
 	uint temp_pc = g_cpu_pc;
-	sprintf(g_dasm_str, "bra     $%x", temp_pc + make_int_16(read_imm_16()));
+	sprintf(g_dasm_str, "bra     $%x", branch_target(temp_pc + make_int_16(read_imm_16())));
 }
 
 static void d68020_bra_32(void)
 {
 	uint temp_pc = g_cpu_pc;
 	LIMIT_CPU_TYPES(M68020_PLUS);
-	sprintf(g_dasm_str, "bra     $%x; (2+)", temp_pc + read_imm_32());
+	sprintf(g_dasm_str, "bra     $%x; (2+)", branch_target(temp_pc + read_imm_32()));
 }
 
 static void d68000_bset_r(void)
@@ -1206,14 +1251,14 @@ static void d68000_bset_s(void)
 static void d68000_bsr_8(void)
 {
 	uint temp_pc = g_cpu_pc;
-	sprintf(g_dasm_str, "bsr     $%x", temp_pc + make_int_8(g_cpu_ir));
+	sprintf(g_dasm_str, "bsr     $%x", branch_target(temp_pc + make_int_8(g_cpu_ir)));
 	SET_OPCODE_FLAGS(DASMFLAG_STEP_OVER);
 }
 
 static void d68000_bsr_16(void)
 {
 	uint temp_pc = g_cpu_pc;
-	sprintf(g_dasm_str, "bsr     $%x", temp_pc + make_int_16(read_imm_16()));
+	sprintf(g_dasm_str, "bsr     $%x", branch_target(temp_pc + make_int_16(read_imm_16())));
 	SET_OPCODE_FLAGS(DASMFLAG_STEP_OVER);
 }
 
@@ -1221,7 +1266,7 @@ static void d68020_bsr_32(void)
 {
 	uint temp_pc = g_cpu_pc;
 	LIMIT_CPU_TYPES(M68020_PLUS);
-	sprintf(g_dasm_str, "bsr     $%x; (2+)", temp_pc + read_imm_32());
+	sprintf(g_dasm_str, "bsr     $%x; (2+)", branch_target(temp_pc + read_imm_32()));
 	SET_OPCODE_FLAGS(DASMFLAG_STEP_OVER);
 }
 
@@ -1604,14 +1649,14 @@ static void d68040_cpush(void)
 static void d68000_dbra(void)
 {
 	uint temp_pc = g_cpu_pc;
-	sprintf(g_dasm_str, "dbra    D%d, $%x", g_cpu_ir & 7, temp_pc + make_int_16(read_imm_16()));
+	sprintf(g_dasm_str, "dbra    D%d, $%x", g_cpu_ir & 7, branch_target(temp_pc + make_int_16(read_imm_16())));
 	SET_OPCODE_FLAGS(DASMFLAG_STEP_OVER);
 }
 
 static void d68000_dbcc(void)
 {
 	uint temp_pc = g_cpu_pc;
-	sprintf(g_dasm_str, "db%-2s    D%d, $%x", g_cc[(g_cpu_ir>>8)&0xf], g_cpu_ir & 7, temp_pc + make_int_16(read_imm_16()));
+	sprintf(g_dasm_str, "db%-2s    D%d, $%x", g_cc[(g_cpu_ir>>8)&0xf], g_cpu_ir & 7, branch_target(temp_pc + make_int_16(read_imm_16())));
 	SET_OPCODE_FLAGS(DASMFLAG_STEP_OVER);
 }
 
@@ -1929,11 +1974,13 @@ static void d68040_fpu(void)
 
 static void d68000_jmp(void)
 {
+	jump_target(g_cpu_ir);
 	sprintf(g_dasm_str, "jmp     %s", get_ea_mode_str_32(g_cpu_ir));
 }
 
 static void d68000_jsr(void)
 {
+	jump_target(g_cpu_ir);
 	sprintf(g_dasm_str, "jsr     %s", get_ea_mode_str_32(g_cpu_ir));
 	SET_OPCODE_FLAGS(DASMFLAG_STEP_OVER);
 }
@@ -3261,14 +3308,14 @@ static void d68851_pbcc16(void)
 {
 	uint32 temp_pc = g_cpu_pc;
 
-	sprintf(g_dasm_str, "pb%s %x", g_mmucond[g_cpu_ir&0xf], temp_pc + make_int_16(read_imm_16()));
+	sprintf(g_dasm_str, "pb%s %x", g_mmucond[g_cpu_ir&0xf], branch_target(temp_pc + make_int_16(read_imm_16())));
 }
 
 static void d68851_pbcc32(void)
 {
 	uint32 temp_pc = g_cpu_pc;
 
-	sprintf(g_dasm_str, "pb%s %x", g_mmucond[g_cpu_ir&0xf], temp_pc + make_int_32(read_imm_32()));
+	sprintf(g_dasm_str, "pb%s %x", g_mmucond[g_cpu_ir&0xf], branch_target(temp_pc + make_int_32(read_imm_32())));
 }
 
 static void d68851_pdbcc(void)
@@ -3276,7 +3323,7 @@ static void d68851_pdbcc(void)
 	uint32 temp_pc = g_cpu_pc;
 	uint16 modes = read_imm_16();
 
-	sprintf(g_dasm_str, "pb%s %x", g_mmucond[modes&0xf], temp_pc + make_int_16(read_imm_16()));
+	sprintf(g_dasm_str, "pb%s %x", g_mmucond[modes&0xf], branch_target(temp_pc + make_int_16(read_imm_16())));
 }
 
 // PScc:  0000000000xxxxxx
@@ -3771,9 +3818,21 @@ unsigned int m68k_disassemble(char* str_buff, unsigned int pc, unsigned int cpu_
 	return COMBINE_OPCODE_FLAGS(g_cpu_pc - pc);
 }
 
+/* Build the opcode table shared by all threads; m68k_init() calls this once
+ * before any other thread can disassemble.
+ */
+void m68ki_dasm_init(void)
+{
+	if(!g_initialized)
+	{
+		build_opcode_table();
+		g_initialized = 1;
+	}
+}
+
 char* m68ki_disassemble_quick(unsigned int pc, unsigned int cpu_type)
 {
-	static char buff[100];
+	static M68K_THREAD_LOCAL char buff[100];
 	buff[0] = 0;
 	m68k_disassemble(buff, pc, cpu_type);
 	return buff;
@@ -3786,11 +3845,31 @@ unsigned int m68k_disassemble_raw(char* str_buff, unsigned int pc, const unsigne
 
 	g_rawop = opdata;
 	g_rawbasepc = pc;
+	g_rawsize = 0xffffffff;
 	result = m68k_disassemble(str_buff, pc, cpu_type);
 	g_rawop = NULL;
 	return result;
 }
 
+unsigned int m68k_disassemble_buffer(char* str_buff, unsigned int pc, const unsigned char* buffer, unsigned int base, unsigned int size, unsigned int* target, unsigned int cpu_type)
+{
+	unsigned int result;
+
+	g_rawop = buffer;
+	g_rawbasepc = base;
+	g_rawsize = size;
+	g_rawoverrun = 0;
+	g_branch_target = M68K_NO_TARGET;
+	result = m68k_disassemble(str_buff, pc, cpu_type);
+	g_rawop = NULL;
+
+	if(g_rawoverrun)
+		return 0;
+	if(target)
+		*target = g_branch_target;
+	return result;
+}
+
 /* Check if the instruction is a valid one */
 unsigned int m68k_is_valid_instruction(unsigned int instruction, unsigned int cpu_type)
 {
@@ -1,3 +1,4 @@
+#include <float.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -60,6 +61,103 @@ static inline floatx80 double_to_fx80(double in)
 	return float64_to_floatx80(*d);
 }
 
+#if M68K_FPU_NATIVE_DOUBLE && FLT_EVAL_METHOD == 0
+
+enum { FPU_NATIVE_ADD, FPU_NATIVE_SUB, FPU_NATIVE_MUL, FPU_NATIVE_DIV, FPU_NATIVE_SQRT };
+
+/* Convert to a host double if fx is zero, or normal with a significand and
+ * exponent that fit the rounding precision (32 or 64)
+ */
+static inline int fx80_to_native(floatx80 fx, int precision, double *out)
+{
+	uint64 bits = (uint64)(fx.high & 0x8000) << 48;
+	int exp = fx.high & 0x7fff;
+
+	if (exp != 0 || fx.low != 0)
+	{
+		if (!(fx.low & U64(0x8000000000000000)))
+			return 0;
+		if (precision == 64 ? (exp < 0x3fff - 1022 || exp > 0x3fff + 1023 || (fx.low & 0x7ff))
+		                    : (exp < 0x3fff - 126 || exp > 0x3fff + 127 || (fx.low & U64(0xffffffffff))))
+			return 0;
+		bits |= ((uint64)(exp - 0x3fff + 1023) << 52) | ((fx.low >> 11) & DOUBLE_MANTISSA);
+	}
+
+	memcpy(out, &bits, sizeof(bits));
+	return 1;
+}
+
+static inline floatx80 native_to_fx80(double in)
+{
+	floatx80 fx;
+	uint64 bits;
+
+	memcpy(&bits, &in, sizeof(bits));
+	fx.high = (bits >> 48) & 0x8000;
+	fx.low = 0;
+	if (bits & DOUBLE_EXPONENT)
+	{
+		fx.high |= ((bits & DOUBLE_EXPONENT) >> 52) - 1023 + 0x3fff;
+		fx.low = U64(0x8000000000000000) | ((bits & DOUBLE_MANTISSA) << 11);
+	}
+	return fx;
+}
+
+/* Do an operation in single or double precision on the host, if that gives
+ * exactly what softfloat would.  With both rounding to nearest, it does when
+ * the operands fit the precision and the result is a normal number in it (or
+ * an exact zero), as each rounds the exact result once; single precision
+ * results are rounded from double, which is exact for these operations.
+ * Returns 0, leaving result alone, to have softfloat do it.
+ */
+static int fpu_native(int op, floatx80 a, floatx80 b, floatx80 *result)
+{
+	int precision = floatx80_rounding_precision;
+	double x, y = 0, r;
+
+	if (precision == 80 || float_rounding_mode != float_round_nearest_even)
+		return 0;
+	if (!fx80_to_native(a, precision, &x) || (op != FPU_NATIVE_SQRT && !fx80_to_native(b, precision, &y)))
+		return 0;
+
+	switch (op)
+	{
+		case FPU_NATIVE_ADD:	r = x + y;		break;
+		case FPU_NATIVE_SUB:	r = x - y;		break;
+		case FPU_NATIVE_MUL:	r = x * y;		break;
+		case FPU_NATIVE_DIV:	r = x / y;		break;
+		default:				r = sqrt(x);	break;
+	}
+	if (precision == 32)
+		r = (float)r;
+
+	// A product or quotient may only have come out as zero by underflowing
+	if (r == 0)
+	{
+		if ((op == FPU_NATIVE_MUL && x != 0 && y != 0) || (op == FPU_NATIVE_DIV && x != 0))
+			return 0;
+	}
+	else if (!(fabs(r) > (precision == 64 ? DBL_MIN : FLT_MIN) && fabs(r) <= (precision == 64 ? DBL_MAX : FLT_MAX)))
+		return 0;
+
+	*result = native_to_fx80(r);
+	return 1;
+}
+
+#else
+#define fpu_native(op, a, b, result) 0
+#endif /* M68K_FPU_NATIVE_DOUBLE */
+
+/* Pass the FPCR's rounding mode and precision on to softfloat */
+static void fpcr_changed(void)
+{
+	static const int8 precision[4] = { 80, 32, 64, 80 };
+
+	// JFF: need to update rounding mode from softfloat module
+	float_rounding_mode = (REG_FPCR >> 4) & 0x3;
+	floatx80_rounding_precision = precision[(REG_FPCR >> 6) & 0x3];
+}
+
 static inline floatx80 load_extended_float80(uint32 ea)
 {
 	uint32 d1,d2;
@@ -1207,7 +1305,8 @@ static void fpgen_rm_reg(uint16 w2)
 		}
 		case 0x04:		// FSQRT
 		{
-			REG_FP[dst] = floatx80_sqrt(source);
+			if (!fpu_native(FPU_NATIVE_SQRT, source, source, &REG_FP[dst]))
+				REG_FP[dst] = floatx80_sqrt(source);
 			SET_CONDITION_CODES(REG_FP[dst]);
 			USE_CYCLES(109);
 			break;
@@ -1241,14 +1340,16 @@ static void fpgen_rm_reg(uint16 w2)
   	    case 0x60:		// FSDIVS (JFF) (source has already been converted to floatx80)
 		case 0x20:		// FDIV
 		{
-			REG_FP[dst] = floatx80_div(REG_FP[dst], source);
+			if (!fpu_native(FPU_NATIVE_DIV, REG_FP[dst], source, &REG_FP[dst]))
+				REG_FP[dst] = floatx80_div(REG_FP[dst], source);
 		    SET_CONDITION_CODES(REG_FP[dst]); // JFF
 			USE_CYCLES(43);
 			break;
 		}
 		case 0x22:		// FADD
 		{
-			REG_FP[dst] = floatx80_add(REG_FP[dst], source);
+			if (!fpu_native(FPU_NATIVE_ADD, REG_FP[dst], source, &REG_FP[dst]))
+				REG_FP[dst] = floatx80_add(REG_FP[dst], source);
 			SET_CONDITION_CODES(REG_FP[dst]);
 			USE_CYCLES(9);
 			break;
@@ -1256,7 +1357,8 @@ static void fpgen_rm_reg(uint16 w2)
    		case 0x63:		// FSMULS (JFF) (source has already been converted to floatx80)
 		case 0x23:		// FMUL
 		{
-			REG_FP[dst] = floatx80_mul(REG_FP[dst], source);
+			if (!fpu_native(FPU_NATIVE_MUL, REG_FP[dst], source, &REG_FP[dst]))
+				REG_FP[dst] = floatx80_mul(REG_FP[dst], source);
 			SET_CONDITION_CODES(REG_FP[dst]);
 			USE_CYCLES(11);
 			break;
@@ -1270,7 +1372,8 @@ static void fpgen_rm_reg(uint16 w2)
 		}
 		case 0x28:		// FSUB
 		{
-			REG_FP[dst] = floatx80_sub(REG_FP[dst], source);
+			if (!fpu_native(FPU_NATIVE_SUB, REG_FP[dst], source, &REG_FP[dst]))
+				REG_FP[dst] = floatx80_sub(REG_FP[dst], source);
 			SET_CONDITION_CODES(REG_FP[dst]);
 			USE_CYCLES(9);
 			break;
@@ -1378,8 +1481,7 @@ static void fmove_fpcr(uint16 w2)
       if (reg & 4) 
 		{
 		  REG_FPCR = READ_EA_32(ea);
-		  // JFF: need to update rounding mode from softfloat module
-		  float_rounding_mode = (REG_FPCR >> 4) & 0x3;
+		  fpcr_changed();
 		}
 		if (reg & 2) REG_FPSR = READ_EA_32(ea);
 		if (reg & 1) REG_FPIAR = READ_EA_32(ea);
@@ -1644,6 +1746,7 @@ static void do_frestore_null()
 	REG_FPCR = 0;
 	REG_FPSR = 0;
 	REG_FPIAR = 0;
+	fpcr_changed();
 	for (i = 0; i < 8; i++)
 	{
 		REG_FP[i].high = 0x7fff;
@@ -40,11 +40,17 @@
  * It requires an input file to function (default m68k_in.c), but you can
  * specify your own like so:
  *
- * m68kmake <output path> <input file>
+ * m68kmake <output path> <input file> [model ...]
  *
  * where output path is the path where the output files should be placed, and
  * input file is the file to use for input.
  *
+ * Each model named (000, 008, 010, ec020, 020, ec030, 030, ec040, lc040 or
+ * 040) also gets an m68kops_<model>.c, which builds the opcode handlers again
+ * for that CPU alone.  CPU_TYPE is a constant there, so the compiler drops
+ * the checks for other models from every handler; m68k_set_cpu_type() uses
+ * the model's table in place of the generic one.
+ *
  * If you modify the input file greatly from its released form, you may have
  * to tweak the configuration section a bit since I'm using static allocation
  * to keep things simple.
@@ -88,11 +94,13 @@ static const char g_version[] = "4.60";
 #define EA_ALLOWED_LENGTH                11	/* Max length of ea allowed str */
 #define MAX_OPCODE_INPUT_TABLE_LENGTH  1000	/* Max length of opcode handler tbl */
 #define MAX_OPCODE_OUTPUT_TABLE_LENGTH 3000	/* Max length of opcode handler tbl */
+#define MAX_MODELS                       10	/* Max number of single-model sets */
 
 /* Default filenames */
 #define FILENAME_INPUT      "m68k_in.c"
 #define FILENAME_PROTOTYPE  "m68kops.h"
 #define FILENAME_TABLE      "m68kops.c"
+#define FILENAME_MODEL      "m68kops_%s.c"
 
 
 /* Identifier sequences recognized by this program */
@@ -245,6 +253,9 @@ void generate_opcode_cc_variants(FILE* filep, body_struct* body, replace_struct*
 void process_opcode_handlers(FILE* filep);
 void populate_table(void);
 void read_insert(char* insert);
+const char* model_type(const char* model);
+void write_model_files(char* output_path);
+void print_model_table(FILE* filep);
 
 
 
@@ -255,6 +266,25 @@ void read_insert(char* insert);
 /* Name of the input file */
 char g_input_filename[M68K_MAX_PATH] = FILENAME_INPUT;
 
+/* CPU models that get their own opcode handler set */
+const char* g_models[MAX_MODELS];
+int g_num_models = 0;
+
+/* Model names as given to m68kmake, and their CPU_TYPE_xxx suffixes */
+const char *const g_model_names[MAX_MODELS][2] =
+{
+	{  "000",   "000"},
+	{  "008",   "008"},
+	{  "010",   "010"},
+	{"ec020", "EC020"},
+	{  "020",   "020"},
+	{"ec030", "EC030"},
+	{  "030",   "030"},
+	{"ec040", "EC040"},
+	{"lc040", "LC040"},
+	{  "040",   "040"},
+};
+
 /* File handles */
 FILE* g_input_file = NULL;
 FILE* g_prototype_file = NULL;
@@ -1209,6 +1239,60 @@ void read_insert(char* insert)
 
 
 
+/* Find a model's CPU_TYPE_xxx suffix, or NULL if it isn't one */
+const char* model_type(const char* model)
+{
+	int i;
+
+	for(i=0;i<MAX_MODELS;i++)
+		if(strcmp(g_model_names[i][0], model) == 0)
+			return g_model_names[i][1];
+	return NULL;
+}
+
+/* Write the files that build m68kops.c again for each single model */
+void write_model_files(char* output_path)
+{
+	char filename[M68K_MAX_PATH*2];
+	FILE* filep;
+	int i;
+
+	for(i=0;i<g_num_models;i++)
+	{
+		sprintf(filename, "%s" FILENAME_MODEL, output_path, g_models[i]);
+		if((filep = fopen(filename, "wt")) == NULL)
+			perror_exit("Unable to create model file (%s)\n", filename);
+
+		fprintf(filep, "/* The opcode handlers again, for the 68%s alone.  CPU_TYPE is a constant\n", model_type(g_models[i]));
+		fprintf(filep, " * here, so the checks for other models compile away.\n */\n\n");
+		fprintf(filep, "#define M68KI_OPS_CPU_TYPE CPU_TYPE_%s\n", model_type(g_models[i]));
+		fprintf(filep, "#define M68KI_OPS_SUFFIX   _%s\n\n", g_models[i]);
+		fprintf(filep, "#include \"%s\"\n", FILENAME_TABLE);
+		fclose(filep);
+	}
+}
+
+/* List the single-model sets for m68k_set_cpu_type() */
+void print_model_table(FILE* filep)
+{
+	int i;
+
+	fprintf(filep, "#ifndef M68KI_OPS_CPU_TYPE\n");
+	for(i=0;i<g_num_models;i++)
+	{
+		fprintf(filep, "extern void (*m68ki_instruction_jump_table_%s[0x10000])(void);\n", g_models[i]);
+		fprintf(filep, "void m68ki_build_opcode_table_%s(void);\n", g_models[i]);
+	}
+	fprintf(filep, "\n/* Opcode handler sets built for a single CPU model */\n");
+	fprintf(filep, "const m68ki_ops_model m68ki_ops_models[] =\n{\n");
+	for(i=0;i<g_num_models;i++)
+		fprintf(filep, "\t{CPU_TYPE_%s, m68ki_instruction_jump_table_%s, m68ki_build_opcode_table_%s},\n",
+			model_type(g_models[i]), g_models[i], g_models[i]);
+	fprintf(filep, "\t{0, NULL, NULL}\n};\n#endif\n\n\n");
+}
+
+
+
 /* ======================================================================== */
 /* ============================= MAIN FUNCTION ============================ */
 /* ======================================================================== */
@@ -1236,6 +1320,7 @@ int main(int argc, char **argv)
 	int ophandler_footer_read = 0;
 	int table_body_read = 0;
 	int ophandler_body_read = 0;
+	int i;
 
 	printf("\n\tMusashi v%s 68000, 68008, 68010, 68EC020, 68020, 68EC030, 68030, 68EC040, 68040 emulator\n", g_version);
 	printf("\t\tCopyright Karl Stenerud (kstenerud@gmail.com)\n\n");
@@ -1254,6 +1339,16 @@ int main(int argc, char **argv)
 			strcpy(g_input_filename, argv[2]);
 	}
 
+	/* Any further arguments are models to build handler sets for */
+	for(i=3;i<argc;i++)
+	{
+		if(model_type(argv[i]) == NULL)
+			error_exit("Unknown CPU model: %s", argv[i]);
+		if(g_num_models == MAX_MODELS)
+			error_exit("Too many CPU models");
+		g_models[g_num_models++] = argv[i];
+	}
+
 
 	/* Open the files we need */
 	sprintf(filename, "%s%s", output_path, FILENAME_PROTOTYPE);
@@ -1377,6 +1472,7 @@ int main(int argc, char **argv)
 			if(!ophandler_body_read)
 				error_exit("Missing opcode handler body");
 
+			print_model_table(g_table_file);
 			fprintf(g_table_file, "%s\n\n", table_header_insert);
 			print_opcode_output_table(g_table_file);
 			fprintf(g_table_file, "%s\n\n", table_footer_insert);
@@ -1396,6 +1492,8 @@ int main(int argc, char **argv)
 	fclose(g_table_file);
 	fclose(g_input_file);
 
+	write_model_files(output_path);
+
 	printf("Generated %d opcode handlers from %d primitives\n", g_num_functions, g_num_primitives);
 
 	return 0;
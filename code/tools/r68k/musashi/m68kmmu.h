@@ -7,10 +7,43 @@
     Visit http://mamedev.org for licensing and usage restrictions.
 */
 
+#define PMMU_TLB_INVALID	0xffffffff
+
 /*
-	pmmu_translate_addr: perform 68851/68030-style PMMU address translation
+	pmmu_tlb_shift: the page size the TLB caches translations by, as a shift
+
+	Translations are cached by the block a full walk down to table C maps;
+	a walk that ends early maps a bigger, aligned block, so that is always
+	safe.  Pages are at least 256 bytes on a real PMMU, and a TC that uses no
+	bits at all (as after reset) still gets a shift the C shifts can take.
 */
-uint pmmu_translate_addr(uint addr_in)
+static uint pmmu_tlb_shift(void)
+{
+	uint used = ((m68ki_cpu.mmu_tc>>16)&0xf) + ((m68ki_cpu.mmu_tc>>12)&0xf) + ((m68ki_cpu.mmu_tc>>8)&0xf) + ((m68ki_cpu.mmu_tc>>4)&0xf);
+
+	if (used < 1)
+		return 31;
+	return used > 24 ? 8 : 32 - used;
+}
+
+/*
+	pmmu_tlb_flush: forget every cached translation, for when the tables or
+	the registers pointing at them change
+*/
+void pmmu_tlb_flush(void)
+{
+	uint i;
+
+	for (i = 0; i < M68K_PMMU_TLB_SIZE; i++)
+		m68ki_cpu.mmu_tlb_tag[i] = PMMU_TLB_INVALID;
+
+	m68ki_cpu.mmu_tlb_shift = pmmu_tlb_shift();
+}
+
+/*
+	pmmu_walk_tables: perform 68851/68030-style PMMU address translation
+*/
+static uint pmmu_walk_tables(uint addr_in)
 {
 	uint32 addr_out, tbl_entry = 0, tbl_entry2, tamode = 0, tbmode = 0, tcmode = 0;
 	uint root_aptr, root_limit, tofs, is, abits, bbits, cbits;
@@ -171,6 +204,30 @@ uint pmmu_translate_addr(uint addr_in)
 	return addr_out;
 }
 
+/*
+	pmmu_translate_addr: translate through the TLB, walking the tables on a miss
+*/
+uint pmmu_translate_addr(uint addr_in)
+{
+	uint page = addr_in >> m68ki_cpu.mmu_tlb_shift;
+	uint offset = addr_in & ((1u << m68ki_cpu.mmu_tlb_shift) - 1);
+	uint slot = page & (M68K_PMMU_TLB_SIZE - 1);
+	uint tag = (page << 1) | (FLAG_S ? 1 : 0);
+	uint addr_out;
+
+	if (m68ki_cpu.mmu_tlb_tag[slot] == tag)
+	{
+		return m68ki_cpu.mmu_tlb_page[slot] + offset;
+	}
+
+	addr_out = pmmu_walk_tables(addr_in);
+
+	m68ki_cpu.mmu_tlb_tag[slot] = tag;
+	m68ki_cpu.mmu_tlb_page[slot] = addr_out - offset;
+
+	return addr_out;
+}
+
 /*
 
 	m68881_mmu_ops: COP 0 MMU opcode handling
@@ -208,12 +265,14 @@ void m68881_mmu_ops(void)
 				}
 				else if ((modes & 0xe200) == 0x2000)	// PFLUSH
 				{
-					fprintf(stderr,"680x0: unhandled PFLUSH PC=%x\n", REG_PC);
+					// Whatever the function code and address, flushing
+					// everything is always correct
+					pmmu_tlb_flush();
 					return;
 				}
 				else if (modes == 0xa000)	// PFLUSHR
 				{
-					fprintf(stderr,"680x0: unhandled PFLUSHR\n");
+					pmmu_tlb_flush();
 					return;
 				}
 				else if (modes == 0x2800)	// PVALID (FORMAT 1)
@@ -291,6 +350,13 @@ void m68881_mmu_ops(void)
 										fprintf(stderr,"680x0: PMOVE to unknown MMU register %x, PC %x\n", (modes>>10) & 7, REG_PC);
 										break;
 								}
+
+								// The 68030's FD bit asks to keep the ATC, but
+								// not if the page size it is cached by changed
+								if (!(modes & 0x100) || ((modes>>13) & 0x7) == 2 || pmmu_tlb_shift() != m68ki_cpu.mmu_tlb_shift)
+								{
+									pmmu_tlb_flush();
+								}
 							}
 							break;
 
@@ -10,7 +10,7 @@
 extern "C" {
 #endif
 
-extern rosco::m68k::emu::AddressDecoder *sys_mem;
+extern thread_local rosco::m68k::emu::AddressDecoder *sys_mem;
 
 void resetMachineHandler() {
     sys_mem->reset();
@@ -3,12 +3,14 @@
 //
 
 #include "AddressDecoder.h"
+#include "Tracer.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern rosco::m68k::emu::AddressDecoder *sys_mem;
+extern thread_local rosco::m68k::emu::AddressDecoder *sys_mem;
+extern thread_local rosco::m68k::emu::Tracer *sys_trace;
 
 /* Read from anywhere */
 unsigned int  m68k_read_memory_8(unsigned int address) {
@@ -58,18 +60,36 @@ unsigned int m68k_read_disassembler_32 (unsigned int address) {
     return sys_mem->read32(address);
 }
 
+/* Code for the block cache to translate, straight from RAM or ROM */
+const unsigned char* m68k_read_code_span(unsigned int address, unsigned int *length) {
+    std::uint32_t available;
+    const std::uint8_t *span = sys_mem->readSpan(address, available);
+
+    *length = available;
+    return span;
+}
+
 /* Write to anywhere */
 void m68k_write_memory_8(unsigned int address, unsigned int value) {
+    if (sys_trace) {
+        sys_trace->write(address, value & 0xFF, 1);
+    }
     sys_mem->write8(address, static_cast<uint8_t>(value & 0xFF));
 
 }
 
 void m68k_write_memory_16(unsigned int address, unsigned int value) {
+    if (sys_trace) {
+        sys_trace->write(address, value & 0xFFFF, 2);
+    }
     sys_mem->write16(address, static_cast<uint16_t>(value & 0xFFFF));
 
 }
 
 void m68k_write_memory_32(unsigned int address, unsigned int value) {
+    if (sys_trace) {
+        sys_trace->write(address, value, 4);
+    }
     sys_mem->write32(address, value);
 }
 
@@ -0,0 +1,52 @@
+//
+// What the tests share: stand-ins for main.cpp's handlers, and a ROM
+// image in a temporary file.
+//
+
+#ifndef ROSCOM68K_EMU_TEST_ROM_H
+#define ROSCOM68K_EMU_TEST_ROM_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include "../musashi/m68k.h"
+
+// Nothing in the tests traps or takes interrupts
+extern "C" {
+    int illegal_instruction_handler(int) {
+        return 0;
+    }
+
+    int interrupt_ack_handler(unsigned int) {
+        return M68K_INT_ACK_AUTOVECTOR;
+    }
+}
+
+// A ROM image on disk for as long as this is in scope
+class TestRom {
+public:
+    TestRom(const unsigned char *image, std::size_t size) {
+        char name[] = "/tmp/r68k-test-XXXXXX";
+        int fd = mkstemp(name);
+
+        if (fd < 0 || write(fd, image, size) != (ssize_t)size) {
+            perror("ROM image");
+            std::exit(EXIT_FAILURE);
+        }
+        close(fd);
+        this->name = name;
+    }
+
+    ~TestRom() { unlink(this->name.c_str()); }
+
+    TestRom(const TestRom&) = delete;
+    TestRom& operator=(const TestRom&) = delete;
+
+    const char* path() const { return this->name.c_str(); }
+
+private:
+    std::string name;
+};
+
+#endif //ROSCOM68K_EMU_TEST_ROM_H
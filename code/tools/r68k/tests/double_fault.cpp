@@ -0,0 +1,40 @@
+//
+// A bus error while stacking another must halt the CPU, on a memory map
+// with nothing at all outside RAM and ROM.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include "Machine.h"
+#include "TestRom.h"
+
+using namespace rosco::m68k::emu;
+
+// Supervisor stack in unmapped memory, then read from unmapped memory: the
+// bus error's frame can't be stacked
+static const unsigned char rom[] = {
+    0x00, 0x90, 0x00, 0x00,             // SSP
+    0x00, 0xe0, 0x00, 0x08,             // PC
+    0x4a, 0x39, 0x00, 0x80, 0x00, 0x00, // tst.b $800000
+    0x60, 0xfe,                         // bra.s *
+};
+
+int main() {
+    TestRom romFile(rom, sizeof(rom));
+
+    MemoryMap map;
+    map.add(MemoryRegion { MemoryRegion::Ram, 0x00000000, 0x00010000 });
+    map.add(MemoryRegion { MemoryRegion::Rom, 0x00e00000, 0x00010000 });
+    map.busErrors = true;
+
+    Machine machine(romFile.path(), 10000000, "/dev/null", false, map);
+    machine.run(1000000);
+
+    if (!machine.halted()) {
+        fprintf(stderr, "double_fault: FAIL: CPU didn't halt\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("double_fault: ok\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+//
+// Fuzzing a target that writes to an I/O slot: the checkpoint only covers
+// RAM, so rolling back must leave the slot alone.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include "Coverage.h"
+#include "Fuzzer.h"
+#include "Machine.h"
+#include "TestRom.h"
+
+using namespace rosco::m68k::emu;
+
+#define TARGET  0x00e00012
+
+static const unsigned char rom[] = {
+    0x00, 0x01, 0x00, 0x00,             // SSP
+    0x00, 0xe0, 0x00, 0x08,             // PC
+    0x4e, 0xb9, 0x00, 0xe0, 0x00, 0x12, // jsr target
+    0x60, 0xfe,                         // bra.s *
+    0x4e, 0x71,                         // nop
+    0x13, 0xfc, 0x00, 0x01, 0x00, 0xf8, // target: move.b #1,$f80000
+    0x00, 0x00,
+    0x4e, 0x75,                         // rts
+};
+
+int main() {
+    TestRom romFile(rom, sizeof(rom));
+
+    MemoryMap map;
+    map.add(MemoryRegion { MemoryRegion::Ram, 0x00000000, 0x00010000 });
+    map.add(MemoryRegion { MemoryRegion::Rom, 0x00e00000, 0x00010000 });
+    map.add(MemoryRegion { MemoryRegion::Io, 0x00f00000, 0x00100000 });
+
+    Machine machine(romFile.path(), 10000000, "/dev/null", false, map);
+    Coverage coverage;
+
+    if (!machine.runTo(TARGET, 1000000)) {
+        fprintf(stderr, "fuzz_io: FAIL: never reached the target\n");
+        return EXIT_FAILURE;
+    }
+    machine.setCoverage(&coverage);
+    machine.setStopOnFault(true);
+
+    Fuzzer fuzzer(machine, coverage, TARGET, TARGET + 16, 1000000);
+
+    for (int run = 0; run < 20; run++) {
+        Fuzzer::Outcome outcome = fuzzer.execute(Fuzzer::Input(run, 0x55));
+
+        if (outcome != Fuzzer::Outcome::Returned) {
+            fprintf(stderr, "fuzz_io: FAIL: run %d: %s\n", run, Fuzzer::describe(outcome));
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("fuzz_io: ok\n");
+    return EXIT_SUCCESS;
+}